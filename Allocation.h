@@ -3,12 +3,18 @@
 
 #include "allocator.h"
 #include "allocator_wrapper.h"
+#include "thread_cache.h"
+#include "pool_allocator.h"
+#include "monotonic_arena.h"
+#include "trace.h"
 
 #include <memory>
+#include <new>
 #include <vector>
 #include <map>
 #include <list>
 #include <set> 
+#include <cstdlib>
 
 /**
  * This file is just used to override standard containers and
@@ -16,26 +22,127 @@
  */
 
 inline static Memory_Linked_List mll{};
-inline static allocator_wrapper<intptr_t> memory{};
+
+/**
+ * records new and delete to the trace file named by the ALLOCATOR_TRACE environment variable, if it is set.
+ */
+inline static bool trace_started = Trace_Recorder::start(std::getenv("ALLOCATOR_TRACE"));
+
+/**
+ * new and delete go through the thread caches, so they can be used from any thread. Their blocks are aligned on 16
+ * bytes, the alignment new must give, so they are handed out as they are.
+ */
+static_assert(alignof(Block) >= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "thread cache blocks must be aligned like new");
 
 void* operator new(std::size_t size)
 {
-    return memory.allocate(size);
+    auto pointer = Thread_Cache::allocate(size);
+    if (pointer == nullptr)
+    {
+        throw std::bad_alloc{};
+    }
+    if (Trace_Recorder::enabled())
+    {
+        Trace_Recorder::record_alloc(pointer, size);
+    }
+    return pointer;
 }
 
 void operator delete(void* pointer) noexcept
 {
-    memory.deallocate(static_cast<intptr_t*>(pointer), 0);
+    if (Trace_Recorder::enabled())
+    {
+        Trace_Recorder::record_free(pointer);
+    }
+    Thread_Cache::deallocate(pointer);
+}
+
+void operator delete(void* pointer, std::size_t size) noexcept
+{
+    if (Trace_Recorder::enabled())
+    {
+        Trace_Recorder::record_free(pointer);
+    }
+    Thread_Cache::deallocate(pointer, size);
 }
 
 void* operator new[](std::size_t size)
 {
-    return memory.allocate(size);
+    auto pointer = Thread_Cache::allocate(size);
+    if (pointer == nullptr)
+    {
+        throw std::bad_alloc{};
+    }
+    if (Trace_Recorder::enabled())
+    {
+        Trace_Recorder::record_alloc(pointer, size);
+    }
+    return pointer;
 }
 
 void operator delete[](void* pointer) noexcept
 {
-    memory.deallocate(static_cast<intptr_t*>(pointer), 0);
+    if (Trace_Recorder::enabled())
+    {
+        Trace_Recorder::record_free(pointer);
+    }
+    Thread_Cache::deallocate(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t size) noexcept
+{
+    if (Trace_Recorder::enabled())
+    {
+        Trace_Recorder::record_free(pointer);
+    }
+    Thread_Cache::deallocate(pointer, size);
+}
+
+/**
+ * Over-aligned types (alignas bigger than 16) come here. Sized deletes of aligned memory ignore the size, as the
+ * blocks do not belong to a size class.
+ */
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    auto pointer = Thread_Cache::allocate_aligned(size, static_cast<std::size_t>(alignment));
+    if (pointer == nullptr)
+    {
+        throw std::bad_alloc{};
+    }
+    if (Trace_Recorder::enabled())
+    {
+        Trace_Recorder::record_alloc(pointer, size);
+    }
+    return pointer;
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept
+{
+    if (Trace_Recorder::enabled())
+    {
+        Trace_Recorder::record_free(pointer);
+    }
+    Thread_Cache::deallocate(pointer);
+}
+
+void operator delete(void* pointer, std::size_t, std::align_val_t alignment) noexcept
+{
+    operator delete(pointer, alignment);
+}
+
+void operator delete[](void* pointer, std::align_val_t alignment) noexcept
+{
+    operator delete(pointer, alignment);
+}
+
+void operator delete[](void* pointer, std::size_t, std::align_val_t alignment) noexcept
+{
+    operator delete(pointer, alignment);
 }
 
 template <typename T>
@@ -50,4 +157,28 @@ using list = std::list<T, allocator_wrapper<T>>;
 template <typename T>
 using set = std::set<T, std::less<T>, allocator_wrapper<T>>;
 
+/**
+ * Node based containers with their nodes in a pool_allocator.
+ */
+template <typename K, typename V>
+using pool_map = std::map<K, V, std::less<K>, pool_allocator<std::pair<const K, V>>>;
+
+template <typename T>
+using pool_list = std::list<T, pool_allocator<T>>;
+
+template <typename T>
+using pool_set = std::set<T, std::less<T>, pool_allocator<T>>;
+
+/**
+ * Containers bound to a Monotonic_Arena, which must be passed to their constructor.
+ */
+template <typename T>
+using arena_vector = std::vector<T, arena_allocator<T>>;
+
+template <typename K, typename V>
+using arena_map = std::map<K, V, std::less<K>, arena_allocator<std::pair<const K, V>>>;
+
+template <typename T>
+using arena_list = std::list<T, arena_allocator<T>>;
+
 #endif // ALLOCATORSANDMEMORYPOOL_ALLOCATION_H
@@ -3,330 +3,2362 @@
 //
 
 #include <utility>
+#include <bit>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/mempolicy.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include <iostream>
 #include "allocator.h"
 
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#ifdef ALLOCATOR_HARDENED
+/**
+ * Reports a misuse of the heap and aborts. stderr is unbuffered, so the message is written without allocating from a
+ * heap that can not be trusted anymore.
+ */
+[[noreturn]] static void heap_corruption(const char *message, const void *data)
+{
+    std::fprintf(stderr, "allocator: %s (%p)\n", message, data);
+    std::abort();
+}
+#endif
+
+/**
+ * Returns where a pointer of a heap file points once the file is mapped delta bytes further, nullptr staying nullptr.
+ */
+template <typename T>
+static T *relocated(T *pointer, std::ptrdiff_t delta)
+{
+    if (pointer == nullptr)
+    {
+        return nullptr;
+    }
+    return reinterpret_cast<T *>(reinterpret_cast<std::uintptr_t>(pointer) + delta);
+}
+
 Memory_Linked_List::Memory_Linked_List() : m_initial{nullptr},
-                                           m_start{m_initial},
-                                           m_next_fit_chunk{nullptr},
                                            m_end{nullptr},
+                                           m_next_fit_chunk{nullptr},
                                            f_list_initial{nullptr},
-                                           f_list_start{nullptr},
-                                           f_list_end{nullptr}
+                                           f_list_end{nullptr},
+                                           m_bins{},
+                                           m_bins_end{},
+                                           m_bin_map{0},
+                                           m_slabs{},
+                                           m_slab_areas{nullptr},
+                                           m_top{nullptr},
+                                           m_region{nullptr},
+                                           m_stats{},
+                                           m_sample_countdown{PTRDIFF_MAX},
+                                           m_file{nullptr},
+                                           m_file_descriptor{-1},
+                                           m_recovered{false},
+                                           m_epoch{0},
+                                           m_next_epoch{},
+                                           m_decay_countdown{decay_check_interval}
+{
+#ifdef ALLOCATOR_HARDENED
+    // different for every heap and every run, so a canary copied from another heap or another run does not match
+    auto now = static_cast<std::uintptr_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+    m_secret = (reinterpret_cast<std::uintptr_t>(this) ^ now) * 0x9e3779b97f4a7c15;
+#endif
+}
+
+Memory_Linked_List::~Memory_Linked_List()
+{
+    // the memory of a file heap stays in the file, which is written to the disk before it is marked clean
+    if (m_file != nullptr)
+    {
+        auto capacity = m_file->capacity;
+        save_file_state();
+        msync(m_file, m_file->brk - reinterpret_cast<char *>(m_file), MS_SYNC);
+        m_file->clean = 1;
+        msync(m_file, sizeof(Heap_File), MS_SYNC);
+        munmap(m_file, capacity);
+        ::close(m_file_descriptor);
+        return;
+    }
+
+    // the first Chunk of every large mapping, chained through prev, as the lists go through the mappings
+    Chunk *mappings = nullptr;
+    auto collect = [&](Chunk *first)
+    {
+        for (auto chunk = first; chunk != nullptr; chunk = chunk->next)
+        {
+            if (!chunk->prev_adjacent && region_of(chunk) == nullptr)
+            {
+                chunk->prev = mappings;
+                mappings = chunk;
+            }
+        }
+    };
+    collect(m_initial);
+    collect(f_list_initial);
+    for (auto bin : m_bins)
+    {
+        collect(bin);
+    }
+
+    if (m_mmap_mode == mmap_mode::mmap)
+    {
+        while (mappings != nullptr)
+        {
+            auto next = mappings->prev;
+            munmap(mappings, mapping_size(mappings) + guard_size());
+            mappings = next;
+        }
+        while (m_region != nullptr)
+        {
+            auto next = m_region->next;
+            munmap(m_region, m_region->end - reinterpret_cast<char *>(m_region));
+            m_region = next;
+        }
+        while (m_slab_areas != nullptr)
+        {
+            auto next = m_slab_areas->next;
+            munmap(m_slab_areas, m_slab_areas->end - reinterpret_cast<char *>(m_slab_areas));
+            m_slab_areas = next;
+        }
+        return;
+    }
+
+    // the break only moves down over the memory at its top, until it belongs to someone else
+    while (true)
+    {
+        auto top = static_cast<char *>(sbrk(0));
+        char *start = nullptr;
+
+        for (auto link = &mappings; *link != nullptr; link = &(*link)->prev)
+        {
+            if (reinterpret_cast<char *>(*link) + mapping_size(*link) == top)
+            {
+                start = reinterpret_cast<char *>(*link);
+                *link = (*link)->prev;
+                break;
+            }
+        }
+        for (auto link = &m_region; start == nullptr && *link != nullptr; link = &(*link)->next)
+        {
+            if ((*link)->end == top)
+            {
+                start = reinterpret_cast<char *>(*link);
+                *link = (*link)->next;
+                break;
+            }
+        }
+        for (auto link = &m_slab_areas; start == nullptr && *link != nullptr; link = &(*link)->next)
+        {
+            if ((*link)->end == top)
+            {
+                start = reinterpret_cast<char *>(*link);
+                *link = (*link)->next;
+                break;
+            }
+        }
+
+        if (start == nullptr)
+        {
+            return;
+        }
+        sbrk(-static_cast<std::intptr_t>(top - start));
+    }
+}
+
+intptr_t *Memory_Linked_List::alloc(std::size_t size)
+{
+    // the rounding of a bigger size would wrap around to a small Chunk
+    if (size > max_alloc_size)
+    {
+        return nullptr;
+    }
+
+    // whole cache lines, aligned on a cache line
+    if (m_cache_line_aligned)
+    {
+        return alloc_aligned(size, cache_line_size);
+    }
+
+    // the allocation holding the next sampled byte goes to the profiler, the others only count their bytes
+    m_sample_countdown -= static_cast<std::ptrdiff_t>(size);
+    if (m_sample_countdown < 0)
+    {
+        return alloc_sampled(size, alignof(intptr_t), 0);
+    }
+
+    // small objects go in a slab of their size class, or in a Chunk when out of memory for a new slab
+    if (m_search_mode == search_mode::slab && size <= slab_max_size)
+    {
+        if (auto data = slab_alloc(size))
+        {
+            return data;
+        }
+    }
+    return alloc_chunk(size);
+}
+
+intptr_t *Memory_Linked_List::alloc_aligned(std::size_t size, std::size_t alignment, std::size_t offset)
+{
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0 || size > max_alloc_size)
+    {
+        return nullptr;
+    }
+
+    // whole cache lines, aligned on a cache line, in cache line aligned mode
+    if (m_cache_line_aligned)
+    {
+        alignment = std::max(alignment, cache_line_size);
+        size = cache_lines(size);
+    }
+
+    m_sample_countdown -= static_cast<std::ptrdiff_t>(size);
+    if (m_sample_countdown < 0)
+    {
+        return alloc_sampled(size, alignment, offset);
+    }
+    return alloc_aligned_chunk(size, alignment, offset);
+}
+
+intptr_t *Memory_Linked_List::alloc_aligned_chunk(std::size_t size, std::size_t alignment, std::size_t offset)
+{
+    // every Chunk is aligned on 8 bytes already
+    auto aligned = align(size);
+    if (alignment <= alignof(intptr_t))
+    {
+        return alloc_chunk(aligned);
+    }
+
+    // the aligned address is less than alignment bytes away, plus room for a free Chunk before it
+    if (aligned + allocSize(min_chunk_size) > max_alloc_size ||
+        alignment > max_alloc_size - aligned - allocSize(min_chunk_size))
+    {
+        return nullptr;
+    }
+    auto raw = alloc_chunk(aligned + alignment + allocSize(min_chunk_size));
+    if (raw == nullptr)
+    {
+        return nullptr;
+    }
+
+    // the first aligned address that leaves nothing, or enough for a Chunk, before it
+    auto start = reinterpret_cast<std::uintptr_t>(raw);
+    auto target = ((start + offset + alignment - 1) & ~(alignment - 1)) - offset;
+    while (target != start && target - start < allocSize(min_chunk_size))
+    {
+        target += alignment;
+    }
+
+    auto chunk = get_header(raw);
+    if (target != start)
+    {
+        // the aligned Chunk takes the end of the raw Chunk
+        auto lead = target - start;
+        auto aligned_chunk = get_header(reinterpret_cast<intptr_t *>(target));
+        aligned_chunk->size = chunk->size - lead;
+        aligned_chunk->used = true;
+        aligned_chunk->prev_adjacent = true;
+        aligned_chunk->next_adjacent = chunk->next_adjacent;
+        aligned_chunk->mapped = false;
+        aligned_chunk->sampled = false;
+#ifdef ALLOCATOR_HARDENED
+        seal(aligned_chunk);
+#endif
+
+        // the start becomes a free Chunk, its left neighbour is used since the raw Chunk was coalesced when freed
+        chunk->size = lead - allocSize(0);
+        chunk->used = false;
+        chunk->next_adjacent = true;
+        update_boundary(chunk);
+        if (m_top == chunk)
+        {
+            m_top = aligned_chunk;
+        }
+
+        unlink_chunk(m_initial, m_end, chunk);
+        push_chunk(m_initial, m_end, aligned_chunk);
+        m_stats.live_bytes -= lead;
+
+        switch (m_search_mode)
+        {
+        case search_mode::free_list:
+            free_listing(chunk);
+            break;
+        case search_mode::segregated:
+        case search_mode::slab:
+            segregated_listing(chunk);
+            break;
+        default:
+            push_chunk(m_initial, m_end, chunk);
+            break;
+        }
+        chunk = aligned_chunk;
+    }
+
+    // gives the end back
+    auto before = chunk->size;
+    split(chunk, aligned);
+    m_stats.live_bytes -= before - chunk->size;
+    return chunk->data;
+}
+
+intptr_t *Memory_Linked_List::alloc_sampled(std::size_t size, std::size_t alignment, std::size_t offset)
+{
+    m_sample_countdown = m_profile.next_countdown();
+
+    // a Chunk even in a slab mode, so free() knows it is a sample from its header
+    auto data = alloc_aligned_chunk(size, alignment, offset);
+
+    // the profiler is off, and PTRDIFF_MAX bytes went by
+    if (data == nullptr || m_profile.interval() == 0)
+    {
+        return data;
+    }
+    get_header(data)->sampled = m_profile.record(data, size);
+    return data;
+}
+
+std::size_t Memory_Linked_List::alloc_batch(std::size_t size, std::size_t count, intptr_t **out)
+{
+    std::size_t done{0};
+    if (size > max_alloc_size)
+    {
+        return done;
+    }
+
+    // cache line aligned blocks are cut differently, they are allocated one by one
+    if (m_cache_line_aligned)
+    {
+        for (; done < count; done++)
+        {
+            out[done] = alloc(size);
+            if (out[done] == nullptr)
+            {
+                break;
+            }
+        }
+        return done;
+    }
+
+    // the blocks before the next sampled byte are allocated together, the one holding it by alloc()
+    while (done < count)
+    {
+        auto unsampled = std::min(count - done,
+                                  static_cast<std::size_t>(m_sample_countdown) / std::max<std::size_t>(size, 1));
+        if (unsampled != 0)
+        {
+            auto blocks = alloc_batch_blocks(size, unsampled, out + done);
+            m_sample_countdown -= static_cast<std::ptrdiff_t>(blocks * size);
+            done += blocks;
+            if (blocks < unsampled || done == count)
+            {
+                break;
+            }
+        }
+
+        out[done] = alloc(size);
+        if (out[done] == nullptr)
+        {
+            break;
+        }
+        done++;
+    }
+    return done;
+}
+
+std::size_t Memory_Linked_List::alloc_batch_blocks(std::size_t size, std::size_t count, intptr_t **out)
+{
+    std::size_t done{0};
+
+    // small objects from the slabs, the rest in chunks if out of memory for a new slab
+    if (m_search_mode == search_mode::slab && size <= slab_max_size)
+    {
+        done = slab_alloc_batch(size, count, out);
+    }
+
+    // runs of chunks, small enough to be carved from a region
+    auto aligned = align(size);
+    auto run_length = std::max<std::size_t>(m_large_threshold / allocSize(aligned), 1);
+    while (done < count)
+    {
+        auto run = alloc_run(aligned, std::min(run_length, count - done), out + done);
+        if (run == 0)
+        {
+            break;
+        }
+        done += run;
+    }
+    return done;
+}
+
+std::size_t Memory_Linked_List::alloc_run(std::size_t size, std::size_t count, intptr_t **out)
+{
+    // one chunk holding every header and payload of the run
+    auto stride = allocSize(size);
+    auto data = alloc_chunk(count * stride - allocSize(0));
+    if (data == nullptr)
+    {
+        return 0;
+    }
+
+    auto first = get_header(data);
+    auto total = first->size;
+    auto next_adjacent = first->next_adjacent;
+    out[0] = data;
+
+    // cuts it in chunks that follow each other, the last one takes the rest of the run. Every new chunk covers the rest
+    // of the run before the one before it shrinks, so the chunks can be walked by their sizes at any time
+    auto last = first;
+    for (std::size_t i = 1; i < count; i++)
+    {
+        auto chunk = reinterpret_cast<Chunk *>(reinterpret_cast<char *>(first) + i * stride);
+        chunk->size = total - i * stride;
+        chunk->used = true;
+        chunk->prev_adjacent = true;
+        chunk->prev_free = false;
+        chunk->next_adjacent = true;
+        chunk->mapped = false;
+        chunk->sampled = false;
+#ifdef ALLOCATOR_HARDENED
+        seal(chunk);
+#endif
+        last->size = size;
+        last->next_adjacent = true;
+        push_chunk(m_initial, m_end, chunk);
+        out[i] = chunk->data;
+        last = chunk;
+    }
+    last->next_adjacent = next_adjacent;
+    if (m_top == first)
+    {
+        m_top = last;
+    }
+
+    // the run was rounded up to a size class, the last block gives the excess back, merged with its free right
+    // neighbour, so a sized free of it sees the size it was allocated with
+    auto before = last->size;
+    auto next = next_neighbour(last);
+    if (next != nullptr && !next->used)
+    {
+        unlink_free(next);
+        merge(last, next);
+    }
+    split(last, size);
+    m_stats.live_bytes -= before - last->size;
+
+    // alloc_chunk counted a single block of the whole run
+    m_stats.allocs += count - 1;
+    m_stats.live_blocks += count - 1;
+    m_stats.live_bytes -= (count - 1) * allocSize(0);
+    m_stats.peak_blocks = std::max(m_stats.peak_blocks, m_stats.live_blocks);
+    return count;
+}
+
+intptr_t *Memory_Linked_List::alloc_chunk(std::size_t size)
+{
+    // gets the minimum memory needed for allocation
+    auto aligned = align(size);
+    m_stats.allocs++;
+
+    // looks for chunks that are freed
+
+    if (auto freed_chunk = find_chunk(aligned))
+    {
+        // sets free chunk flag to used
+        freed_chunk->used = true;
+        update_boundary(freed_chunk);
+        // gives the end of the chunk back if it is too big
+        split(freed_chunk, aligned);
+
+        m_stats.hits[Allocator_Stats::class_of(aligned)]++;
+        count_live(freed_chunk);
+        // gives a pointer to the freed chunk
+        return freed_chunk->data;
+    }
+
+    // requests data from memory
+    auto chunk = memory_map(aligned);
+
+    // out of memory
+    if (chunk == nullptr)
+    {
+        return nullptr;
+    }
+
+    // sets its header, memory_map() wrote its size
+    chunk->used = true;
+
+    // initialises the list
+    if (m_initial == nullptr)
+    {
+        m_next_fit_chunk = chunk;
+    }
+
+    // linking chunk at the end of the list
+    push_chunk(m_initial, m_end, chunk);
+
+    m_stats.misses[Allocator_Stats::class_of(aligned)]++;
+    count_live(chunk);
+
+    // returning a pointer to the data
+    return chunk->data;
+}
+
+intptr_t *Memory_Linked_List::slab_alloc(std::size_t size)
+{
+    auto aligned = align(size);
+    if (aligned > slab_max_size)
+    {
+        return nullptr;
+    }
+
+    auto index = Size_Classes::index(aligned);
+    auto slab = m_slabs[index];
+    m_stats.allocs++;
+
+    // no slab of this class has a free object, a new one is started
+    if (slab == nullptr)
+    {
+        slab = slab_page();
+        if (slab == nullptr)
+        {
+            m_stats.allocs--;
+            return nullptr;
+        }
+
+        slab->next = nullptr;
+        slab->prev = nullptr;
+        slab->size = static_cast<std::uint32_t>(aligned);
+        slab->capacity = static_cast<std::uint16_t>((slab_page_size - sizeof(Slab)) / aligned);
+        slab->free_count = slab->capacity;
+
+        // one set bit per object
+        for (std::size_t i = 0; i < Slab::bitmap_words; i++)
+        {
+            auto first = i * 64;
+            auto count = first >= slab->capacity ? 0 : std::min<std::size_t>(slab->capacity - first, 64);
+            slab->bitmap[i] = count == 64 ? ~std::uint64_t{0} : (std::uint64_t{1} << count) - 1;
+        }
+        m_slabs[index] = slab;
+        m_stats.misses[Allocator_Stats::class_of(aligned)]++;
+    }
+    else
+    {
+        m_stats.hits[Allocator_Stats::class_of(aligned)]++;
+    }
+
+    auto object = slab_find_free(slab);
+    slab->bitmap[object / 64] &= ~(std::uint64_t{1} << (object % 64));
+
+    // a full slab leaves the list
+    if (--slab->free_count == 0)
+    {
+        m_slabs[index] = slab->next;
+        if (slab->next != nullptr)
+        {
+            slab->next->prev = nullptr;
+        }
+    }
+
+    m_stats.live_bytes += aligned;
+    m_stats.live_blocks++;
+    m_stats.peak_bytes = std::max(m_stats.peak_bytes, m_stats.live_bytes);
+    m_stats.peak_blocks = std::max(m_stats.peak_blocks, m_stats.live_blocks);
+    return reinterpret_cast<intptr_t *>(reinterpret_cast<char *>(slab + 1) + object * aligned);
+}
+
+std::size_t Memory_Linked_List::slab_alloc_batch(std::size_t size, std::size_t count, intptr_t **out)
 {
+    auto aligned = align(size);
+    if (aligned > slab_max_size)
+    {
+        return 0;
+    }
+
+    auto index = Size_Classes::index(aligned);
+    std::size_t done{0};
+    while (done < count)
+    {
+        // one object from the first slab with free objects, or from a new one, keeps the list up to date
+        auto data = slab_alloc(aligned);
+        if (data == nullptr)
+        {
+            break;
+        }
+        out[done++] = data;
+
+        // then every free object of the slab, or as many as needed, a bitmap word at a time
+        auto slab = reinterpret_cast<Slab *>(reinterpret_cast<std::uintptr_t>(data) & ~(slab_page_size - 1));
+        auto objects = reinterpret_cast<char *>(slab + 1);
+        std::size_t taken{0};
+        for (std::size_t i = 0; i < Slab::bitmap_words && slab->free_count - taken != 0 && done < count; i++)
+        {
+            auto word = slab->bitmap[i];
+            while (word != 0 && done < count)
+            {
+                auto object = i * 64 + std::countr_zero(word);
+                word &= word - 1;
+                out[done++] = reinterpret_cast<intptr_t *>(objects + object * aligned);
+                taken++;
+            }
+            slab->bitmap[i] = word;
+        }
+        if (taken == 0)
+        {
+            continue;
+        }
+
+        // a full slab leaves the list, it is the first one
+        slab->free_count -= static_cast<std::uint16_t>(taken);
+        if (slab->free_count == 0 && m_slabs[index] == slab)
+        {
+            m_slabs[index] = slab->next;
+            if (slab->next != nullptr)
+            {
+                slab->next->prev = nullptr;
+            }
+        }
+
+        m_stats.allocs += taken;
+        m_stats.hits[Allocator_Stats::class_of(aligned)] += taken;
+        m_stats.live_bytes += taken * aligned;
+        m_stats.live_blocks += taken;
+        m_stats.peak_bytes = std::max(m_stats.peak_bytes, m_stats.live_bytes);
+        m_stats.peak_blocks = std::max(m_stats.peak_blocks, m_stats.live_blocks);
+    }
+    return done;
+}
+
+void Memory_Linked_List::slab_free(Slab *slab, intptr_t *data)
+{
+    auto was_full = slab->free_count == 0;
+    if (slab_mark_free(slab, data))
+    {
+        slab_relist(slab, was_full);
+        decay(false);
+    }
+}
+
+bool Memory_Linked_List::slab_mark_free(Slab *slab, intptr_t *data)
+{
+    auto offset = reinterpret_cast<char *>(data) - reinterpret_cast<char *>(slab + 1);
+    auto object = static_cast<std::size_t>(offset) / slab->size;
+    auto bit = std::uint64_t{1} << (object % 64);
+
+    // not the start of an object, or an object that is free already
+    auto valid = offset >= 0 && offset % slab->size == 0 && object < slab->capacity;
+    if (!valid || (slab->bitmap[object / 64] & bit) != 0)
+    {
+#ifdef ALLOCATOR_HARDENED
+        heap_corruption(valid ? "double free" : "free of a pointer that is not an object of its slab", data);
+#endif
+        return false;
+    }
+#ifdef ALLOCATOR_HARDENED
+    std::memset(data, free_poison, slab->size);
+#endif
+    slab->bitmap[object / 64] |= bit;
+    slab->free_count++;
+
+    m_stats.frees++;
+    m_stats.live_bytes -= slab->size;
+    m_stats.live_blocks--;
+    return true;
+}
+
+void Memory_Linked_List::slab_relist(Slab *slab, bool was_full)
+{
+    auto index = Size_Classes::index(slab->size);
+    auto &first = m_slabs[index];
+
+    // a full slab has a free object again, it goes first so the next alloc uses its page, which is in cache
+    if (was_full)
+    {
+        slab->prev = nullptr;
+        slab->next = first;
+        if (first != nullptr)
+        {
+            first->prev = slab;
+        }
+        first = slab;
+    }
+
+    // an empty slab gives its page back, unless it is the last one of its class, so a single object allocated and
+    // freed over and over does not start a new slab every time
+    if (slab->free_count == slab->capacity && (first != slab || slab->next != nullptr))
+    {
+        if (slab->prev != nullptr)
+        {
+            slab->prev->next = slab->next;
+        }
+        else
+        {
+            first = slab->next;
+        }
+        if (slab->next != nullptr)
+        {
+            slab->next->prev = slab->prev;
+        }
+
+        auto area = slab_area_of(slab);
+        area->empty[area->empty_count++] =
+            static_cast<std::uint32_t>((reinterpret_cast<char *>(slab) - area->first) / slab_page_size);
+    }
+}
+
+std::size_t Memory_Linked_List::slab_find_free(const Slab *slab)
+{
+#ifdef __AVX2__
+    // four words at a time, the first one that is not zero holds the first free object
+    for (std::size_t i = 0; i < Slab::bitmap_words; i += 4)
+    {
+        auto words = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(slab->bitmap + i));
+        auto zero = _mm256_cmpeq_epi64(words, _mm256_setzero_si256());
+        auto zero_words = static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(zero)));
+        if (zero_words != 0xf)
+        {
+            auto word = i + std::countr_one(zero_words);
+            return word * 64 + std::countr_zero(slab->bitmap[word]);
+        }
+    }
+#else
+    // tzcnt on the first word that is not zero
+    for (std::size_t i = 0; i < Slab::bitmap_words; i++)
+    {
+        if (slab->bitmap[i] != 0)
+        {
+            return i * 64 + std::countr_zero(slab->bitmap[i]);
+        }
+    }
+#endif
+    // a slab with free objects always has a set bit
+    return 0;
+}
+
+Slab *Memory_Linked_List::slab_page()
+{
+    // an empty page, or a page never used, of an area
+    for (auto area = m_slab_areas; area != nullptr; area = area->next)
+    {
+        if (area->empty_count != 0)
+        {
+            auto page = area->first + area->empty[--area->empty_count] * slab_page_size;
+            area->aged_count = std::min(area->aged_count, area->empty_count);
+            area->purged_count = std::min(area->purged_count, area->empty_count);
+            return reinterpret_cast<Slab *>(page);
+        }
+        if (area->end - area->bump >= static_cast<std::ptrdiff_t>(slab_page_size))
+        {
+            auto page = area->bump;
+            area->bump += slab_page_size;
+            return reinterpret_cast<Slab *>(page);
+        }
+    }
+
+    // every area is full, a new one is reserved
+    auto area = static_cast<Slab_Area *>(memory_request(slab_area_size));
+    if (area == nullptr)
+    {
+        return nullptr;
+    }
+
+    // the pages start after the stack, on a page boundary
+    auto start = reinterpret_cast<std::uintptr_t>(area);
+    auto header = sizeof(Slab_Area) + (slab_area_size / slab_page_size - 1) * sizeof(std::uint32_t);
+    area->next = m_slab_areas;
+    area->first = reinterpret_cast<char *>((start + header + slab_page_size - 1) & ~(slab_page_size - 1));
+    area->bump = area->first + slab_page_size;
+    area->end = reinterpret_cast<char *>(area) + slab_area_size;
+    area->empty_count = 0;
+    area->aged_count = 0;
+    area->purged_count = 0;
+    m_slab_areas = area;
+    if (m_file != nullptr)
+    {
+        m_file->slab_areas = area;
+    }
+    return reinterpret_cast<Slab *>(area->first);
+}
+
+Slab_Area *Memory_Linked_List::slab_area_of(const void *data) const
+{
+    for (auto area = m_slab_areas; area != nullptr; area = area->next)
+    {
+        if (data >= area->first && data < area->bump)
+        {
+            return area;
+        }
+    }
+    return nullptr;
+}
+
+Slab *Memory_Linked_List::slab_of(const void *data) const
+{
+    // the slab is at the start of the page
+    if (m_slab_areas == nullptr || slab_area_of(data) == nullptr)
+    {
+        return nullptr;
+    }
+    return reinterpret_cast<Slab *>(reinterpret_cast<std::uintptr_t>(data) & ~(slab_page_size - 1));
+}
+
+std::size_t Memory_Linked_List::align(std::size_t size)
+{
+    // minimum data size is 8, then steps of at most 1.25 times
+    return Size_Classes::round(size);
+}
+
+std::size_t Memory_Linked_List::cache_lines(std::size_t size)
+{
+    return (std::max<std::size_t>(size, 1) + cache_line_size - 1) & ~(cache_line_size - 1);
+}
+
+std::size_t Memory_Linked_List::allocSize(std::size_t size)
+{
+    // size of data + size of header - initial data, the footer of free chunks is in their data
+    return size + sizeof(Chunk) - sizeof(std::declval<Chunk>().data);
+}
+
+std::size_t *Memory_Linked_List::get_footer(Chunk *chunk)
+{
+    // the footer is the last word of the chunk
+    return reinterpret_cast<std::size_t *>(reinterpret_cast<char *>(chunk) + allocSize(chunk->size)) - 1;
+}
+
+void Memory_Linked_List::update_boundary(Chunk *chunk)
+{
+    if (!chunk->used)
+    {
+        *get_footer(chunk) = chunk->size;
+
+        // its pages have been dirty since this epoch
+        if (chunk->size >= purge_min_size)
+        {
+            chunk->data[0] = static_cast<intptr_t>(m_epoch << 2);
+        }
+    }
+
+    // the right neighbour may only read the footer of a free chunk
+    if (auto next = next_neighbour(chunk))
+    {
+        next->prev_free = !chunk->used;
+    }
+}
+
+Chunk *Memory_Linked_List::next_neighbour(Chunk *chunk)
+{
+    if (!chunk->next_adjacent)
+    {
+        return nullptr;
+    }
+    return reinterpret_cast<Chunk *>(reinterpret_cast<char *>(chunk) + allocSize(chunk->size));
+}
+
+Chunk *Memory_Linked_List::prev_neighbour(Chunk *chunk)
+{
+    // used chunks have no footer
+    if (!chunk->prev_adjacent || !chunk->prev_free)
+    {
+        return nullptr;
+    }
+    // the footer of the previous chunk is right before the header
+    auto prev_size = *(reinterpret_cast<std::size_t *>(chunk) - 1);
+    return reinterpret_cast<Chunk *>(reinterpret_cast<char *>(chunk) - allocSize(prev_size));
+}
+
+#ifdef ALLOCATOR_HARDENED
+void Memory_Linked_List::seal(Chunk *chunk) const
+{
+    chunk->canary = m_secret ^ reinterpret_cast<std::uintptr_t>(chunk);
+}
+
+void Memory_Linked_List::check_chunk(Chunk *chunk) const
+{
+    // checked before reading the header, a misaligned pointer is not from alloc
+    if (reinterpret_cast<std::uintptr_t>(chunk) % alignof(Chunk) != 0 ||
+        chunk->canary != (m_secret ^ reinterpret_cast<std::uintptr_t>(chunk)))
+    {
+        heap_corruption("free of a pointer that is not a block of this heap, or whose header was overwritten",
+                        chunk->data);
+    }
+    if (!chunk->used)
+    {
+        heap_corruption("double free", chunk->data);
+    }
+
+    // the header after it is the first thing a write past its end hits
+    auto next = next_neighbour(chunk);
+    if (next != nullptr && next->canary != (m_secret ^ reinterpret_cast<std::uintptr_t>(next)))
+    {
+        heap_corruption("block written past its end", chunk->data);
+    }
+}
+#endif
+
+Chunk *Memory_Linked_List::memory_map(std::size_t size)
+{
+    // small chunks are carved from a region, and every chunk of a file heap, whose memory is only handed out in order
+    if (m_mmap_mode == mmap_mode::file || (m_region_size != 0 && allocSize(size) <= m_large_threshold))
+    {
+        return region_carve(size);
+    }
+
+    // large chunks get their own mapping, and have no physical neighbours
+    auto bytes = allocSize(size);
+    auto guard = guard_size();
+    if (guard != 0)
+    {
+        // the payload takes whole pages, so it ends right before the guard page
+        bytes = (bytes + guard - 1) & ~(guard - 1);
+    }
+
+    auto chunk = static_cast<Chunk *>(memory_request(bytes + guard));
+    if (chunk != nullptr)
+    {
+        if (guard != 0)
+        {
+            mprotect(reinterpret_cast<char *>(chunk) + bytes, guard, PROT_NONE);
+            m_stats.syscalls++;
+        }
+
+        // a mapping with a guard page is never remapped, the guard page would not follow
+        chunk->size = bytes - allocSize(0);
+        chunk->prev_adjacent = false;
+        chunk->prev_free = false;
+        chunk->next_adjacent = false;
+        chunk->mapped = m_mmap_mode == mmap_mode::mmap && guard == 0;
+        chunk->sampled = false;
+#ifdef ALLOCATOR_HARDENED
+        seal(chunk);
+#endif
+    }
+    return chunk;
+}
+
+Chunk *Memory_Linked_List::region_carve(std::size_t size)
+{
+    auto total_size = allocSize(size);
+
+    // reserves a new region if there is none or the current one is full
+    if (m_region == nullptr || m_region->end - m_region->bump < static_cast<std::ptrdiff_t>(total_size))
+    {
+        auto region_size = std::max(m_region_size, total_size + sizeof(Region));
+        auto region = static_cast<Region *>(memory_request(region_size));
+        if (region == nullptr)
+        {
+            return nullptr;
+        }
+
+        region->next = m_region;
+        region->bump = reinterpret_cast<char *>(region) + sizeof(Region);
+        region->end = reinterpret_cast<char *>(region) + region_size;
+        m_region = region;
+        if (m_file != nullptr)
+        {
+            m_file->regions = region;
+        }
+
+        // the first chunk of a region has no neighbour before it
+        m_top = nullptr;
+    }
+
+    // the last chunk carved from this region is right before this one
+    auto chunk = reinterpret_cast<Chunk *>(m_region->bump);
+    chunk->size = size;
+    chunk->prev_adjacent = m_top != nullptr;
+    chunk->prev_free = m_top != nullptr && !m_top->used;
+    chunk->next_adjacent = false;
+    chunk->mapped = false;
+    chunk->sampled = false;
+    if (m_top != nullptr)
+    {
+        m_top->next_adjacent = true;
+    }
+    m_top = chunk;
+#ifdef ALLOCATOR_HARDENED
+    seal(chunk);
+#endif
+
+    // bumps the pointer once the header is written, so everything up to the bump pointer is made of Chunks
+    m_region->bump += total_size;
+    return chunk;
+}
+
+void *Memory_Linked_List::memory_request(std::size_t bytes)
+{
+    void *memory = nullptr;
+    switch (m_mmap_mode)
+    {
+    case mmap_mode::sbrk:
+        m_stats.syscalls++;
+        memory = memory_map_sbrk(bytes);
+        break;
+    case mmap_mode::mmap:
+        m_stats.syscalls++;
+        memory = memory_map_mmap(bytes);
+        break;
+    case mmap_mode::file:
+        memory = memory_map_file(bytes);
+        break;
+    default:
+        throw std::runtime_error("No mememory mapping has been picked");
+        return nullptr;
+        break;
+    }
+
+    // a failed request maps nothing
+    if (memory != nullptr)
+    {
+        m_stats.mapped_bytes += bytes;
+    }
+    return memory;
+}
+
+void *Memory_Linked_List::memory_map_mmap(std::size_t bytes)
+{
+    auto flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if (m_no_reserve)
+    {
+        flags |= MAP_NORESERVE;
+    }
+
+    // huge pages need a mapping aligned on them, so a huge page more is mapped and the ends are cut off
+    auto huge = m_huge_pages && bytes >= huge_page_size;
+    auto mapped = huge ? bytes + huge_page_size : bytes;
+
+    // faults only take huge pages, or pages from the node, once they are asked for, so these are pre-faulted by hand
+    auto touch = m_populate && (huge || m_numa_node >= 0);
+    if (m_populate && !touch)
+    {
+        flags |= MAP_POPULATE;
+    }
+
+    // Use mmap to allocate memory with read/write permissions
+    void *addr = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, flags, -1, 0);
+
+    // Check if mmap failed
+    if (addr == MAP_FAILED)
+    {
+        return nullptr;
+    }
+
+    auto page = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+    auto start = reinterpret_cast<std::uintptr_t>(addr);
+    if (huge)
+    {
+        auto aligned = (start + huge_page_size - 1) & ~(huge_page_size - 1);
+        auto end = (aligned + bytes + page - 1) & ~(page - 1);
+        if (aligned != start)
+        {
+            munmap(addr, aligned - start);
+            m_stats.syscalls++;
+        }
+        if (end != start + mapped)
+        {
+            munmap(reinterpret_cast<void *>(end), start + mapped - end);
+            m_stats.syscalls++;
+        }
+
+        start = aligned;
+        madvise(reinterpret_cast<void *>(start), bytes, MADV_HUGEPAGE);
+        m_stats.syscalls++;
+    }
+
+    if (m_numa_node >= 0 && static_cast<std::size_t>(m_numa_node) < sizeof(unsigned long) * 8)
+    {
+        // the kernel reads one bit less than maxnode
+        unsigned long nodes = 1ul << m_numa_node;
+        syscall(SYS_mbind, start, bytes, MPOL_PREFERRED, &nodes, sizeof(nodes) * 8 + 1, 0);
+        m_stats.syscalls++;
+    }
+
+    // a write in every page
+    if (touch)
+    {
+        for (auto address = start; address < start + bytes; address += page)
+        {
+            *reinterpret_cast<volatile char *>(address) = 0;
+        }
+    }
+    return reinterpret_cast<void *>(start);
+}
+
+void *Memory_Linked_List::memory_map_sbrk(std::size_t bytes)
+{
+    // program break
+    auto chunk = sbrk(0);
+
+    // check if it will be OOM
+    if (sbrk(bytes) == (void *)-1)
+    {
+        return nullptr;
+    }
+    return chunk;
+}
+
+void *Memory_Linked_List::memory_map_file(std::size_t bytes)
+{
+    // the file does not grow, it was made as big as the heap can get
+    auto start = m_file->brk;
+    if (reinterpret_cast<char *>(m_file) + m_file->capacity - start < static_cast<std::ptrdiff_t>(bytes))
+    {
+        return nullptr;
+    }
+    m_file->brk += bytes;
+    return start;
+}
+
+void Memory_Linked_List::memory_release(void *start, std::size_t bytes)
+{
+    m_stats.syscalls++;
+    m_stats.mapped_bytes -= bytes;
+
+    if (m_mmap_mode == mmap_mode::sbrk)
+    {
+        sbrk(-static_cast<std::intptr_t>(bytes));
+    }
+    else if (m_mmap_mode == mmap_mode::file)
+    {
+        // the pages above the new end are cut out of the file, it keeps its size
+        auto page = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+        auto first = (reinterpret_cast<std::uintptr_t>(start) + page - 1) & ~(page - 1);
+        auto last = (reinterpret_cast<std::uintptr_t>(start) + bytes + page - 1) & ~(page - 1);
+        m_file->brk = static_cast<char *>(start);
+        if (first < last)
+        {
+            madvise(reinterpret_cast<void *>(first), last - first, MADV_REMOVE);
+        }
+    }
+    else
+    {
+        munmap(start, bytes);
+    }
+}
+
+std::size_t Memory_Linked_List::trim()
+{
+    auto released = purge(true);
+
+    // giving back the top of the program break, or of a file, may leave another free mapping at the top
+    if (m_mmap_mode != mmap_mode::mmap)
+    {
+        while (auto more = purge(true))
+        {
+            released += more;
+        }
+    }
+    return released;
+}
+
+void Memory_Linked_List::decay(bool large)
+{
+    if (m_decay_time == std::chrono::milliseconds::max())
+    {
+        return;
+    }
+
+    // the clock is not read on every free
+    if (!large && --m_decay_countdown != 0)
+    {
+        return;
+    }
+    m_decay_countdown = decay_check_interval;
+
+    auto now = std::chrono::steady_clock::now();
+    if (now < m_next_epoch)
+    {
+        return;
+    }
+    m_epoch++;
+    m_next_epoch = now + m_decay_time;
+    purge(false);
+}
+
+std::size_t Memory_Linked_List::purge(bool force)
+{
+    switch (m_search_mode)
+    {
+    case search_mode::free_list:
+        return purge_list(f_list_initial, force);
+    case search_mode::segregated:
+    case search_mode::slab:
+    {
+        std::size_t released{0};
+        for (std::size_t i = 0; i < bin_count; i++)
+        {
+            released += purge_list(m_bins[i], force);
+        }
+        return released + purge_slabs(force);
+    }
+    default:
+        return purge_list(m_initial, force);
+    }
+}
+
+std::size_t Memory_Linked_List::purge_list(Chunk *first, bool force)
+{
+    std::size_t released{0};
+    for (auto chunk = first; chunk != nullptr;)
+    {
+        // the chunk may leave the list, and its memory may be unmapped
+        auto next = chunk->next;
+        if (!chunk->used)
+        {
+            released += purge_chunk(chunk, force);
+        }
+        chunk = next;
+    }
+    return released;
+}
+
+std::size_t Memory_Linked_List::purge_slabs(bool force)
+{
+    std::size_t released{0};
+    for (auto area = m_slab_areas; area != nullptr; area = area->next)
+    {
+        // the pages emptied during this epoch are kept, unless forced
+        auto count = force ? area->empty_count : area->aged_count;
+        if (!force)
+        {
+            area->aged_count = area->empty_count;
+        }
+        if (count <= area->purged_count)
+        {
+            continue;
+        }
+
+        // sorted, so neighbouring pages are given back with a single call
+        std::sort(area->empty + area->purged_count, area->empty + count);
+        for (auto i = area->purged_count; i < count;)
+        {
+            auto run = i + 1;
+            while (run < count && area->empty[run] == area->empty[run - 1] + 1)
+            {
+                run++;
+            }
+            madvise(area->first + area->empty[i] * slab_page_size, (run - i) * slab_page_size,
+                    m_mmap_mode == mmap_mode::file ? MADV_REMOVE : MADV_DONTNEED);
+            m_stats.syscalls++;
+            released += (run - i) * slab_page_size;
+            i = run;
+        }
+        area->purged_count = count;
+    }
+    m_stats.purged_bytes += released;
+    return released;
+}
+
+std::size_t Memory_Linked_List::purge_chunk(Chunk *chunk, bool force)
+{
+    auto stamped = chunk->size >= purge_min_size;
+    auto stamp = stamped ? static_cast<std::size_t>(chunk->data[0]) : 0;
+
+    // only chunks that have been free since before the previous epoch
+    if (!force && (!stamped || (stamp >> 2) + 1 >= m_epoch))
+    {
+        return 0;
+    }
+
+    // alone in its mapping, the whole mapping goes
+    if (!chunk->prev_adjacent && !chunk->next_adjacent)
+    {
+        if (auto released = release_mapping(chunk))
+        {
+            return released;
+        }
+    }
+
+    // the pages have been released already, trim() does it again if it was with MADV_FREE
+    auto purged_already = (stamp & purged) != 0 && (!force || (stamp & purged_lazily) == 0);
+    if (!stamped || purged_already)
+    {
+        return 0;
+    }
+    return purge_pages(chunk, m_lazy_purge && !force);
+}
+
+std::size_t Memory_Linked_List::purge_pages(Chunk *chunk, bool lazy)
+{
+    // the pages of a file are shared, MADV_FREE does not apply, they are cut out of the file instead
+    auto page = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+    lazy = lazy && m_mmap_mode != mmap_mode::file;
+    chunk->data[0] = static_cast<intptr_t>((chunk->data[0] & ~std::size_t{3}) | purged | (lazy ? purged_lazily : 0));
+
+    // the whole pages between the stamp and the footer
+    auto first = (reinterpret_cast<std::uintptr_t>(chunk->data + 1) + page - 1) & ~(page - 1);
+    auto last = reinterpret_cast<std::uintptr_t>(get_footer(chunk)) & ~(page - 1);
+    if (first >= last)
+    {
+        return 0;
+    }
+
+    auto advice = m_mmap_mode == mmap_mode::file ? MADV_REMOVE : lazy ? MADV_FREE : MADV_DONTNEED;
+    madvise(reinterpret_cast<void *>(first), last - first, advice);
+    m_stats.syscalls++;
+    m_stats.purged_bytes += last - first;
+    return last - first;
+}
+
+std::size_t Memory_Linked_List::release_mapping(Chunk *chunk)
+{
+    void *start = chunk;
+    auto bytes = allocSize(chunk->size) + guard_size();
+
+    // the only chunk of a region gives the whole region back, except the current one, which is still carved from
+    auto region = region_of(chunk);
+    if (region != nullptr)
+    {
+        if (region == m_region)
+        {
+            return 0;
+        }
+        start = region;
+        bytes = region->end - reinterpret_cast<char *>(region);
+    }
+
+    // the program break, and the end of the memory of a file, can only move down over the memory at its top
+    if (m_mmap_mode == mmap_mode::sbrk && sbrk(0) != static_cast<char *>(start) + bytes)
+    {
+        return 0;
+    }
+    if (m_mmap_mode == mmap_mode::file && m_file->brk != static_cast<char *>(start) + bytes)
+    {
+        return 0;
+    }
+
+    unlink_free(chunk);
+    if (m_next_fit_chunk == chunk)
+    {
+        m_next_fit_chunk = m_initial;
+    }
+    for (auto link = &m_region; region != nullptr && *link != nullptr; link = &(*link)->next)
+    {
+        if (*link == region)
+        {
+            *link = region->next;
+            break;
+        }
+    }
+    if (m_file != nullptr)
+    {
+        m_file->regions = m_region;
+    }
+
+    memory_release(start, bytes);
+    return bytes;
+}
+
+std::size_t Memory_Linked_List::mapping_size(Chunk *chunk)
+{
+    // the chunks split from it follow it, up to the end of the mapping
+    std::size_t size{0};
+    for (; chunk != nullptr; chunk = next_neighbour(chunk))
+    {
+        size += allocSize(chunk->size);
+    }
+    return size;
+}
+
+Region *Memory_Linked_List::region_of(Chunk *chunk) const
+{
+    // the first chunk of a region is right after its header
+    for (auto region = m_region; region != nullptr; region = region->next)
+    {
+        if (reinterpret_cast<char *>(region) + sizeof(Region) == reinterpret_cast<char *>(chunk))
+        {
+            return region;
+        }
+    }
+    return nullptr;
+}
+
+bool Memory_Linked_List::set_search_mode(Memory_Linked_List::search_mode mode)
+{
+    // the free Chunks are in the lists of the current mode, the new one would not find them
+    if (mode != m_search_mode && m_stats.mapped_bytes != 0)
+    {
+        return false;
+    }
+    m_search_mode = mode;
+    return true;
+}
+
+std::size_t Memory_Linked_List::get_syscall_count() const
+{
+    return m_stats.syscalls;
+}
+
+Allocator_Stats Memory_Linked_List::get_stats() const
+{
+    return m_stats;
+}
+
+void Memory_Linked_List::set_sample_interval(std::size_t bytes)
+{
+    m_profile.set_interval(bytes);
+    m_sample_countdown = m_profile.next_countdown();
+}
+
+const Heap_Profile &Memory_Linked_List::get_profile() const
+{
+    return m_profile;
+}
+
+bool Memory_Linked_List::open_file(const char *path, std::size_t capacity, void *base)
+{
+    // the memory of a heap can not move into a file once handed out
+    if (m_file != nullptr || m_stats.mapped_bytes != 0)
+    {
+        return false;
+    }
+
+    auto descriptor = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (descriptor < 0)
+    {
+        return false;
+    }
+
+    // an empty file is a new heap, any other file must be a heap of this build
+    Heap_File header{};
+    struct stat status{};
+    if (fstat(descriptor, &status) != 0)
+    {
+        ::close(descriptor);
+        return false;
+    }
+    auto existing = status.st_size != 0;
+    if (existing && (pread(descriptor, &header, sizeof(Heap_File), 0) != static_cast<ssize_t>(sizeof(Heap_File)) ||
+                     header.magic != Heap_File::file_magic || header.version != Heap_File::file_version ||
+                     header.header_size != sizeof(Chunk) || header.moving != 0))
+    {
+        ::close(descriptor);
+        return false;
+    }
+
+    // whole pages, the header takes the first one
+    auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    auto header_bytes = (sizeof(Heap_File) + page - 1) & ~(page - 1);
+    capacity = std::max((capacity + page - 1) & ~(page - 1), existing ? header.capacity : 0);
+    if (capacity <= header_bytes ||
+        (static_cast<off_t>(capacity) > status.st_size && ftruncate(descriptor, static_cast<off_t>(capacity)) != 0))
+    {
+        ::close(descriptor);
+        return false;
+    }
+
+    // where the file was made, so the pointers in it are right, or anywhere if it is taken
+    if (base == nullptr)
+    {
+        base = existing ? header.base : reinterpret_cast<void *>(file_base);
+    }
+    auto address = mmap(base, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED_NOREPLACE, descriptor, 0);
+    if (address != MAP_FAILED && address != base)
+    {
+        // kernels older than MAP_FIXED_NOREPLACE take the address as a hint
+        munmap(address, capacity);
+        address = MAP_FAILED;
+    }
+    if (address == MAP_FAILED)
+    {
+        address = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    }
+    if (address == MAP_FAILED)
+    {
+        ::close(descriptor);
+        return false;
+    }
+    m_stats.syscalls++;
+
+    m_file = static_cast<Heap_File *>(address);
+    m_file_descriptor = descriptor;
+    m_mmap_mode = mmap_mode::file;
+
+    if (!existing)
+    {
+        m_file->version = Heap_File::file_version;
+        m_file->header_size = sizeof(Chunk);
+        m_file->base = static_cast<char *>(address);
+        m_file->capacity = capacity;
+        m_file->brk = static_cast<char *>(address) + header_bytes;
+        m_file->search_mode = static_cast<std::uint32_t>(m_search_mode);
+        m_file->cache_line_aligned = m_cache_line_aligned;
+#ifdef ALLOCATOR_HARDENED
+        m_file->secret = m_secret;
+#endif
+        // written last, a header that is not complete is never taken for a heap
+        m_file->magic = Heap_File::file_magic;
+    }
+    else
+    {
+        // the Chunks of the file are kept for its own modes, and sealed with its secret
+        m_search_mode = static_cast<search_mode>(m_file->search_mode);
+        m_cache_line_aligned = m_file->cache_line_aligned != 0;
+        m_file->capacity = capacity;
+#ifdef ALLOCATOR_HARDENED
+        m_secret = m_file->secret;
+#endif
+        auto delta = static_cast<char *>(address) - m_file->base;
+        if (delta != 0)
+        {
+            relocate_file(delta);
+        }
+
+        // the state saved when it was closed is only right if nothing moved since
+        m_recovered = m_file->clean == 0 || delta != 0;
+        if (m_recovered)
+        {
+            recover_file();
+        }
+        else
+        {
+            load_file_state();
+        }
+    }
+
+    // until the heap is closed, the state in the file is out of date
+    m_file->clean = 0;
+    msync(m_file, sizeof(Heap_File), MS_SYNC);
+    return true;
+}
+
+bool Memory_Linked_List::was_recovered() const
+{
+    return m_recovered;
+}
+
+void Memory_Linked_List::set_root(void *data)
+{
+    if (m_file != nullptr)
+    {
+        m_file->root = data == nullptr ? 0 : static_cast<char *>(data) - reinterpret_cast<char *>(m_file);
+    }
+}
+
+void *Memory_Linked_List::get_root() const
+{
+    if (m_file == nullptr || m_file->root == 0)
+    {
+        return nullptr;
+    }
+    return reinterpret_cast<char *>(m_file) + m_file->root;
+}
+
+void Memory_Linked_List::save_file_state()
+{
+    m_file->search_mode = static_cast<std::uint32_t>(m_search_mode);
+    m_file->cache_line_aligned = m_cache_line_aligned;
+    m_file->initial = m_initial;
+    m_file->end = m_end;
+    m_file->next_fit_chunk = m_next_fit_chunk;
+    m_file->free_list_initial = f_list_initial;
+    m_file->free_list_end = f_list_end;
+    m_file->top = m_top;
+    std::copy(m_bins, m_bins + bin_count, m_file->bins);
+    std::copy(m_bins_end, m_bins_end + bin_count, m_file->bins_end);
+    m_file->bin_map = m_bin_map;
+    std::copy(m_slabs, m_slabs + slab_class_count, m_file->slabs);
+    m_file->epoch = m_epoch;
+    m_file->stats = m_stats;
+}
+
+void Memory_Linked_List::load_file_state()
+{
+    m_initial = m_file->initial;
+    m_end = m_file->end;
+    m_next_fit_chunk = m_file->next_fit_chunk;
+    f_list_initial = m_file->free_list_initial;
+    f_list_end = m_file->free_list_end;
+    m_top = m_file->top;
+    std::copy(m_file->bins, m_file->bins + bin_count, m_bins);
+    std::copy(m_file->bins_end, m_file->bins_end + bin_count, m_bins_end);
+    m_bin_map = m_file->bin_map;
+    std::copy(m_file->slabs, m_file->slabs + slab_class_count, m_slabs);
+    m_region = m_file->regions;
+    m_slab_areas = m_file->slab_areas;
+    m_epoch = m_file->epoch;
+    m_stats = m_file->stats;
+}
+
+void Memory_Linked_List::relocate_file(std::ptrdiff_t delta)
+{
+    // a file left moving half of its pointers can not be opened again
+    m_file->moving = 1;
+    msync(m_file, sizeof(Heap_File), MS_SYNC);
+
+    m_file->brk = relocated(m_file->brk, delta);
+    m_file->regions = relocated(m_file->regions, delta);
+    for (auto region = m_file->regions; region != nullptr; region = region->next)
+    {
+        region->next = relocated(region->next, delta);
+        region->bump = relocated(region->bump, delta);
+        region->end = relocated(region->end, delta);
+    }
+    m_file->slab_areas = relocated(m_file->slab_areas, delta);
+    for (auto area = m_file->slab_areas; area != nullptr; area = area->next)
+    {
+        area->next = relocated(area->next, delta);
+        area->first = relocated(area->first, delta);
+        area->bump = relocated(area->bump, delta);
+        area->end = relocated(area->end, delta);
+    }
+    m_file->base = reinterpret_cast<char *>(m_file);
+
+    m_file->moving = 0;
+}
+
+void Memory_Linked_List::recover_file()
+{
+    m_initial = nullptr;
+    m_end = nullptr;
+    f_list_initial = nullptr;
+    f_list_end = nullptr;
+    std::fill(m_bins, m_bins + bin_count, nullptr);
+    std::fill(m_bins_end, m_bins_end + bin_count, nullptr);
+    m_bin_map = 0;
+    std::fill(m_slabs, m_slabs + slab_class_count, nullptr);
+    m_region = m_file->regions;
+    m_slab_areas = m_file->slab_areas;
+    m_top = nullptr;
+    m_epoch = m_file->epoch;
+    m_stats = {};
+
+    for (auto region = m_region; region != nullptr; region = region->next)
+    {
+        m_stats.mapped_bytes += region->end - reinterpret_cast<char *>(region);
+        auto start = reinterpret_cast<char *>(region) + sizeof(Region);
+
+        // the Chunks are walked by their sizes, their flags are made again and free neighbours are merged, as the heap
+        // may have stopped in the middle of a split, a merge or a free
+        Chunk *last = nullptr;
+        for (auto position = start; position < region->bump;)
+        {
+            auto chunk = reinterpret_cast<Chunk *>(position);
+            auto bytes = allocSize(chunk->size);
+            if (chunk->size < min_chunk_size || chunk->size % alignof(Chunk) != 0 ||
+                static_cast<std::ptrdiff_t>(bytes) > region->end - position)
+            {
+                region->bump = position;
+                break;
+            }
+
+            // carved, or grown, right before the bump pointer was moved
+            position += bytes;
+            region->bump = std::max(region->bump, position);
+
+            if (last != nullptr && !last->used && !chunk->used)
+            {
+                last->size += bytes;
+#ifdef ALLOCATOR_HARDENED
+                chunk->canary = 0;
+#endif
+                continue;
+            }
+            chunk->prev_adjacent = last != nullptr;
+            chunk->prev_free = false;
+            chunk->next_adjacent = false;
+            chunk->mapped = false;
+            chunk->sampled = false;
+#ifdef ALLOCATOR_HARDENED
+            seal(chunk);
+#endif
+            if (last != nullptr)
+            {
+                last->next_adjacent = true;
+            }
+            last = chunk;
+        }
+
+        // then the footers and the lists
+        for (auto chunk = start == region->bump ? nullptr : reinterpret_cast<Chunk *>(start); chunk != nullptr;
+             chunk = next_neighbour(chunk))
+        {
+            update_boundary(chunk);
+            if (chunk->used)
+            {
+                push_chunk(m_initial, m_end, chunk);
+                count_live(chunk);
+            }
+            else if (m_search_mode == search_mode::free_list)
+            {
+                free_listing(chunk);
+            }
+            else if (m_search_mode == search_mode::segregated || m_search_mode == search_mode::slab)
+            {
+                segregated_listing(chunk);
+            }
+            else
+            {
+                push_chunk(m_initial, m_end, chunk);
+            }
+        }
+        if (region == m_region)
+        {
+            m_top = last;
+        }
+    }
+    m_next_fit_chunk = m_initial;
+
+    // every page of the areas is a Slab with objects in use, or goes on the stack of empty pages
+    for (auto area = m_slab_areas; area != nullptr; area = area->next)
+    {
+        m_stats.mapped_bytes += area->end - reinterpret_cast<char *>(area);
+        area->empty_count = 0;
+        area->aged_count = 0;
+        area->purged_count = 0;
+        for (auto page = area->first; page < area->bump; page += slab_page_size)
+        {
+            auto slab = reinterpret_cast<Slab *>(page);
+            auto valid = slab->size >= min_slab_size && slab->size <= slab_max_size && align(slab->size) == slab->size &&
+                         slab->capacity == (slab_page_size - sizeof(Slab)) / slab->size;
+            std::size_t free_count{0};
+            for (std::size_t i = 0; valid && i < Slab::bitmap_words; i++)
+            {
+                // no bit past the last object
+                auto objects = i * 64 >= slab->capacity ? 0 : std::min<std::size_t>(slab->capacity - i * 64, 64);
+                valid = objects == 64 || (slab->bitmap[i] >> objects) == 0;
+                free_count += std::popcount(slab->bitmap[i]);
+            }
+            if (!valid || free_count == slab->capacity)
+            {
+                area->empty[area->empty_count++] = static_cast<std::uint32_t>((page - area->first) / slab_page_size);
+                continue;
+            }
+
+            slab->free_count = static_cast<std::uint16_t>(free_count);
+            m_stats.live_bytes += (slab->capacity - free_count) * slab->size;
+            m_stats.live_blocks += slab->capacity - free_count;
+            if (free_count != 0)
+            {
+                auto &first = m_slabs[Size_Classes::index(slab->size)];
+                slab->prev = nullptr;
+                slab->next = first;
+                if (first != nullptr)
+                {
+                    first->prev = slab;
+                }
+                first = slab;
+            }
+        }
+    }
+    m_stats.peak_bytes = m_stats.live_bytes;
+    m_stats.peak_blocks = m_stats.live_blocks;
+}
+
+void Memory_Linked_List::count_live(Chunk *chunk)
+{
+    m_stats.live_bytes += chunk->size;
+    m_stats.live_blocks++;
+    m_stats.peak_bytes = std::max(m_stats.peak_bytes, m_stats.live_bytes);
+    m_stats.peak_blocks = std::max(m_stats.peak_blocks, m_stats.live_blocks);
+}
+
+void Memory_Linked_List::free(intptr_t *data)
+{
+    // objects in a slab have no chunk
+    if (auto slab = slab_of(data))
+    {
+        slab_free(slab, data);
+        return;
+    }
+
+    // gets chunk that is being freed
+    auto chunk = get_header(data);
+#ifdef ALLOCATOR_HARDENED
+    check_chunk(chunk);
+    std::memset(chunk->data, free_poison, chunk->size);
+#else
+    // freeing a free chunk again would break the lists, it is ignored like a free object of a slab
+    if (!chunk->used)
+    {
+        return;
+    }
+#endif
+
+    // the only samples there can be, and the only frees that look the profile up
+    if (chunk->sampled)
+    {
+        m_profile.erase(data);
+        chunk->sampled = false;
+    }
+
+    m_stats.frees++;
+    m_stats.live_bytes -= chunk->size;
+    m_stats.live_blocks--;
+
+    // frees it
+    chunk->used = false;
+    update_boundary(chunk);
+
+    // free_list, segregated and slab keep their free chunks out of the memory linked list
+    if (lists_free_chunks())
+    {
+        unlink_chunk(m_initial, m_end, chunk);
+    }
+
+    // merges it with its free neighbours
+    chunk = coalesce(chunk);
+
+    // if free_list mode is set, the freed data will be put in its own linked list
+    if (m_search_mode == search_mode::free_list)
+    {
+        free_listing(chunk);
+    }
+
+    // if segregated or slab mode is set, the freed data is pushed on the bin of its size
+    if (m_search_mode == search_mode::segregated || m_search_mode == search_mode::slab)
+    {
+        segregated_listing(chunk);
+    }
+
+    // gives back the pages of the chunks that have been free for long enough
+    decay(chunk->size >= purge_min_size);
 }
 
-intptr_t *Memory_Linked_List::alloc(std::size_t size)
+void Memory_Linked_List::free(intptr_t *data, [[maybe_unused]] std::size_t size)
 {
-    // gets the minimum memory needed for allocation
-    auto aligned = align(size);
+    // the size is only a hint, the block is freed by its header like with free(data). Hardened builds check it, as a
+    // size that does not match is a wrong pointer or an overwritten header
+#ifdef ALLOCATOR_HARDENED
+    if (auto slab = slab_of(data))
+    {
+        // an object smaller than its slab may have been shrunk in place by reallocate
+        if (align(size) > slab->size)
+        {
+            heap_corruption("sized free with a size bigger than the object", data);
+        }
+        slab_free(slab, data);
+        return;
+    }
 
-    // looks for chunks that are freed
+    auto chunk = get_header(data);
+    check_chunk(chunk);
 
-    if (auto freed_chunk = find_chunk(aligned))
+    // alloc gives a chunk of at least the aligned size, whole cache lines in cache line aligned mode, and splits it if
+    // the rest could hold a chunk
+    auto aligned = align(m_cache_line_aligned ? cache_lines(size) : size);
+    auto most = aligned + allocSize(min_chunk_size) - 1;
+
+    // a large chunk mapped with a guard page takes whole pages, see memory_map()
+    auto guard = guard_size();
+    if (guard != 0 && !chunk->prev_adjacent && !chunk->next_adjacent)
     {
-        // sets free chunk flag to used
-        freed_chunk->used = true;
-        // gives a pointer to the freed chunk
-        return freed_chunk->data;
+        most = std::max(most, ((allocSize(aligned) + guard - 1) & ~(guard - 1)) - allocSize(0));
+    }
+    if (chunk->size < aligned || chunk->size > most)
+    {
+        heap_corruption("sized free with a size the block was not allocated with", data);
     }
+#endif
 
-    // requests data from memory
-    auto chunk = memory_map(aligned);
+    free(data);
+}
 
-    // sets its header
-    chunk->size = aligned;
-    chunk->used = true;
+void Memory_Linked_List::free_batch(intptr_t **data, std::size_t count)
+{
+    // slab objects are freed as they come, the objects of a page that follow each other updating its slab once. The
+    // chunks are moved to the front, to be sorted without the slab objects
+    std::size_t chunks{0};
+    Slab *slab{nullptr};
+    bool was_full{false};
+    bool freed{false};
+    for (std::size_t i = 0; i <= count; i++)
+    {
+        auto object_slab = i < count && data[i] != nullptr ? slab_of(data[i]) : nullptr;
+        if (i < count && data[i] != nullptr && object_slab == nullptr)
+        {
+            data[chunks++] = data[i];
+            continue;
+        }
+
+        // another page, or the end of the batch, the slab of the objects before is updated
+        if (object_slab != slab)
+        {
+            if (freed)
+            {
+                slab_relist(slab, was_full);
+                decay(false);
+            }
+            slab = object_slab;
+            was_full = slab != nullptr && slab->free_count == 0;
+            freed = false;
+        }
+        if (slab != nullptr)
+        {
+            freed |= slab_mark_free(slab, data[i]);
+        }
+    }
+
+    // in address order, the chunks next to each other in memory follow each other
+    std::sort(data, data + chunks);
 
-    // linking chunk to the list
-    if (m_start != nullptr)
+    for (std::size_t i = 0; i < chunks;)
     {
-        m_end->next = chunk;
+        // the chunks right after it in memory are merged into it
+        auto first = get_header(data[i]);
+        auto last = first;
+#ifdef ALLOCATOR_HARDENED
+        check_chunk(first);
+#endif
+        std::size_t merged{0};
+        for (i++; i < chunks; i++)
+        {
+            auto next = next_neighbour(last);
+            if (next == nullptr || !next->used || get_header(data[i]) != next)
+            {
+                break;
+            }
+#ifdef ALLOCATOR_HARDENED
+            check_chunk(next);
+            next->canary = 0;
+#endif
+            if (next->sampled)
+            {
+                m_profile.erase(next->data);
+            }
+            unlink_chunk(m_initial, m_end, next);
+            if (m_next_fit_chunk == next)
+            {
+                m_next_fit_chunk = first;
+            }
+            last = next;
+            merged++;
+        }
+
+        if (merged != 0)
+        {
+            // counted as freed now, free() takes the merged chunk off the live counters
+            m_stats.frees += merged;
+            m_stats.live_blocks -= merged;
+            m_stats.live_bytes += merged * allocSize(0);
+
+            first->size = reinterpret_cast<char *>(last) + allocSize(last->size) - reinterpret_cast<char *>(first) -
+                          allocSize(0);
+            first->next_adjacent = last->next_adjacent;
+            if (m_top == last)
+            {
+                m_top = first;
+            }
+        }
+        free(first->data);
     }
+}
 
-    // initialises the list
-    if (m_initial == nullptr)
+intptr_t *Memory_Linked_List::reallocate(intptr_t *data, std::size_t size)
+{
+    if (data == nullptr)
     {
-        m_initial = chunk;
-        m_next_fit_chunk = chunk;
-        m_start = chunk;
+        return alloc(size);
+    }
+    if (size > max_alloc_size)
+    {
+        return nullptr;
     }
 
-    // making chunk the last on the list
-    m_end = chunk;
+    // an object stays in its slab while it fits, objects of other sizes are in other slabs
+    if (auto slab = slab_of(data))
+    {
+        m_stats.reallocs++;
+        if (align(size) <= slab->size)
+        {
+            m_stats.in_place_reallocs++;
+            return data;
+        }
 
-    // returning a pointer to the data
+        auto moved = alloc(size);
+        if (moved != nullptr)
+        {
+            std::memcpy(moved, data, slab->size);
+            slab_free(slab, data);
+        }
+        return moved;
+    }
+
+    // in cache line aligned mode, Chunks take whole cache lines
+    auto chunk = get_header(data);
+    auto aligned = align(m_cache_line_aligned ? cache_lines(size) : size);
+    auto old_size = chunk->size;
+    m_stats.reallocs++;
+#ifdef ALLOCATOR_HARDENED
+    check_chunk(chunk);
+#endif
+
+    // shrinks, or the Chunk is big enough already
+    if (aligned <= chunk->size)
+    {
+        // takes the free right neighbour first, so the end that is cut off merges with it
+        auto next = next_neighbour(chunk);
+        if (next != nullptr && !next->used)
+        {
+            unlink_free(next);
+            merge(chunk, next);
+        }
+        split(chunk, aligned);
+    }
+    else
+    {
+        auto grown = grow_in_place(chunk, aligned);
+
+        // moves the data to a new Chunk
+        if (grown == nullptr)
+        {
+            auto moved = alloc(size);
+            if (moved != nullptr)
+            {
+                std::memcpy(moved, data, old_size);
+                free(data);
+            }
+            return moved;
+        }
+        chunk = grown;
+    }
+
+    // a sample keeps its call stack, at its new size and maybe a new address after mremap
+    if (chunk->sampled)
+    {
+        m_profile.move(data, chunk->data, size);
+    }
+
+    m_stats.in_place_reallocs++;
+    m_stats.live_bytes = m_stats.live_bytes - old_size + chunk->size;
+    m_stats.peak_bytes = std::max(m_stats.peak_bytes, m_stats.live_bytes);
     return chunk->data;
 }
 
-std::size_t Memory_Linked_List::align(std::size_t size)
+Chunk *Memory_Linked_List::grow_in_place(Chunk *chunk, std::size_t size)
 {
-    // minimum data size is 8
-    auto i = 8;
+    // absorbs the free right neighbour, and gives back what is not needed
+    auto next = next_neighbour(chunk);
+    if (next != nullptr && !next->used && chunk->size + allocSize(next->size) >= size)
+    {
+        unlink_free(next);
+        merge(chunk, next);
+        split(chunk, size);
+        return chunk;
+    }
+
+    // the last Chunk carved from the current Region takes more of it
+    auto end = reinterpret_cast<char *>(chunk) + allocSize(chunk->size);
+    if (chunk == m_top && m_region != nullptr && end == m_region->bump &&
+        m_region->end - m_region->bump >= static_cast<std::ptrdiff_t>(size - chunk->size))
+    {
+        // the size first, so the chunk never ends before the bump pointer
+        auto grown = size - chunk->size;
+        chunk->size = size;
+        m_region->bump += grown;
+        return chunk;
+    }
 
-    // doubles until minimum size required is reached
-    while (i < size)
+    // a Chunk alone in its mapping is remapped, the kernel moves the pages instead of copying them
+    if (chunk->mapped && !chunk->next_adjacent)
     {
-        i *= 2;
+        auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        auto old_bytes = (allocSize(chunk->size) + page - 1) & ~(page - 1);
+        auto new_bytes = (allocSize(size) + page - 1) & ~(page - 1);
+
+        // the chunk leaves its list while it may move
+        unlink_chunk(m_initial, m_end, chunk);
+        auto moved = mremap(chunk, old_bytes, new_bytes, MREMAP_MAYMOVE);
+        if (moved == MAP_FAILED)
+        {
+            push_chunk(m_initial, m_end, chunk);
+            return nullptr;
+        }
+
+        m_stats.syscalls++;
+        if (m_next_fit_chunk == chunk)
+        {
+            m_next_fit_chunk = static_cast<Chunk *>(moved);
+        }
+
+        // counted like memory_request(), without the rounding to pages, so releasing it takes as much off
+        chunk = static_cast<Chunk *>(moved);
+        m_stats.mapped_bytes += allocSize(size) - allocSize(chunk->size);
+        chunk->size = size;
+#ifdef ALLOCATOR_HARDENED
+        seal(chunk);
+#endif
+        push_chunk(m_initial, m_end, chunk);
+        return chunk;
     }
-    return i;
+    return nullptr;
 }
 
-std::size_t Memory_Linked_List::allocSize(std::size_t size)
+Chunk *Memory_Linked_List::coalesce(Chunk *chunk)
 {
-    // size of data + size of header - initial data
-    return size + sizeof(Chunk) - sizeof(std::declval<Chunk>().data);
+    // the chunk absorbs its right neighbour
+    auto next = next_neighbour(chunk);
+    if (next != nullptr && !next->used)
+    {
+        unlink_free(next);
+        merge(chunk, next);
+    }
+
+    // the left neighbour absorbs the chunk
+    auto prev = prev_neighbour(chunk);
+    if (prev != nullptr && !prev->used)
+    {
+        // in the fit modes the left neighbour keeps its place in the list, otherwise it is listed again once merged
+        if (lists_free_chunks())
+        {
+            unlink_free(prev);
+        }
+        else
+        {
+            unlink_chunk(m_initial, m_end, chunk);
+        }
+        merge(prev, chunk);
+        chunk = prev;
+    }
+    return chunk;
 }
 
-Chunk *Memory_Linked_List::memory_map(std::size_t size)
+void Memory_Linked_List::merge(Chunk *chunk, Chunk *absorbed)
 {
-    switch (m_mmap_mode)
+    // the chunk now covers the header, payload and footer of the absorbed chunk
+    chunk->size += allocSize(absorbed->size);
+    chunk->next_adjacent = absorbed->next_adjacent;
+    update_boundary(chunk);
+
+#ifdef ALLOCATOR_HARDENED
+    // its header is now in the middle of a payload, freeing it again must fail
+    absorbed->canary = 0;
+#endif
+
+    // nothing may point to the absorbed chunk anymore
+    if (m_top == absorbed)
     {
-    case mmap_mode::sbrk:
-        return memory_map_mmap(size);
-        break;
-    case mmap_mode::mmap:
-        return memory_map_sbrk(size);
-        break;
-    default:
-        throw std::runtime_error("No mememory mapping has been picked");
-        return nullptr;
-        break;
+        m_top = chunk;
+    }
+    if (m_next_fit_chunk == absorbed)
+    {
+        m_next_fit_chunk = chunk;
     }
 }
 
-Chunk *Memory_Linked_List::memory_map_mmap(std::size_t size)
+void Memory_Linked_List::split(Chunk *chunk, std::size_t size)
 {
-    // Calculate the allocation size, including any metadata and alignment requirements
-    std::size_t total_size = allocSize(size);
+    // not enough left for a chunk
+    if (chunk->size < size + allocSize(min_chunk_size))
+    {
+        return;
+    }
 
-    // Use mmap to allocate memory with read/write permissions
-    void *addr = mmap(nullptr, total_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    // the rest of the chunk becomes a new free chunk
+    auto rest = reinterpret_cast<Chunk *>(reinterpret_cast<char *>(chunk) + allocSize(size));
+    rest->size = chunk->size - allocSize(size);
+    rest->used = false;
+    rest->prev_adjacent = true;
+    rest->prev_free = !chunk->used;
+    rest->next_adjacent = chunk->next_adjacent;
+    rest->mapped = false;
+    rest->sampled = false;
+#ifdef ALLOCATOR_HARDENED
+    seal(rest);
+#endif
 
-    // Check if mmap failed
-    if (addr == MAP_FAILED)
+    chunk->size = size;
+    chunk->next_adjacent = true;
+    update_boundary(rest);
+
+    if (m_top == chunk)
     {
-        return nullptr;
+        m_top = rest;
     }
 
-    return static_cast<Chunk *>(addr);
+    // the rest is free, so it goes where the free chunks are kept
+    switch (m_search_mode)
+    {
+    case search_mode::free_list:
+        free_listing(rest);
+        break;
+    case search_mode::segregated:
+    case search_mode::slab:
+        segregated_listing(rest);
+        break;
+    default:
+        // keeps the memory linked list in address order by putting the rest right after the chunk
+        rest->prev = chunk;
+        rest->next = chunk->next;
+        if (chunk->next != nullptr)
+        {
+            chunk->next->prev = rest;
+        }
+        else
+        {
+            m_end = rest;
+        }
+        chunk->next = rest;
+        break;
+    }
 }
 
-Chunk *Memory_Linked_List::memory_map_sbrk(std::size_t size)
+bool Memory_Linked_List::lists_free_chunks() const
 {
-    // program break
-    auto chunk = (Chunk *)sbrk(0);
+    return m_search_mode == search_mode::free_list || m_search_mode == search_mode::segregated ||
+           m_search_mode == search_mode::slab;
+}
 
-    // check if it will be OOM
-    if (sbrk(allocSize(size)) == (void *)-1)
+void Memory_Linked_List::unlink_free(Chunk *chunk)
+{
+    switch (m_search_mode)
     {
-        return nullptr;
+    case search_mode::free_list:
+        unlink_chunk(f_list_initial, f_list_end, chunk);
+        break;
+    case search_mode::segregated:
+    case search_mode::slab:
+    {
+        auto index = bin_index(chunk->size);
+        unlink_chunk(m_bins[index], m_bins_end[index], chunk);
+        // the bin is empty now
+        if (m_bins[index] == nullptr)
+        {
+            m_bin_map &= ~(std::size_t{1} << index);
+        }
+        break;
+    }
+    default:
+        unlink_chunk(m_initial, m_end, chunk);
+        break;
     }
-    return chunk;
 }
 
-// Implementation for search mode setting.
-void Memory_Linked_List::set_search_mode(Memory_Linked_List::search_mode mode)
+void Memory_Linked_List::push_chunk(Chunk *&first, Chunk *&last, Chunk *chunk)
 {
-    m_search_mode = mode;
+    chunk->next = nullptr;
+    chunk->prev = last;
+
+    // adds to the list if it exists
+    if (last != nullptr)
+    {
+        last->next = chunk;
+    }
+    // initialise the list
+    else
+    {
+        first = chunk;
+    }
+
+    // makes the chunk the last in the list
+    last = chunk;
 }
 
-void Memory_Linked_List::free(intptr_t *data)
+void Memory_Linked_List::unlink_chunk(Chunk *&first, Chunk *&last, Chunk *chunk)
 {
-    // gets chunk that is being freed
-    auto chunk = get_header(data);
+    // links the neighbours together, or moves the ends of the list
+    if (chunk->prev != nullptr)
+    {
+        chunk->prev->next = chunk->next;
+    }
+    else
+    {
+        first = chunk->next;
+    }
 
-    // if free_list mode is set, the freed data will be put in its own linked list
-    if (m_search_mode == search_mode::free_list)
+    if (chunk->next != nullptr)
     {
-        free_listing(chunk);
+        chunk->next->prev = chunk->prev;
+    }
+    else
+    {
+        last = chunk->prev;
     }
 
-    // frees it
-    chunk->used = false;
+    chunk->next = nullptr;
+    chunk->prev = nullptr;
 }
 
 Chunk *Memory_Linked_List::free_list(std::size_t size)
 {
-    Chunk *prev_s{m_initial};
-
     for (auto s = f_list_initial; s != nullptr; s = s->next)
     {
+        m_stats.search_steps++;
         if (s->size >= size)
         {
-            if (s == f_list_initial)
-            {
-                if (f_list_initial->next == nullptr)
-                {
-                    // add to the free list if it exists
-                    if (m_initial != nullptr)
-                    {
-                        m_end->next = s;
-                    }
-                    // initialise the free list
-                    if (m_initial == nullptr)
-                    {
-                        m_initial = s;
-                        m_start = s;
-                    }
-
-                    // makes the chunk the last in the list
-                    s->next = nullptr;
-                    m_end = s;
-
-                    // reset the whole mll
-                    f_list_initial = nullptr;
-                    f_list_start = nullptr;
-                    f_list_end = nullptr;
-
-                    return s;
-                }
-                else
-                {
-                    f_list_initial = s->next;
-                    f_list_start = s->next;
-
-                    // adds chunk to the free list
-                    if (m_initial != nullptr)
-                    {
-                        m_end->next = s;
-                    }
-                    // initialise the free list
-                    if (m_initial == nullptr)
-                    {
-                        m_initial = s;
-                        m_start = s;
-                    }
-
-                    // adds chunk to the end of the list
-                    s->next = nullptr;
-                    m_end = s;
-                    return s;
-                }
-            }
-            else
-            {
-                if (s == m_end)
-                {
-                    m_end = prev_s;
-                    prev_s->next = nullptr;
-                }
-                else
-                {
-                    prev_s->next = s->next;
-                }
-
-                // adds chunk to the free list
-                if (m_initial != nullptr)
-                {
-                    m_end->next = s;
-                    s->next = nullptr;
-                }
-                // initialise the free list
-                if (m_initial == nullptr)
-                {
-                    m_initial = s;
-                    m_start = s;
-                }
-                s->next = nullptr;
-                f_list_end = s;
-            }
+            // moves the chunk from the free list to the end of the memory linked list
+            unlink_chunk(f_list_initial, f_list_end, s);
+            push_chunk(m_initial, m_end, s);
+            return s;
         }
-        prev_s = s;
     }
     return nullptr;
 }
 
 void Memory_Linked_List::free_listing(Chunk *chunk)
 {
-    // checks if the first one is the chunk
-    if (chunk == m_initial)
-    {
-        // checks if the mll is only one chunk
-        if (chunk->next == nullptr)
-        {
-            // add to the free list if it exists
-            if (f_list_start != nullptr)
-            {
-                f_list_end->next = chunk;
-            }
-            // initialise the free list
-            if (f_list_initial == nullptr)
-            {
-                f_list_initial = chunk;
-                f_list_start = chunk;
-            }
+    // adds chunk to the end of the free list
+    push_chunk(f_list_initial, f_list_end, chunk);
+}
 
-            // makes the chunk the last in the list
-            f_list_end = chunk;
+void Memory_Linked_List::segregated_listing(Chunk *chunk)
+{
+    auto index = bin_index(chunk->size);
 
-            // reset the whole mll
-            m_initial = nullptr;
-            m_start = nullptr;
-            m_end = nullptr;
-        }
+    // adds chunk to the end of its bin, and marks the bin as not empty
+    push_chunk(m_bins[index], m_bins_end[index], chunk);
+    m_bin_map |= std::size_t{1} << index;
+}
 
-        // chunk is first, but not last in the mll
-        else
-        {
-            // update the current mll
-            m_initial = chunk->next;
-            m_start = chunk->next;
+Chunk *Memory_Linked_List::segregated_list(std::size_t size)
+{
+    // a single look at the bin map
+    m_stats.search_steps++;
 
-            // adds chunk to the free list
-            if (f_list_start != nullptr)
-            {
-                f_list_end->next = chunk;
-            }
-            // initialise the free list
-            if (f_list_initial == nullptr)
+    // bigger than every class, only some of the chunks of the last bin are big enough
+    if (size > Size_Classes::max_size)
+    {
+        for (auto s = m_bins[bin_count - 1]; s != nullptr; s = s->next)
+        {
+            m_stats.search_steps++;
+            if (s->size >= size)
             {
-                f_list_initial = chunk;
-                f_list_start = chunk;
+                unlink_free(s);
+                push_chunk(m_initial, m_end, s);
+                return s;
             }
-
-            // adds chunk to the end of the list
-            chunk->next = nullptr;
-            f_list_end = chunk;
         }
+        return nullptr;
     }
 
-    // keeping track of the last chunk
-    Chunk *prev_s{m_initial};
+    // every bin from the class of the request holds big enough chunks
+    auto candidates = m_bin_map & (~std::size_t{0} << Size_Classes::index(size));
 
-    for (auto s = m_initial; s != nullptr; s = s->next)
+    // nothing big enough has been freed
+    if (candidates == 0)
     {
-        if (s == chunk)
-        {
-            if (chunk == m_end)
-            {
-                m_end = prev_s;
-                prev_s->next = nullptr;
-            }
-            else
-            {
-                prev_s->next = chunk->next;
-            }
+        return nullptr;
+    }
 
-            // adds chunk to the free list
-            if (f_list_start != nullptr)
-            {
-                f_list_end->next = chunk;
-                chunk->next = nullptr;
-            }
-            // initialise the free list
-            if (f_list_initial == nullptr)
-            {
-                f_list_initial = chunk;
-                f_list_start = chunk;
-            }
-            chunk->next = nullptr;
-            f_list_end = chunk;
-        }
-        prev_s = s;
+    // the smallest non empty bin
+    auto index = static_cast<std::size_t>(std::countr_zero(candidates));
+    auto chunk = m_bins[index];
+
+    // moves the chunk from its bin to the end of the memory linked list
+    unlink_free(chunk);
+    push_chunk(m_initial, m_end, chunk);
+    return chunk;
+}
+
+std::size_t Memory_Linked_List::bin_index(std::size_t size)
+{
+    // chunks bigger than every class share the last bin
+    if (size >= Size_Classes::max_size)
+    {
+        return bin_count - 1;
     }
+
+    // the class of the size, or the one before it if the chunk is smaller than the class
+    auto index = Size_Classes::index(size);
+    return Size_Classes::size(index) == size ? index : index - 1;
 }
 
 Chunk *Memory_Linked_List::first_fit(std::size_t size)
@@ -334,6 +2366,7 @@ Chunk *Memory_Linked_List::first_fit(std::size_t size)
     // going through the whole list
     for (auto s = m_initial; s != nullptr; s = s->next)
     {
+        m_stats.search_steps++;
         // checks if it is an adequate free Chunk
         if (!s->used && s->size >= size)
         {
@@ -349,6 +2382,7 @@ Chunk *Memory_Linked_List::next_fit(std::size_t size)
     // going through the whole list, but starting at the last found block
     for (auto s = m_next_fit_chunk; s != nullptr; s = s->next)
     {
+        m_stats.search_steps++;
         // checking if block reuse conditions are met
         if (!s->used && s->size >= size)
         {
@@ -368,36 +2402,23 @@ Chunk *Memory_Linked_List::next_fit(std::size_t size)
 
 Chunk *Memory_Linked_List::best_fit(std::size_t size)
 {
-    int multiplier{1};
-    size_t max_memory_stored{0};
+    Chunk *best{nullptr};
 
-    // go through the whole list, saving the largest stored size of a chunk
+    // go through the whole list, keeping the smallest free chunk that is big enough. Since chunks are split and
+    // merged, their sizes are not powers of two anymore, so they can not be looked up by size.
     for (auto s = m_initial; s != nullptr; s = s->next)
     {
-        if (max_memory_stored < s->size)
-            max_memory_stored = s->size;
-    }
-
-    // if size is bigger then the largest stored chunk, return nullptr
-    if (size > max_memory_stored)
-        return nullptr;
-
-    // start with the minimum size required and go through the whole list. If there is no chunk freed with said size is
-    // found, do it again but with double the size required.
-    while (true)
-    {
-        for (auto s = m_initial; s != nullptr; s = s->next)
+        m_stats.search_steps++;
+        if (!s->used && s->size >= size && (best == nullptr || s->size < best->size))
         {
-            if (!s->used && s->size == size * multiplier)
-            {
-                return s;
-            }
-        }
-        if (size * multiplier == max_memory_stored)
-            return nullptr;
+            best = s;
 
-        multiplier *= 2;
+            // nothing can fit better
+            if (s->size == size)
+                break;
+        }
     }
+    return best;
 }
 
 Chunk *Memory_Linked_List::find_chunk(std::size_t size)
@@ -415,6 +2436,9 @@ Chunk *Memory_Linked_List::find_chunk(std::size_t size)
         break;
     case search_mode::free_list:
         return free_list(size);
+    case search_mode::segregated:
+    case search_mode::slab:
+        return segregated_list(size);
     default:
         throw std::invalid_argument("No search mode were selected");
         return nullptr;
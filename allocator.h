@@ -5,193 +5,1107 @@
 #ifndef ALLOCATOR_H
 #define ALLOCATOR_H
 
+#include <chrono>
 #include <cstdint>
+#include <cstddef>
+#include <utility>
+#include "allocator_stats.h"
+#include "heap_profile.h"
+#include "size_classes.h"
 
 /**
  * Chunk is a node within the memory pool link list.
  *
  * Chunk has a payload pointer that points towards the users data. The rest is the header, which determines whether it
- * is used, how big it is, and what the next node is.
+ * is used, how big it is, and what the next node is. The size and the flags share a single word.
+ *
+ * A free Chunk also ends with a footer (boundary tag) holding its size, in the last word of its payload. It lets the
+ * Chunk physically after it find its header in O(1), which is what makes coalescing possible. Used Chunks do not need
+ * one, as only free Chunks are merged, so their whole payload belongs to the user.
+ *
+ * A free Chunk big enough to hold whole pages also keeps, in the first word of its payload, the epoch it was freed at
+ * and whether its pages have been given back to the OS since, see Memory_Linked_List::trim().
+ *
+ * A Chunk handed out as a sample of the heap profiler is flagged, so freeing the other Chunks never looks the profile
+ * up.
+ *
+ * Built with ALLOCATOR_HARDENED, the header also holds a canary, so free() can tell a Chunk of the heap from a wrong
+ * pointer or an overwritten header.
  */
 class Chunk
 {
 public:
     /**
      * Header.
-     * Size of the chunk.
+     * Size of the chunk, a multiple of 8.
+     */
+    std::size_t size : 58;
+
+    /**
+     * checking if it is used.
+     */
+    std::size_t used : 1;
+
+    /**
+     * set if a Chunk ends right before this one in memory.
+     */
+    std::size_t prev_adjacent : 1;
+
+    /**
+     * set if the Chunk right before this one is free, meaning its footer can be read.
+     */
+    std::size_t prev_free : 1;
+
+    /**
+     * set if a Chunk starts right after this one in memory.
+     */
+    std::size_t next_adjacent : 1;
+
+    /**
+     * set if the Chunk starts a mapping of its own made with mmap, so it can be resized with mremap when it is alone
+     * in it (no neighbour after it).
+     */
+    std::size_t mapped : 1;
+
+    /**
+     * set if the Chunk is a sample of the heap profiler, which has to forget it when it is freed.
+     */
+    std::size_t sampled : 1;
+
+#ifdef ALLOCATOR_HARDENED
+    /**
+     * the address of the Chunk mixed with the secret of its heap, cleared when the Chunk is merged into another one.
+     */
+    std::uintptr_t canary;
+#endif
+
+    /**
+     * pointer to next chunk.
+     */
+    Chunk *next;
+
+    /**
+     * pointer to previous chunk, so a Chunk can be removed from its list in O(1).
+     */
+    Chunk *prev;
+
+    /**
+     * Payload.
+     * Users memory.
+     */
+    intptr_t data[1];
+};
+
+/**
+ * Region is a large block of memory reserved with a single mmap or sbrk call. Chunks are carved out of it one after
+ * the other with a bump pointer, so most allocations never need a syscall. The header sits at the start of the region.
+ */
+class Region
+{
+public:
+    /**
+     * pointer to the next region.
+     */
+    Region *next;
+
+    /**
+     * the next free byte, where the next Chunk will be carved.
+     */
+    char *bump;
+
+    /**
+     * the end of the region.
+     */
+    char *end;
+};
+
+/**
+ * Slab is a page of objects of the same size class, used by the slab search mode for small allocations.
+ *
+ * The header sits at the start of the page and the objects follow it, with no header of their own. One bit per
+ * object says whether it is free, so finding a free object is a scan of a few words for a set bit, in a header that is
+ * most likely in cache, instead of a walk through Chunks spread over the heap. Pages are aligned on slab_page_size, so
+ * the Slab of an object is found by masking its address.
+ */
+class Slab
+{
+public:
+    /**
+     * number of words in the bitmap, one bit for each of the objects of 8 bytes that fit in a page.
+     */
+    static constexpr std::size_t bitmap_words = 8;
+
+    /**
+     * the next Slab of the same class with free objects.
+     */
+    Slab *next;
+
+    /**
+     * the previous Slab of the same class with free objects.
+     */
+    Slab *prev;
+
+    /**
+     * size of the objects, a size class.
+     */
+    std::uint32_t size;
+
+    /**
+     * number of objects in the page.
+     */
+    std::uint16_t capacity;
+
+    /**
+     * number of free objects.
+     */
+    std::uint16_t free_count;
+
+    /**
+     * a set bit for every free object, the bits past capacity are clear.
+     */
+    std::uint64_t bitmap[bitmap_words];
+};
+
+/**
+ * Slab_Area is a block of memory reserved with a single mmap or sbrk call, that slab pages are taken from. Pages are
+ * carved with a bump pointer, and pages left empty are kept on a stack in the header to be reused by any size class.
+ * The header sits at the start of the area, the pages start at the first page boundary after it.
+ */
+class Slab_Area
+{
+public:
+    /**
+     * pointer to the next area.
+     */
+    Slab_Area *next;
+
+    /**
+     * the first page.
+     */
+    char *first;
+
+    /**
+     * the next page never used.
+     */
+    char *bump;
+
+    /**
+     * the end of the area.
+     */
+    char *end;
+
+    /**
+     * number of pages on the stack of empty pages.
+     */
+    std::size_t empty_count;
+
+    /**
+     * the bottom of the stack that has been empty since before the current epoch.
+     */
+    std::size_t aged_count;
+
+    /**
+     * the bottom of the stack whose pages have been given back to the OS.
+     */
+    std::size_t purged_count;
+
+    /**
+     * the stack of empty pages, as page numbers from first, as many entries as there are pages.
+     */
+    std::uint32_t empty[1];
+};
+
+/**
+ * Heap_File is the header at the start of the file of a persistent heap, see Memory_Linked_List::open_file().
+ *
+ * The file is mapped at the address it was created at, so the Chunks, Regions and Slabs in it keep their pointers from
+ * one run to the next. Memory is handed out to the heap from the start of the file with a bump pointer, like the
+ * program break. The lists of Regions and Slab_Areas are kept up to date here, they are all it takes to find every
+ * Chunk and Slab again. The rest of the state of the heap is only written when it is closed, and marked clean.
+ */
+class Heap_File
+{
+public:
+    /**
+     * "MLLHEAP1", the first bytes of every heap file.
+     */
+    static constexpr std::uint64_t file_magic = 0x31504145484c4c4d;
+
+    /**
+     * version of the layout of the file, changed with the layout of this header or of the Chunks.
+     */
+    static constexpr std::uint32_t file_version = 1;
+
+    std::uint64_t magic;
+    std::uint32_t version;
+
+    /**
+     * size of a Chunk header, which is bigger in hardened builds, so a file is only opened by builds like its own.
+     */
+    std::uint32_t header_size;
+
+    /**
+     * set when the heap was closed, and the state below it matches the Chunks.
+     */
+    std::uint32_t clean;
+
+    /**
+     * set while the pointers of the file are being moved to a new address. A file left like this can not be opened.
+     */
+    std::uint32_t moving;
+
+    /**
+     * the address the file is mapped at, every pointer in it points after it.
+     */
+    char *base;
+
+    /**
+     * size of the file, the most memory the heap can have.
+     */
+    std::size_t capacity;
+
+    /**
+     * the end of the memory handed out to the heap so far.
+     */
+    char *brk;
+
+    /**
+     * the Regions and Slab_Areas of the heap, always up to date.
+     */
+    Region *regions;
+    Slab_Area *slab_areas;
+
+    /**
+     * distance from the start of the file to the root object, 0 when there is none.
+     */
+    std::size_t root;
+
+    /**
+     * the search mode the free Chunks are kept for, and whether allocations take whole cache lines.
+     */
+    std::uint32_t search_mode;
+    std::uint32_t cache_line_aligned;
+
+    /**
+     * the secret of the canaries of hardened builds.
+     */
+    std::uintptr_t secret;
+
+    /**
+     * the state of the heap when it was closed.
+     */
+    Chunk *initial;
+    Chunk *end;
+    Chunk *next_fit_chunk;
+    Chunk *free_list_initial;
+    Chunk *free_list_end;
+    Chunk *top;
+    Chunk *bins[Size_Classes::count];
+    Chunk *bins_end[Size_Classes::count];
+    std::size_t bin_map;
+    Slab *slabs[Size_Classes::count];
+    std::size_t epoch;
+    Allocator_Stats stats;
+};
+
+/**
+ * A linked list of the chunks created the memory.
+ *
+ * This whole class is the allocator and memory management class. When creating a new object within the heap, this class
+ * will create memory and manage it.
+ */
+class Memory_Linked_List
+{
+public:
+    /**
+     * this enum is to select the search mode desired for block reuse.
+     *
+     * first_fist will reuse the first block that is big enough to store the data.
+     *
+     * next_fit is like first_fit, but will keep the position of the last tracked found memory, so it doesnt have to
+     * start all over again.
+     *
+     * best_fit will find the best block possible for the new memory.
+     *
+     * free_list creates a new linked list of the free Chunks, and will go through that list when reusing memory .
+     *
+     * segregated keeps one free list per power of two size class, so reusing a Chunk is a pop from the matching bin
+     * and freeing one is a push, no matter how many Chunks are alive.
+     *
+     * slab puts allocations of up to slab_max_size bytes in Slab pages of their size class, found with a bitmap scan
+     * and freed by setting their bit back. Bigger allocations are Chunks kept like in segregated.
+     *
+     * In every mode, freed Chunks are merged with the free Chunks physically next to them, and reused Chunks that are
+     * too big are split. Only Chunks carved from the same Region are contiguous, so large Chunks that have their own
+     * mapping are never merged.
+     */
+    enum class search_mode
+    {
+        first_fit,
+        next_fit,
+        best_fit,
+        free_list,
+        segregated,
+        slab,
+    };
+
+    /**
+     * this enum is to select where the memory of the heap comes from.
+     *
+     * sbrk moves the program break, mmap makes anonymous mappings.
+     *
+     * file takes it from a file mapped with MAP_SHARED, so the heap and what it holds outlive the process, see
+     * open_file(). It is set by open_file(), not by hand.
+     */
+    enum class mmap_mode
+    {
+        sbrk,
+        mmap,
+        file,
+    };
+
+    /**
+     * the search mode that will be used in block reuse
+     */
+    search_mode m_search_mode = search_mode::first_fit;
+
+    /**
+     * the allocator chosen when allocating
+     */
+    mmap_mode m_mmap_mode = mmap_mode::mmap;
+
+    /**
+     * size of the regions reserved for small Chunks. Setting it to 0 gives every Chunk its own mapping.
+     */
+    std::size_t m_region_size = std::size_t{64} << 20;
+
+    /**
+     * Chunks bigger than this (header included) get their own mapping instead of being carved from a region.
+     */
+    std::size_t m_large_threshold = std::size_t{1} << 20;
+
+    /**
+     * size of a cache line on x64.
+     */
+    static constexpr std::size_t cache_line_size = 64;
+
+    /**
+     * when set, every alloc is aligned on a cache line and takes whole cache lines, so two allocations never share a
+     * line and threads writing to their own objects do not slow each other down (false sharing).
+     */
+    bool m_cache_line_aligned = false;
+
+    /**
+     * size of a transparent huge page on x64.
+     */
+    static constexpr std::size_t huge_page_size = std::size_t{2} << 20;
+
+    /**
+     * when set, mappings of at least huge_page_size are aligned on huge_page_size and asked to be backed by
+     * transparent huge pages (madvise(MADV_HUGEPAGE)), so a single TLB entry and a single page fault cover 2 MiB
+     * instead of 4 KiB. Only used with mmap_mode::mmap, like the other mapping policies.
+     */
+    bool m_huge_pages = false;
+
+    /**
+     * when set, mappings are pre-faulted when they are made (MAP_POPULATE), so touching the memory later never takes a
+     * page fault, at the cost of making all of it resident right away.
+     */
+    bool m_populate = false;
+
+    /**
+     * when set, mappings are made with MAP_NORESERVE, no swap space is set aside for them, for large reservations that
+     * are mostly never touched.
+     */
+    bool m_no_reserve = false;
+
+    /**
+     * when not negative, every new mapping is placed on this NUMA node with mbind (MPOL_PREFERRED, so it still comes
+     * from another node when this one is full), instead of on the node of the thread that touches it first. Nodes up
+     * to 63.
+     */
+    int m_numa_node = -1;
+
+    /**
+     * how long the pages of a free Chunk stay resident before they are given back to the OS, so memory freed and
+     * reused right away never pays for the syscalls and page faults. Free memory is only looked at when the heap is
+     * used, an idle heap keeps its pages until trim() is called. milliseconds::max() never gives anything back on its
+     * own.
+     */
+    std::chrono::milliseconds m_decay_time{10000};
+
+    /**
+     * biggest allocation put in a Slab in the slab search mode.
+     */
+    static constexpr std::size_t slab_max_size = 256;
+
+    /**
+     * size and alignment of a Slab page.
+     */
+    static constexpr std::size_t slab_page_size = 4096;
+
+    /**
+     * biggest size alloc(), alloc_aligned(), alloc_batch() and reallocate() take, bigger ones fail. The headers, the
+     * rounding to a size class and to pages are added to it, and must not wrap around to a small size.
+     */
+    static constexpr std::size_t max_alloc_size = PTRDIFF_MAX - 4096;
+
+    /**
+     * when set, pages are given back with MADV_FREE instead of MADV_DONTNEED once they decayed. The kernel only takes
+     * them when it runs short of memory, which is cheaper if they are reused soon, but the resident size does not go
+     * down right away. trim() always uses MADV_DONTNEED.
+     */
+    bool m_lazy_purge = false;
+
+#ifdef ALLOCATOR_HARDENED
+    /**
+     * when set, Chunks with a mapping of their own are followed by a page that can not be read or written, so writing
+     * past the end of a large allocation crashes right away instead of going unnoticed. Their size is rounded up to
+     * whole pages, so the payload ends right before the guard page. Only with mmap_mode::mmap, and only in hardened
+     * builds.
+     */
+    bool m_guard_pages = true;
+
+    /**
+     * size of a guard page, a page on x64.
+     */
+    static constexpr std::size_t guard_page_size = 4096;
+
+    /**
+     * byte written over the payload of every block freed in hardened builds, so reading freed memory gives values
+     * that stand out instead of the old data.
+     */
+    static constexpr unsigned char free_poison = 0xdf;
+#endif
+
+    /**
+     * Sets the search mode. Every mode keeps its free Chunks in lists of its own, so the mode can only change while
+     * the heap has no memory: once something has been allocated, the switch is refused and the heap keeps its mode.
+     *
+     * @param mode the new search mode.
+     * @return false if the heap has memory already, unless it is in this mode.
+     */
+    bool set_search_mode(search_mode mode);
+
+    /**
+     * Returns the number of mmap and sbrk calls made so far, used by the benchmark.
+     */
+    std::size_t get_syscall_count() const;
+
+    /**
+     * Returns a snapshot of the counters of this heap. They are always kept up to date, with plain increments.
+     */
+    Allocator_Stats get_stats() const;
+
+    /**
+     * Turns the sampling heap profiler on, or off with 0. See Heap_Profile.
+     *
+     * About one allocated byte in bytes is sampled, and the call stack of the allocation holding it is kept until it is
+     * freed. Sampled allocations are always Chunks, even the small ones of the slab search mode, so free() finds out
+     * from their header alone. The other allocations only take the bytes they allocate off a countdown.
+     *
+     * @param bytes the mean number of bytes allocated between two samples, Heap_Profile::default_interval is a good
+     * start.
+     */
+    void set_sample_interval(std::size_t bytes);
+
+    /**
+     * Returns the profiler of this heap, to dump its live samples with Heap_Profile::write().
+     */
+    const Heap_Profile &get_profile() const;
+
+    /**
+     * where open_file() maps a new file by default, far from where the system puts mappings, and from the memory the
+     * address sanitizer reserves, so it is mapped at the same address on every run.
+     */
+    static constexpr std::uintptr_t file_base = 0x300000000000;
+
+    /**
+     * Backs the heap with a file, so a later run of the program can open it again and find the memory of the heap,
+     * and everything stored in it, where it was. Must be called before the heap allocates anything.
+     *
+     * A new file is created with capacity bytes, sparse, and the search mode of the heap. An existing file brings its
+     * own search mode and cache line mode along, and is mapped where it was created, so the pointers stored in it are
+     * still right. If the file was closed properly, the heap takes its state back from the file right away.
+     * Otherwise the process stopped while the file was open, and the heap is rebuilt from its Regions and Slabs:
+     * Chunks are walked by their sizes, their flags and footers are written again, free neighbours are merged and
+     * the lists and counters are rebuilt. When the address it was mapped at is taken, the file is mapped somewhere else
+     * and its Regions and Slab_Areas are moved, then the heap is rebuilt the same way. Data that must survive a move
+     * stores Relative_Pointers instead of pointers.
+     *
+     * The file is closed by the destructor, which writes the state of the heap and marks the file clean.
+     *
+     * @param path the file, created if it does not exist.
+     * @param capacity the size of a new file, the most memory the heap can have. An existing file grows to it.
+     * @param base where the file is mapped, nullptr for where it was created, or file_base for a new file.
+     * @return false if the heap has memory already, or if the file can not be opened, mapped, or is not a heap
+     * file of this build.
+     */
+    bool open_file(const char *path, std::size_t capacity, void *base = nullptr);
+
+    /**
+     * Returns whether open_file() had to rebuild the heap, because the file was not closed or was moved.
+     */
+    bool was_recovered() const;
+
+    /**
+     * Stores where the root object of a file heap is, the one a later run starts from to find everything else. It is
+     * written to the file right away, so it should only point to data that is complete.
+     *
+     * @param data memory from this heap, or nullptr for none. Ignored unless the heap is backed by a file.
+     */
+    void set_root(void *data);
+
+    /**
+     * Returns the root object of a file heap, at the address the file is mapped at in this run.
+     *
+     * @return the root object, or nullptr if there is none or the heap is not backed by a file.
+     */
+    void *get_root() const;
+
+    /**
+     * Initialises the link list. It sets all of the member variables to nullptr.
+     */
+    Memory_Linked_List();
+
+    /**
+     *  alloc memory onto the heap, manging this memory in a linked list, and creating or recycling Chunks.
+     *
+     *  alloc will first check if there are any Chunks that can be recycled first, using what ever algorithm is
+     *  selected in m_search_mode. If a free Chunk as not been found, it will manually request memory form the heap.
+     *  alloc also manages the memory linked list, initializing it or adding new chunks at the end of it. In either
+     *  cases, whether a Chunk is recycled or created, the Chunk used value is set to true and the payload pointer is
+     *  returned to the user.
+     * @param size the size that the user wants to store.
+     * @return the payload pointer to the data, or nullptr if out of memory or if size is above max_alloc_size.
+     */
+    intptr_t *alloc(std::size_t size);
+
+    /**
+     * Allocates memory aligned on a power of two, meant for alignments up to the page size.
+     *
+     * A Chunk big enough to hold an aligned block anywhere in it is allocated, then its start is cut into a free
+     * Chunk, so the header of the aligned Chunk sits right before the aligned address, and its end is split off as
+     * usual. The memory is freed with free().
+     *
+     * @param size the number of bytes needed.
+     * @param alignment a power of two.
+     * @param offset data + offset is aligned instead of data, for callers that put a header of their own first. A
+     * multiple of 8.
+     * @return a pointer to the memory, or nullptr if out of memory, if alignment is not a power of two or if size is
+     * above max_alloc_size.
+     */
+    intptr_t *alloc_aligned(std::size_t size, std::size_t alignment, std::size_t offset = 0);
+
+    /**
+     * Allocates count blocks of the same size at once, each freed like a block from alloc().
+     *
+     * In the slab search mode, small blocks are taken from the bitmaps of as few Slabs as possible, a word at a time.
+     * Otherwise a single Chunk big enough for a run of blocks is found or carved, then cut into a Chunk per block in
+     * one pass, so the search and the bookkeeping are paid once per run instead of once per block. Runs stay under
+     * m_large_threshold, so their blocks come from a Region.
+     *
+     * The blocks count towards the next sample of the heap profiler like with alloc(), the one holding the sampled
+     * byte is allocated on its own.
+     *
+     * @param size the number of bytes of every block.
+     * @param count the number of blocks.
+     * @param out where the pointers to the blocks are written.
+     * @return the number of blocks allocated, less than count only if out of memory, 0 if size is above max_alloc_size.
+     */
+    std::size_t alloc_batch(std::size_t size, std::size_t count, intptr_t **out);
+
+    /**
+     * Sets the used flag of a Chunk to false.
+     *
+     * By setting the used flag to false, the Chunk is marked to be reused when a new Chunk of memory is being
+     * requested. If the free_list option has been selected, it will instead put the freed chunk in its own linked list.
+     * The Chunk is then merged with its free physical neighbours, so the freed memory can serve bigger requests.
+     *
+     * A Chunk or a Slab object that is free already is ignored, as freeing it again would break the lists. Hardened
+     * builds abort on it as a double free.
+     *
+     * @param data a pointer of the memory that is being freed.
+     */
+    void free(intptr_t *data);
+
+    /**
+     * Frees a Chunk when the size given to alloc is known, like with sized delete.
+     *
+     * The size is only a hint: the block is freed by its header, exactly like with free(data), double frees included,
+     * so a wrong size never frees the wrong amount of memory. Hardened builds check the size, and abort when it could
+     * not come from an alloc of this block.
+     *
+     * @param data a pointer of the memory that is being freed.
+     * @param size the size given to alloc, a hint.
+     */
+    void free(intptr_t *data, std::size_t size);
+
+    /**
+     * Frees count blocks at once.
+     *
+     * Objects of a Slab that follow each other in the batch, like the nodes of a container allocated with
+     * alloc_batch(), only update their Slab and its list once. The Chunks are sorted by address, and runs of Chunks
+     * next to each other in memory are merged into a single Chunk, which is then freed, listed and coalesced with its
+     * neighbours once.
+     *
+     * @param data the blocks, nullptr ones ignored. The array is reordered.
+     * @param count the number of blocks.
+     */
+    void free_batch(intptr_t **data, std::size_t count);
+
+    /**
+     * Returns the Slab an allocation of the slab search mode is in.
+     *
+     * @param data a pointer from alloc().
+     * @return the Slab, or nullptr if the memory is a Chunk.
+     */
+    Slab *slab_of(const void *data) const;
+
+    /**
+     * Resizes the memory of a Chunk, moving it only when it must.
+     *
+     * A Chunk that is big enough already is split if it shrinks. A growing Chunk first tries to absorb its free right
+     * neighbour, then to take more of its Region when it is the last Chunk carved from it, then mremap when it has a
+     * mapping of its own. Only if none of these work, the data is copied to a new Chunk and the old one is freed.
+     *
+     * @param data the memory being resized, nullptr allocates new memory.
+     * @param size the new number of bytes.
+     * @return a pointer to the memory, or nullptr if out of memory or if size is above max_alloc_size, in which case
+     * data is left untouched.
+     */
+    intptr_t *reallocate(intptr_t *data, std::size_t size);
+
+    /**
+     *  Returns a Chunk within the memory. Objects in a Slab have no Chunk, see slab_of().
+     *
+     * @param data the pointer of the memory stored.
+     * @return a pointer of the header of the chunk.
+     *
+     * @note This function is copied from Writing a Memory Allocator by Dmitry Soshnikov, as I am not exactly sure how
+     * it works. Link (http://dmitrysoshnikov.com/compilers/writing-a-memory-allocator/).
+     */
+    static Chunk *get_header(intptr_t *data)
+    {
+        return (Chunk *)((char *)data + sizeof(std::declval<Chunk>().data) - sizeof(Chunk));
+    }
+
+    /**
+     * this is for testing purposes, it prints the whole memory linked list and information about each node.
+     */
+    void print_all_memory();
+
+    /**
+     * prints all the memory as int
+     */
+    void print_all_memory_as_int();
+
+    /**
+     * prints all the memory as char
+     */
+    void print_all_memory_as_char();
+
+    /**
+     * this is for testing purposes, it prints the whole freed memory linked list and information about each node.
+     */
+    void print_all_free_memory();
+
+    /**
+     * Gives every free page back to the OS now, without waiting for m_decay_time.
+     *
+     * In the slab search mode, the empty Slab pages are given back as well, with madvise.
+     *
+     * Regions left without a used Chunk, other than the current one, and free large Chunks are unmapped. The pages
+     * inside the other free Chunks are released with madvise, keeping their address space and headers, so they
+     * come back zeroed on the next page fault. With sbrk, only memory at the top of the program break can be given
+     * back, the rest is released with madvise as well.
+     *
+     * @return the number of bytes given back.
+     */
+    std::size_t trim();
+
+    /**
+     * A heap owns its mappings, it can not be copied.
+     */
+    Memory_Linked_List(const Memory_Linked_List &) = delete;
+    Memory_Linked_List &operator=(const Memory_Linked_List &) = delete;
+
+    /**
+     * Gives all of the memory back to the OS: every Region, Slab_Area and large Chunk is unmapped. With sbrk, the
+     * program break is moved down over the memory at its top, as long as it belongs to this heap. A heap backed by a
+     * file writes its state to the file instead, then closes it, see open_file().
+     */
+    ~Memory_Linked_List();
+
+private:
+    /**
+     * align returns the memory needed for the storage of the data, the size rounded up to its class in Size_Classes:
+     * 8, 16, 24, ... 64, 80, 96... etc. This always rounds up, eg(if data is 13 bytes, it will allocate 16 bytes, and
+     * 1025 bytes take 1280).
+     *
+     * @param size number of bytes that the user wants to store.
+     * @return the round up number of bytes needed to store the data.
+     */
+    static std::size_t align(std::size_t size);
+
+    /**
+     * Returns the size of the data that needs to be allocated, plus the size of the header. The header however,
+     * already has the first pointer of the user data, so it is subtracted.
+     *
+     * @param size the number of bytes that is being allocated.
+     * @return the size plus the header.
+     *
+     * @note This function is copied from Writing a Memory Allocator by Dmitry Soshnikov, as I am not exactly sure how
+     * it works. Link (http://dmitrysoshnikov.com/compilers/writing-a-memory-allocator/).
+     */
+    static std::size_t allocSize(std::size_t size);
+
+    /**
+     * Returns a size rounded up to whole cache lines, what an alloc takes in cache line aligned mode.
+     *
+     * @param size the number of bytes that is being allocated.
+     * @return the number of bytes of the cache lines holding them, at least one line.
+     */
+    static std::size_t cache_lines(std::size_t size);
+
+    /**
+     * Adds a Chunk that has just been handed out to the live counters, and updates the peaks.
+     *
+     * @param chunk the allocated Chunk.
+     */
+    void count_live(Chunk *chunk);
+
+    /**
+     * Returns the footer (boundary tag) of a Chunk, which stores its size. Only free Chunks have one.
+     *
+     * @param chunk the Chunk.
+     * @return a pointer to the last word of the Chunk.
+     */
+    static std::size_t *get_footer(Chunk *chunk);
+
+    /**
+     * Writes the footer of a Chunk if it is free, and tells the Chunk after it whether it can read it. Called whenever
+     * the size or the used flag of a Chunk changes. A free Chunk of at least purge_min_size bytes is stamped with the
+     * current epoch, its pages are dirty.
+     *
+     * @param chunk the Chunk.
+     */
+    void update_boundary(Chunk *chunk);
+
+    /**
+     * Returns the Chunk that starts right after this one in memory.
+     *
+     * @param chunk the Chunk.
+     * @return the physical neighbour, or nullptr if there is none.
+     */
+    static Chunk *next_neighbour(Chunk *chunk);
+
+    /**
+     * Returns the free Chunk that ends right before this one in memory, found with its footer.
+     *
+     * @param chunk the Chunk.
+     * @return the physical neighbour, or nullptr if there is none or it is used.
+     */
+    static Chunk *prev_neighbour(Chunk *chunk);
+
+    /**
+     * Merges a freed Chunk with the free Chunks physically before and after it.
+     *
+     * The absorbed Chunks are removed from whatever list they are in. The merged Chunk is not added to any list.
+     *
+     * @param chunk a freed Chunk.
+     * @return the merged Chunk, which starts at the left neighbour if it was merged.
+     */
+    Chunk *coalesce(Chunk *chunk);
+
+    /**
+     * Grows a Chunk over the Chunk physically after it.
+     *
+     * @param chunk the Chunk that stays.
+     * @param absorbed the Chunk right after it, already removed from its list.
+     */
+    void merge(Chunk *chunk, Chunk *absorbed);
+
+    /**
+     * Cuts the end of a reused Chunk into a new free Chunk, if what is left is at least min_chunk_size.
+     *
+     * @param chunk the Chunk being reused.
+     * @param size the size needed for memory.
+     */
+    void split(Chunk *chunk, std::size_t size);
+
+    /**
+     * Allocates an aligned Chunk, without counting it towards the next sample, see alloc_aligned().
+     *
+     * @param size the number of bytes needed, rounded to cache lines in cache line aligned mode.
+     * @param alignment a power of two.
+     * @param offset data + offset is aligned instead of data.
+     * @return a pointer to the memory, or nullptr if out of memory.
+     */
+    intptr_t *alloc_aligned_chunk(std::size_t size, std::size_t alignment, std::size_t offset);
+
+    /**
+     * Allocates the block that holds the next sampled byte in a Chunk, and gives it to the profiler with its call
+     * stack. Draws the countdown to the next sample.
+     *
+     * @param size the size that the user wants to store.
+     * @param alignment a power of two.
+     * @param offset data + offset is aligned instead of data.
+     * @return a pointer to the memory, or nullptr if out of memory.
+     */
+    intptr_t *alloc_sampled(std::size_t size, std::size_t alignment, std::size_t offset);
+
+    /**
+     * Allocates a batch of blocks, none of them sampled, see alloc_batch().
+     *
+     * @param size the number of bytes of every block.
+     * @param count the number of blocks.
+     * @param out where the pointers to the blocks are written.
+     * @return the number of blocks allocated, less than count only if out of memory.
+     */
+    std::size_t alloc_batch_blocks(std::size_t size, std::size_t count, intptr_t **out);
+
+    /**
+     * Allocates a Chunk, reusing a free one or carving a new one, see alloc().
+     *
+     * @param size the size that the user wants to store.
+     * @return the payload pointer to the data.
      */
-    std::size_t size;
+    intptr_t *alloc_chunk(std::size_t size);
 
     /**
-     * checking if it is used.
+     * Takes a free object from the first Slab of its class that has one, starting a new Slab if there is none.
+     *
+     * @param size the size that the user wants to store.
+     * @return the object, or nullptr if out of memory or if the size is bigger than slab_max_size.
      */
-    bool used;
+    intptr_t *slab_alloc(std::size_t size);
 
     /**
-     * pointer to next chunk.
+     * Takes up to count free objects from the Slabs of a size class, all the set bits of a bitmap word at a time,
+     * starting new Slabs as needed.
+     *
+     * @param size the size that the user wants to store, at most slab_max_size.
+     * @param count the number of objects.
+     * @param out where the pointers to the objects are written.
+     * @return the number of objects taken, less than count only if out of memory.
      */
-    Chunk *next;
+    std::size_t slab_alloc_batch(std::size_t size, std::size_t count, intptr_t **out);
 
     /**
-     * Payload.
-     * Users memory.
+     * Allocates a run of count Chunks of the same size next to each other, cut from a single Chunk.
+     *
+     * @param size the aligned size of every Chunk.
+     * @param count the number of Chunks, whose headers and payloads fit in m_large_threshold.
+     * @param out where the pointers to the Chunks are written.
+     * @return count, or 0 if out of memory.
      */
-    intptr_t data[1];
-};
+    std::size_t alloc_run(std::size_t size, std::size_t count, intptr_t **out);
 
-/**
- * A linked list of the chunks created the memory.
- *
- * This whole class is the allocator and memory management class. When creating a new object within the heap, this class
- * will create memory and manage it.
- */
-class Memory_Linked_List
-{
-public:
     /**
-     * this enum is to select the search mode desired for block reuse.
+     * Marks an object of a Slab free. A Slab left empty gives its page back to its Slab_Area, unless it is the only
+     * Slab of its class with free objects. An object that is not used is ignored.
      *
-     * first_fist will reuse the first block that is big enough to store the data.
+     * @param slab the Slab of the object.
+     * @param data the object.
+     */
+    void slab_free(Slab *slab, intptr_t *data);
+
+    /**
+     * Sets the bit of an object of a Slab and takes it off the live counters, without moving the Slab in its list.
      *
-     * next_fit is like first_fit, but will keep the position of the last tracked found memory, so it doesnt have to
-     * start all over again.
+     * @return false if the object is not used, or not an object of the Slab.
+     */
+    bool slab_mark_free(Slab *slab, intptr_t *data);
+
+    /**
+     * Moves a Slab whose objects were freed: back in the list of its class if it was full, to its Slab_Area if it is
+     * empty.
      *
-     * best_fit will find the best block possible for the new memory.
+     * @param slab the Slab.
+     * @param was_full whether the Slab was full before the objects were freed.
+     */
+    void slab_relist(Slab *slab, bool was_full);
+
+    /**
+     * Returns the index of the first free object of a Slab, the first set bit of its bitmap.
      *
-     * free_list creates a new linked list of the free Chunks, and will go through that list when reusing memory .
+     * @param slab a Slab with free objects.
      */
-    enum class search_mode
-    {
-        first_fit,
-        next_fit,
-        best_fit,
-        free_list,
-    };
+    static std::size_t slab_find_free(const Slab *slab);
 
-    enum class mmap_mode
-    {
-        sbrk,
-        mmap,
-    };
+    /**
+     * Takes an empty page for a new Slab, from the stack of a Slab_Area or at its bump pointer, reserving a new area
+     * if they are all full.
+     *
+     * @return the page, or nullptr if out of memory.
+     */
+    Slab *slab_page();
 
     /**
-     * the search mode that will be used in block reuse
+     * Returns the Slab_Area a pointer is in.
+     *
+     * @param data any pointer.
+     * @return the area, or nullptr if the pointer is not in a Slab page.
      */
-    search_mode m_search_mode = search_mode::first_fit;
+    Slab_Area *slab_area_of(const void *data) const;
 
     /**
-     * the allocator chosen when allocating
+     * Gives back the pages that are on the stacks of empty pages, see trim().
+     *
+     * @param force set to also give back the pages emptied during the current epoch.
+     * @return the number of bytes given back.
      */
-    mmap_mode m_mmap_mode = mmap_mode::mmap;
+    std::size_t purge_slabs(bool force);
 
-    void set_search_mode(search_mode mode); // Declaration for setting searchmode for benchmark test
+    /**
+     * Grows a used Chunk without moving it, or with mremap for a Chunk alone in its mapping.
+     *
+     * @param chunk the Chunk being grown.
+     * @param size the aligned size it needs.
+     * @return the Chunk, which only moves with mremap, or nullptr if it can not grow in place.
+     */
+    Chunk *grow_in_place(Chunk *chunk, std::size_t size);
 
     /**
-     * Initialises the link list. It sets all of the member variables to nullptr.
+     * Checks if free Chunks are kept out of the memory linked list, in the free list or in the bins.
+     *
+     * @return true for the free_list and segregated search modes.
      */
-    Memory_Linked_List();
+    bool lists_free_chunks() const;
 
     /**
-     *  alloc memory onto the heap, manging this memory in a linked list, and creating or recycling Chunks.
+     * Removes a free Chunk from where free Chunks are kept in the current search mode.
      *
-     *  alloc will first check if there are any Chunks that can be recycled first, using what ever algorithm is
-     *  selected in m_search_mode. If a free Chunk as not been found, it will manually request memory form the heap.
-     *  alloc also manages the memory linked list, initializing it or adding new chunks at the end of it. In either
-     *  cases, whether a Chunk is recycled or created, the Chunk used value is set to true and the payload pointer is
-     *  returned to the user.
-     * @param size the size that the user wants to store.
-     * @return the payload pointer to the data.
+     * @param chunk the free Chunk.
      */
-    intptr_t *alloc(std::size_t size);
+    void unlink_free(Chunk *chunk);
 
     /**
-     * Sets the used flag of a Chunk to false.
+     * Adds a Chunk at the end of a doubly linked list.
      *
-     * By setting the used flag to false, the Chunk is marked to be reused when a new Chunk of memory is being
-     * requested. If the free_list option has been selected, it will instead put the freed chunk in its own linked list
+     * @param first the first Chunk of the list.
+     * @param last the last Chunk of the list.
+     * @param chunk the Chunk being added.
+     */
+    static void push_chunk(Chunk *&first, Chunk *&last, Chunk *chunk);
+
+    /**
+     * Removes a Chunk from a doubly linked list.
      *
-     * @param data a pointer of the memory that is being freed.
+     * @param first the first Chunk of the list.
+     * @param last the last Chunk of the list.
+     * @param chunk the Chunk being removed.
      */
-    void free(intptr_t *data);
+    static void unlink_chunk(Chunk *&first, Chunk *&last, Chunk *chunk);
 
     /**
-     *  Returns a Chunk within the memory.
+     * Returns the memory for a new Chunk. Small Chunks are carved from the current Region, and a new Region is
+     * reserved when it is full. Chunks bigger than m_large_threshold get their own mapping.
      *
-     * @param data the pointer of the memory stored.
-     * @return a pointer of the header of the chunk.
+     * The adjacency flags of the Chunk are set, the rest of the header is left to the caller.
      *
-     * @note This function is copied from Writing a Memory Allocator by Dmitry Soshnikov, as I am not exactly sure how
-     * it works. Link (http://dmitrysoshnikov.com/compilers/writing-a-memory-allocator/).
+     * @param size The amount of bytes that the user wants to store
+     * @return the new Chunk, or nullptr if out of memory.
      */
-    static Chunk *get_header(intptr_t *data)
-    {
-        return (Chunk *)((char *)data + sizeof(std::declval<Chunk>().data) - sizeof(Chunk));
-    }
+    Chunk* memory_map(std::size_t size);
 
     /**
-     * this is for testing purposes, it prints the whole memory linked list and information about each node.
+     * Carves a Chunk at the bump pointer of the current Region. The Chunk carved before it in the same Region is its
+     * physical neighbour.
+     *
+     * @param size The amount of bytes that the user wants to store
+     * @return the new Chunk, or nullptr if out of memory.
      */
-    void print_all_memory();
+    Chunk *region_carve(std::size_t size);
 
     /**
-     * prints all the memory as int
+     * Counts a free, and starts a new epoch every m_decay_time, giving back the pages of the Chunks that have been
+     * free for a whole epoch. The clock is only read every decay_check_interval frees, or when a big Chunk is freed.
+     *
+     * @param large set when the freed Chunk holds whole pages.
      */
-    void print_all_memory_as_int();
+    void decay(bool large);
 
     /**
-     * prints all the memory as char
+     * Gives back the free pages of every free Chunk, see trim().
+     *
+     * @param force set to ignore the epochs, and give back everything.
+     * @return the number of bytes given back.
      */
-    void print_all_memory_as_char();
+    std::size_t purge(bool force);
 
     /**
-     * this is for testing purposes, it prints the whole freed memory linked list and information about each node.
+     * Gives back the free pages of the free Chunks of a list, see trim().
+     *
+     * @param first the first Chunk of the list.
+     * @param force set to ignore the epochs.
+     * @return the number of bytes given back.
      */
-    void print_all_free_memory();
+    std::size_t purge_list(Chunk *first, bool force);
 
     /**
-     * A default destructor to give memory back to the OS when the class is not used anymore.
+     * Gives back the mapping of a free Chunk if it is alone in it, or else the whole pages of its payload.
+     *
+     * @param chunk a free Chunk.
+     * @param force set to ignore the epoch it was freed at.
+     * @return the number of bytes given back.
      */
-    ~Memory_Linked_List() = default;
+    std::size_t purge_chunk(Chunk *chunk, bool force);
 
-private:
     /**
-     * align returns the memory needed for the storage of the data. This is specifically made for x64 machines, as it
-     * returns 8, 16, 32... etc. This always rounds up, eg(if data is 13 bytes, it will allocate 16 bytes).
+     * Releases the whole pages of a free Chunk with madvise, keeping its header, its stamp and its footer.
      *
-     * @param size number of bytes that the user wants to store.
-     * @return the round up number of bytes needed to store the data.
+     * @param chunk a free Chunk of at least purge_min_size bytes.
+     * @param lazy set to use MADV_FREE instead of MADV_DONTNEED.
+     * @return the number of bytes given back.
      */
-    static std::size_t align(std::size_t size);
+    std::size_t purge_pages(Chunk *chunk, bool lazy);
 
     /**
-     * Returns the size of the data that needs to be allocated, plus the size of the header. The header however,
-     * already has the first pointer of the user data, so it is subtracted.
+     * Unmaps a free Chunk that is alone in its mapping, a large Chunk or the only Chunk of a Region that is not the
+     * current one. The Chunk is removed from its list first.
      *
-     * @param size the number of bytes that is being allocated.
-     * @return the size plus the header.
+     * @param chunk a free Chunk with no physical neighbours.
+     * @return the number of bytes given back, 0 if it can not be, for the current Region or with sbrk when the
+     * mapping is not at the top of the program break.
+     */
+    std::size_t release_mapping(Chunk *chunk);
+
+    /**
+     * Returns the size of the mapping of its own that a large Chunk starts, whatever Chunks it has been split in.
      *
-     * @note This function is copied from Writing a Memory Allocator by Dmitry Soshnikov, as I am not exactly sure how
-     * it works. Link (http://dmitrysoshnikov.com/compilers/writing-a-memory-allocator/).
+     * @param chunk the first Chunk of the mapping.
+     * @return the number of bytes mapped for it.
+     */
+    static std::size_t mapping_size(Chunk *chunk);
+
+    /**
+     * Returns the Region a Chunk is the first Chunk of.
+     *
+     * @param chunk a Chunk with no neighbour before it.
+     * @return the Region, or nullptr if the Chunk has a mapping of its own.
      */
-    std::size_t allocSize(std::size_t size);
+    Region *region_of(Chunk *chunk) const;
 
     /**
      * This function simply selects the allocator, etheir sbrk or mmap.
-     * 
-     * @param size The amount of bytes that the user wants to store
+     *
+     * @param bytes the number of bytes to map.
+     * @return a pointer to the memory, or nullptr if out of memory.
      */
-    Chunk* memory_map(std::size_t size);
+    void *memory_request(std::size_t bytes);
 
     /**
      * The mmap allocator.
-     * returns the program break pointer (heap pointer) and makes sure that it will not go out of memory (OOM). It
-     * returns the program break, and it also does a check if it is possible to allocate this chunk, and if it is not
-     * possible, to returns nullptr.
+     * returns a new anonymous mapping and makes sure that it will not go out of memory (OOM). If it is not possible
+     * to map this memory, it returns nullptr. The mapping follows m_huge_pages, m_populate, m_no_reserve and
+     * m_numa_node.
      *
-     * @param size amount of bytes that needs to be stored.
-     * @return the program break pointer.
+     * @param bytes amount of bytes that needs to be mapped.
+     * @return a pointer to the mapping.
      */
-    Chunk *memory_map_mmap(std::size_t size);
+    void *memory_map_mmap(std::size_t bytes);
 
     /**
      * The sbrk allocator.
@@ -199,10 +1113,51 @@ private:
      * returns the program break, and it also does a check if it is possible to allocate this chunk, and if it is not
      * possible, to returns nullptr.
      *
-     * @param size amount of bytes that needs to be stored.
+     * @param bytes amount of bytes that needs to be stored.
      * @return the program break pointer.
      */
-    Chunk *memory_map_sbrk(std::size_t size);
+    void *memory_map_sbrk(std::size_t bytes);
+
+    /**
+     * The file allocator.
+     * returns the end of the memory of the file handed out so far, and moves it up, like the program break.
+     *
+     * @param bytes amount of bytes that needs to be stored.
+     * @return a pointer to the memory, or nullptr if the file is full.
+     */
+    void *memory_map_file(std::size_t bytes);
+
+    /**
+     * Copies the state of the heap to its file, before it is closed.
+     */
+    void save_file_state();
+
+    /**
+     * Takes the state of the heap back from a file that was closed properly.
+     */
+    void load_file_state();
+
+    /**
+     * Moves the pointers of the Regions and Slab_Areas of a file mapped at another address than the last time. The
+     * Chunks and Slabs are left to recover_file().
+     *
+     * @param delta the new address of the file less the old one.
+     */
+    void relocate_file(std::ptrdiff_t delta);
+
+    /**
+     * Rebuilds the lists and counters of a heap from the Chunks and Slabs of its file, see open_file().
+     */
+    void recover_file();
+
+    /**
+     * Gives memory from memory_request() back, with munmap, or by moving the program break down with sbrk, which
+     * the caller has checked is right after the memory.
+     *
+     * @param start the start of the memory.
+     * @param bytes the number of bytes.
+     */
+    void memory_release(void *start, std::size_t bytes);
 
     /**
      * Finds the first already allocated Chunk of memory that is not being used. This function goes through the entire
@@ -242,8 +1197,8 @@ private:
      *  Creates and manges a linked list for free Chunks.
      *
      *  free_listing will add Chunks to a free linked list, initializing it if there are none, or adding them to the end
-     *  of the list. It also removes the freed Chunk for the memory linked list. This makes searching much faster, as
-     *  the reuse algorithm only has to go through the freed Chunks.
+     *  of the list. The freed Chunk has already been removed from the memory linked list. This makes searching much
+     *  faster, as the reuse algorithm only has to go through the freed Chunks.
      *
      * @param chunk the Chunk being removed.
      */
@@ -259,6 +1214,37 @@ private:
      */
     Chunk *free_list(std::size_t size);
 
+    /**
+     * Pushes a freed Chunk on the bin of its size class.
+     *
+     * Like free_listing, the Chunk has already been removed from the memory linked list, and is added at the end of
+     * its bin. This makes freeing O(1).
+     *
+     * @param chunk the Chunk being freed.
+     */
+    void segregated_listing(Chunk *chunk);
+
+    /**
+     * Pops a Chunk from the bin matching the size requested.
+     *
+     * Bin n holds the Chunks from the size of class n up to the size of class n + 1, so any Chunk in the bin of the
+     * aligned size is big enough. If that bin is empty, m_bin_map gives the first non empty bigger bin without
+     * searching. Only sizes bigger than every class need to search the last bin, which holds every Chunk bigger than
+     * the last class.
+     *
+     * @param size the size needed for memory
+     * @return the chunk that is being reused, or nullptr if the bin is empty.
+     */
+    Chunk *segregated_list(std::size_t size);
+
+    /**
+     * Returns the bin that holds the free Chunks of a size.
+     *
+     * @param size the size of a Chunk.
+     * @return the index of the bin, which is the biggest size class the Chunk can hold.
+     */
+    static std::size_t bin_index(std::size_t size);
+
     /**
      * this function chooses which search mode is used for block reuse.
      * @param mode what search mode is used.
@@ -275,10 +1261,6 @@ private:
      * initial start of the linked list
      */
     Chunk *m_initial;
-    /**
-     * The start of the linked list.
-     */
-    Chunk *m_start;
     /**
      * The end of the linked list.
      */
@@ -295,14 +1277,166 @@ private:
     Chunk *f_list_initial;
 
     /**
-     * the first Chunk in the freed list
+     * the last Chunk in the freed list
      */
-    Chunk *f_list_start;
+    Chunk *f_list_end;
 
     /**
-     * the last Chunk in the freed list
+     * number of bins used by the segregated search mode, one per size class, so m_bin_map fits in a size_t.
      */
-    Chunk *f_list_end;
+    static constexpr std::size_t bin_count = Size_Classes::count;
+    static_assert(bin_count <= sizeof(std::size_t) * 8, "one bit per bin in m_bin_map");
+
+    /**
+     * Used in the segregated search mode, the first free Chunk of every size class.
+     */
+    Chunk *m_bins[bin_count];
+
+    /**
+     * Used in the segregated search mode, the last free Chunk of every size class.
+     */
+    Chunk *m_bins_end[bin_count];
+
+    /**
+     * one bit per bin, set when the bin is not empty.
+     */
+    std::size_t m_bin_map;
+
+    /**
+     * size of the smallest objects, the smallest size class.
+     */
+    static constexpr std::size_t min_slab_size = 8;
+
+    /**
+     * number of Slab size classes, every class up to slab_max_size.
+     */
+    static constexpr std::size_t slab_class_count = Size_Classes::index(slab_max_size) + 1;
+
+    /**
+     * size of the Slab_Areas, 4096 pages.
+     */
+    static constexpr std::size_t slab_area_size = std::size_t{16} << 20;
+    static_assert(Slab::bitmap_words * 64 >= slab_page_size / min_slab_size, "one bit per object in a page");
+
+    /**
+     * Used in the slab search mode, the first Slab with free objects of every size class.
+     */
+    Slab *m_slabs[slab_class_count];
+
+    /**
+     * Used in the slab search mode, the areas slab pages are taken from.
+     */
+    Slab_Area *m_slab_areas;
+
+    /**
+     * The last Chunk carved from the current region, the physical neighbour of the next one.
+     */
+    Chunk *m_top;
+
+    /**
+     * The region Chunks are being carved from, the first in the list of regions.
+     */
+    Region *m_region;
+
+    /**
+     * the counters returned by get_stats().
+     */
+    Allocator_Stats m_stats;
+
+    /**
+     * bytes left to allocate before the next sample, PTRDIFF_MAX while the profiler is off. An allocation that takes
+     * it below 0 is sampled.
+     */
+    std::ptrdiff_t m_sample_countdown;
+
+    /**
+     * the live samples of the heap profiler.
+     */
+    Heap_Profile m_profile;
+
+    /**
+     * the header of the file of a heap backed by a file, nullptr otherwise.
+     */
+    Heap_File *m_file;
+
+    /**
+     * the file of a heap backed by a file, -1 otherwise.
+     */
+    int m_file_descriptor;
+
+    /**
+     * whether open_file() rebuilt the heap.
+     */
+    bool m_recovered;
+
+    /**
+     * the current epoch, free Chunks stamped with an older one than the previous epoch are given back.
+     */
+    std::size_t m_epoch;
+
+    /**
+     * when the next epoch starts.
+     */
+    std::chrono::steady_clock::time_point m_next_epoch;
+
+    /**
+     * frees left before decay() reads the clock.
+     */
+    std::size_t m_decay_countdown;
+
+    /**
+     * number of frees between two looks at the clock.
+     */
+    static constexpr std::size_t decay_check_interval = 256;
+
+    /**
+     * smallest free Chunk whose pages are given back, two pages so there is a whole one after its stamp.
+     */
+    static constexpr std::size_t purge_min_size = 8192;
+
+    /**
+     * the low bits of the stamp of a free Chunk, the epoch is above them: set once its pages are released, and if it
+     * was with MADV_FREE.
+     */
+    static constexpr std::size_t purged = 1;
+    static constexpr std::size_t purged_lazily = 2;
+
+    /**
+     * smallest payload a split can leave behind.
+     */
+    static constexpr std::size_t min_chunk_size = 8;
+
+#ifdef ALLOCATOR_HARDENED
+    /**
+     * a random value of this heap, mixed in the canaries of its Chunks.
+     */
+    std::uintptr_t m_secret;
+
+    /**
+     * Writes the canary of a Chunk whose header has just been written, or that has moved.
+     */
+    void seal(Chunk *chunk) const;
+
+    /**
+     * Aborts unless a block being freed is a used Chunk of this heap: its canary must match, it must not be free
+     * already, and the canary of the Chunk after it must be intact, or the block was written past its end.
+     *
+     * @param chunk the header of the block.
+     */
+    void check_chunk(Chunk *chunk) const;
+#endif
+
+    /**
+     * Returns the size of the guard page after a Chunk with a mapping of its own, always 0 unless hardened.
+     */
+    std::size_t guard_size() const
+    {
+#ifdef ALLOCATOR_HARDENED
+        return m_guard_pages && m_mmap_mode == mmap_mode::mmap ? guard_page_size : 0;
+#else
+        return 0;
+#endif
+    }
 };
 
 #endif //ALLOCATOR_H
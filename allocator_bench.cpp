@@ -0,0 +1,378 @@
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+#include "allocator.h"
+#include "thread_cache.h"
+
+/*
+ * Statistical benchmark suite, built as its own allocator_bench target without the address sanitizer.
+ *
+ * Every case allocates a batch of blocks and frees them in a shuffled order. It is run a few times to warm the heap
+ * up, then many times while being timed, and the time per operation of every repetition is a sample. The median and
+ * p99 of the samples are reported, with the throughput of the median repetition.
+ *
+ * The cases ending in /sampled run with the heap profiler on, at its default interval, to compare against the same
+ * case without it. The cases ending in /sized free every block with its size, which the hardened heap checks against
+ * the header of the block, large blocks with a guard page included.
+ *
+ * The allocator_bench_hardened target runs the same cases with the hardened heap (ALLOCATOR_HARDENED), so the cost of
+ * its checks is the difference between the two.
+ *
+ * usage: allocator_bench [--format=text|csv|json] [--repetitions=N] [--warmup=N] [--batch=N] [--filter=TEXT]
+ */
+
+/**
+ * whether the heaps are built with their safety checks.
+ */
+#ifdef ALLOCATOR_HARDENED
+constexpr bool hardened = true;
+#else
+constexpr bool hardened = false;
+#endif
+
+/**
+ * Settings given on the command line.
+ */
+class Bench_Options
+{
+public:
+    std::string format = "text";
+    std::size_t repetitions = 200;
+    std::size_t warmup = 10;
+    std::size_t batch = 1000;
+
+    /**
+     * only the cases whose name contains it are run.
+     */
+    std::string filter;
+};
+
+/**
+ * Result of one case.
+ */
+class Bench_Result
+{
+public:
+    std::string name;
+    std::string search;
+    std::string mmap;
+    std::size_t size;
+
+    /**
+     * nanoseconds per operation (an alloc or a free) of every timed repetition, sorted.
+     */
+    std::vector<double> samples;
+
+    /**
+     * Chunks looked at per allocation, 0 when the allocator does not report it.
+     */
+    double search_steps_per_alloc;
+
+    double median() const { return percentile(0.5); }
+    double p99() const { return percentile(0.99); }
+
+    double mean() const
+    {
+        return std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+    }
+
+    /**
+     * allocs and frees per second, at the median.
+     */
+    double ops_per_second() const { return 1e9 / median(); }
+
+    /**
+     * allocs per second at the median, every alloc being paired with a free.
+     */
+    double allocs_per_second() const { return ops_per_second() / 2; }
+
+    /**
+     * Returns the sample below which a share q of the samples are, using the nearest rank.
+     */
+    double percentile(double q) const
+    {
+        auto rank = static_cast<std::size_t>(std::ceil(q * samples.size()));
+        return samples[std::clamp<std::size_t>(rank, 1, samples.size()) - 1];
+    }
+};
+
+const char *search_mode_name(Memory_Linked_List::search_mode search)
+{
+    switch (search)
+    {
+    case Memory_Linked_List::search_mode::first_fit:
+        return "first_fit";
+    case Memory_Linked_List::search_mode::next_fit:
+        return "next_fit";
+    case Memory_Linked_List::search_mode::best_fit:
+        return "best_fit";
+    case Memory_Linked_List::search_mode::free_list:
+        return "free_list";
+    case Memory_Linked_List::search_mode::segregated:
+        return "segregated";
+    case Memory_Linked_List::search_mode::slab:
+        return "slab";
+    }
+    return "unknown";
+}
+
+const char *mmap_mode_name(Memory_Linked_List::mmap_mode mode)
+{
+    return mode == Memory_Linked_List::mmap_mode::sbrk ? "sbrk" : "mmap";
+}
+
+/**
+ * Times a case: warmup untimed repetitions, then options.repetitions timed ones.
+ *
+ * @param options the settings of the run.
+ * @param allocate allocates a block of the given size.
+ * @param deallocate frees a block.
+ * @param size the size of every block.
+ * @return the sorted samples, in nanoseconds per operation.
+ */
+std::vector<double> run_case(const Bench_Options &options, const std::function<void *(std::size_t)> &allocate,
+                             const std::function<void(void *)> &deallocate, std::size_t size)
+{
+    std::vector<void *> pointers(options.batch);
+    std::vector<std::size_t> order(options.batch);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), std::mt19937{42});
+
+    std::vector<double> samples;
+    samples.reserve(options.repetitions);
+
+    for (std::size_t repetition = 0; repetition < options.warmup + options.repetitions; repetition++)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        for (std::size_t i = 0; i < options.batch; i++)
+        {
+            pointers[i] = allocate(size);
+        }
+        // frees out of order, so the heap has to coalesce
+        for (auto i : order)
+        {
+            deallocate(pointers[i]);
+        }
+
+        auto end = std::chrono::steady_clock::now();
+        if (repetition >= options.warmup)
+        {
+            samples.push_back(std::chrono::duration<double, std::nano>(end - start).count() / (2 * options.batch));
+        }
+    }
+
+    std::sort(samples.begin(), samples.end());
+    return samples;
+}
+
+void print_text(const std::vector<Bench_Result> &results)
+{
+    std::cout << (hardened ? "hardened heap" : "heap without checks") << std::endl;
+    std::cout << "name                                  median ns     p99 ns    mean ns      Mops/s  Mallocs/s  steps/alloc"
+              << std::endl;
+    for (const auto &result : results)
+    {
+        char line[160];
+        std::snprintf(line, sizeof(line), "%-36s %10.2f %10.2f %10.2f %11.2f %10.2f %12.2f", result.name.c_str(),
+                      result.median(), result.p99(), result.mean(), result.ops_per_second() / 1e6,
+                      result.allocs_per_second() / 1e6, result.search_steps_per_alloc);
+        std::cout << line << std::endl;
+    }
+}
+
+void print_csv(const std::vector<Bench_Result> &results)
+{
+    std::cout << "name,search_mode,mmap_mode,size,repetitions,median_ns,p99_ns,mean_ns,ops_per_sec,allocs_per_sec,"
+                 "search_steps_per_alloc"
+              << std::endl;
+    for (const auto &result : results)
+    {
+        std::cout << result.name << "," << result.search << "," << result.mmap << "," << result.size << ","
+                  << result.samples.size() << "," << result.median() << "," << result.p99() << "," << result.mean()
+                  << "," << result.ops_per_second() << "," << result.allocs_per_second() << ","
+                  << result.search_steps_per_alloc << std::endl;
+    }
+}
+
+void print_json(const std::vector<Bench_Result> &results, const Bench_Options &options)
+{
+    std::cout << "{\"context\":{\"repetitions\":" << options.repetitions << ",\"warmup\":" << options.warmup
+              << ",\"batch\":" << options.batch << ",\"hardened\":" << (hardened ? "true" : "false")
+              << "},\"benchmarks\":[";
+    for (std::size_t i = 0; i < results.size(); i++)
+    {
+        const auto &result = results[i];
+        std::cout << (i == 0 ? "" : ",") << "{\"name\":\"" << result.name << "\",\"search_mode\":\"" << result.search
+                  << "\",\"mmap_mode\":\"" << result.mmap << "\",\"size\":" << result.size
+                  << ",\"median_ns\":" << result.median() << ",\"p99_ns\":" << result.p99()
+                  << ",\"mean_ns\":" << result.mean() << ",\"ops_per_sec\":" << result.ops_per_second()
+                  << ",\"allocs_per_sec\":" << result.allocs_per_second()
+                  << ",\"search_steps_per_alloc\":" << result.search_steps_per_alloc << "}";
+    }
+    std::cout << "]}" << std::endl;
+}
+
+/**
+ * Reads --name=value arguments, returns false on an unknown one.
+ */
+bool parse_options(int argc, char **argv, Bench_Options &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        auto equals = argument.find('=');
+        auto name = argument.substr(0, equals);
+        auto value = equals == std::string::npos ? std::string{} : argument.substr(equals + 1);
+
+        if (name == "--format" && (value == "text" || value == "csv" || value == "json"))
+            options.format = value;
+        else if (name == "--repetitions" && std::atol(value.c_str()) > 0)
+            options.repetitions = std::atol(value.c_str());
+        else if (name == "--warmup")
+            options.warmup = std::atol(value.c_str());
+        else if (name == "--batch" && std::atol(value.c_str()) > 0)
+            options.batch = std::atol(value.c_str());
+        else if (name == "--filter")
+            options.filter = value;
+        else
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    Bench_Options options;
+    if (!parse_options(argc, argv, options))
+    {
+        std::cerr << "usage: " << argv[0]
+                  << " [--format=text|csv|json] [--repetitions=N] [--warmup=N] [--batch=N] [--filter=TEXT]" << std::endl;
+        return 1;
+    }
+
+    // the malloc baseline runs on liballocator.so when it is preloaded, where a size that can not be served must fail
+    // instead of wrapping around to a small block
+    volatile std::size_t huge = SIZE_MAX - 100;
+    errno = 0;
+    if (std::malloc(huge) != nullptr || errno != ENOMEM)
+    {
+        std::cerr << "malloc of " << huge << " bytes did not fail with ENOMEM" << std::endl;
+        return 1;
+    }
+
+    std::array<Memory_Linked_List::mmap_mode, 2> modes = {Memory_Linked_List::mmap_mode::sbrk, Memory_Linked_List::mmap_mode::mmap};
+    std::array<Memory_Linked_List::search_mode, 6> search_modes = {Memory_Linked_List::search_mode::first_fit, Memory_Linked_List::search_mode::next_fit, Memory_Linked_List::search_mode::best_fit, Memory_Linked_List::search_mode::free_list, Memory_Linked_List::search_mode::segregated, Memory_Linked_List::search_mode::slab};
+    std::array<std::size_t, 3> sizes = {16, 256, 4096};
+
+    std::vector<Bench_Result> results;
+    auto wanted = [&](const std::string &name)
+    { return name.find(options.filter) != std::string::npos; };
+
+    for (auto size : sizes)
+    {
+        for (auto mode : modes)
+        {
+            for (auto search : search_modes)
+            {
+                auto name = std::string{search_mode_name(search)} + "/" + mmap_mode_name(mode) + "/" + std::to_string(size);
+                if (!wanted(name))
+                    continue;
+
+                // a new heap per case, so cases do not see each other's free Chunks
+                auto heap = new Memory_Linked_List{};
+                heap->m_mmap_mode = mode;
+                heap->set_search_mode(search);
+
+                auto samples = run_case(
+                    options, [heap](std::size_t bytes)
+                    { return static_cast<void *>(heap->alloc(bytes)); },
+                    [heap](void *pointer)
+                    { heap->free(static_cast<intptr_t *>(pointer)); },
+                    size);
+                results.push_back(Bench_Result{name, search_mode_name(search), mmap_mode_name(mode), size, samples,
+                                               heap->get_stats().search_steps_per_alloc()});
+                // the heap is leaked, it has no way to give its memory back
+            }
+        }
+
+        // with the heap profiler on, the allocations that are not sampled cost the same as above plus a countdown
+        for (auto search : {Memory_Linked_List::search_mode::segregated, Memory_Linked_List::search_mode::slab})
+        {
+            auto name = std::string{search_mode_name(search)} + "/mmap/" + std::to_string(size) + "/sampled";
+            if (!wanted(name))
+                continue;
+
+            auto heap = new Memory_Linked_List{};
+            heap->set_search_mode(search);
+            heap->set_sample_interval(Heap_Profile::default_interval);
+
+            auto samples = run_case(
+                options, [heap](std::size_t bytes)
+                { return static_cast<void *>(heap->alloc(bytes)); },
+                [heap](void *pointer)
+                { heap->free(static_cast<intptr_t *>(pointer)); },
+                size);
+            results.push_back(Bench_Result{name, search_mode_name(search), "mmap", size, samples,
+                                           heap->get_stats().search_steps_per_alloc()});
+        }
+
+        // baselines
+        auto name = "thread_cache/" + std::to_string(size);
+        if (wanted(name))
+        {
+            auto samples = run_case(options, Thread_Cache::allocate, [](void *pointer)
+                                    { Thread_Cache::deallocate(pointer); }, size);
+            results.push_back(Bench_Result{name, "thread_cache", "", size, samples, 0.0});
+        }
+
+        name = "malloc/" + std::to_string(size);
+        if (wanted(name))
+        {
+            auto samples = run_case(options, std::malloc, std::free, size);
+            results.push_back(Bench_Result{name, "malloc", "", size, samples, 0.0});
+        }
+    }
+
+    // sized frees, up to large blocks that get a mapping of their own
+    for (std::size_t size : {std::size_t{16}, std::size_t{4096}, std::size_t{3} << 20})
+    {
+        for (auto search : search_modes)
+        {
+            auto name = std::string{search_mode_name(search)} + "/mmap/" + std::to_string(size) + "/sized";
+            if (!wanted(name))
+                continue;
+
+            auto heap = new Memory_Linked_List{};
+            heap->set_search_mode(search);
+
+            auto samples = run_case(
+                options, [heap](std::size_t bytes)
+                { return static_cast<void *>(heap->alloc(bytes)); },
+                [heap, size](void *pointer)
+                { heap->free(static_cast<intptr_t *>(pointer), size); },
+                size);
+            results.push_back(Bench_Result{name, search_mode_name(search), "mmap", size, samples,
+                                           heap->get_stats().search_steps_per_alloc()});
+        }
+    }
+
+    if (options.format == "csv")
+        print_csv(results);
+    else if (options.format == "json")
+        print_json(results, options);
+    else
+        print_text(results);
+    return 0;
+}
@@ -0,0 +1,97 @@
+#include <sstream>
+#include "allocator_stats.h"
+
+double Allocator_Stats::reuse_ratio() const
+{
+    std::size_t reused{0};
+    for (auto hit : hits)
+    {
+        reused += hit;
+    }
+    return allocs == 0 ? 0.0 : static_cast<double>(reused) / allocs;
+}
+
+double Allocator_Stats::search_steps_per_alloc() const
+{
+    return allocs == 0 ? 0.0 : static_cast<double>(search_steps) / allocs;
+}
+
+Allocator_Stats &Allocator_Stats::operator+=(const Allocator_Stats &other)
+{
+    live_bytes += other.live_bytes;
+    live_blocks += other.live_blocks;
+    peak_bytes += other.peak_bytes;
+    peak_blocks += other.peak_blocks;
+    mapped_bytes += other.mapped_bytes;
+    purged_bytes += other.purged_bytes;
+    syscalls += other.syscalls;
+    allocs += other.allocs;
+    frees += other.frees;
+    reallocs += other.reallocs;
+    in_place_reallocs += other.in_place_reallocs;
+    search_steps += other.search_steps;
+    remote_frees += other.remote_frees;
+
+    for (std::size_t i = 0; i < class_count; i++)
+    {
+        hits[i] += other.hits[i];
+        misses[i] += other.misses[i];
+        cache_hits[i] += other.cache_hits[i];
+        cache_misses[i] += other.cache_misses[i];
+    }
+    return *this;
+}
+
+std::string Allocator_Stats::to_json() const
+{
+    std::ostringstream out;
+    out << "{\"live_bytes\":" << live_bytes << ",\"live_blocks\":" << live_blocks
+        << ",\"peak_bytes\":" << peak_bytes << ",\"peak_blocks\":" << peak_blocks
+        << ",\"mapped_bytes\":" << mapped_bytes << ",\"purged_bytes\":" << purged_bytes
+        << ",\"syscalls\":" << syscalls
+        << ",\"allocs\":" << allocs << ",\"frees\":" << frees << ",\"reallocs\":" << reallocs
+        << ",\"in_place_reallocs\":" << in_place_reallocs
+        << ",\"search_steps\":" << search_steps << ",\"reuse_ratio\":" << reuse_ratio()
+        << ",\"remote_frees\":" << remote_frees << ",\"classes\":[";
+
+    // only the size classes that have been used
+    bool first{true};
+    for (std::size_t i = 0; i < class_count; i++)
+    {
+        if (hits[i] + misses[i] + cache_hits[i] + cache_misses[i] == 0)
+            continue;
+
+        out << (first ? "" : ",") << "{\"size\":" << (std::size_t{1} << i) << ",\"hits\":" << hits[i]
+            << ",\"misses\":" << misses[i] << ",\"cache_hits\":" << cache_hits[i]
+            << ",\"cache_misses\":" << cache_misses[i] << "}";
+        first = false;
+    }
+    out << "]}";
+    return out.str();
+}
+
+std::string Allocator_Stats::to_text() const
+{
+    std::ostringstream out;
+    out << "live:          " << live_bytes << " bytes in " << live_blocks << " blocks" << std::endl;
+    out << "peak:          " << peak_bytes << " bytes in " << peak_blocks << " blocks" << std::endl;
+    out << "mapped:        " << mapped_bytes << " bytes in " << syscalls << " syscalls" << std::endl;
+    out << "purged:        " << purged_bytes << " bytes" << std::endl;
+    out << "allocs/frees:  " << allocs << " / " << frees << std::endl;
+    out << "reallocs:      " << reallocs << ", " << in_place_reallocs << " in place" << std::endl;
+    out << "search steps:  " << search_steps_per_alloc() << " per alloc" << std::endl;
+    out << "reuse ratio:   " << reuse_ratio() << std::endl;
+    out << "remote frees:  " << remote_frees << std::endl;
+
+    for (std::size_t i = 0; i < class_count; i++)
+    {
+        if (hits[i] + misses[i] + cache_hits[i] + cache_misses[i] == 0)
+            continue;
+
+        out << "class " << (std::size_t{1} << i) << ": " << hits[i] << " hits, " << misses[i] << " misses";
+        if (cache_hits[i] + cache_misses[i] != 0)
+            out << ", cache " << cache_hits[i] << " hits, " << cache_misses[i] << " misses";
+        out << std::endl;
+    }
+    return out.str();
+}
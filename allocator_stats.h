@@ -0,0 +1,119 @@
+#ifndef ALLOCATOR_STATS_H
+#define ALLOCATOR_STATS_H
+
+#include <bit>
+#include <cstddef>
+#include <string>
+
+/**
+ * A snapshot of the counters of an allocator.
+ *
+ * Every Memory_Linked_List keeps one up to date with plain increments, since a heap is only used by one thread at a
+ * time. Thread caches count their own hits and misses, and Central_Heap::get_stats() adds everything up for the whole
+ * process. Size classes are indexed by log2 of their size.
+ */
+class Allocator_Stats
+{
+public:
+    /**
+     * number of size classes, one per power of two that fits in a size_t.
+     */
+    static constexpr std::size_t class_count = sizeof(std::size_t) * 8;
+
+    /**
+     * Returns the class a size is counted in, log2 of the size rounded down. The finer classes of Size_Classes are
+     * counted together, 2^n up to 2^(n+1) bytes.
+     */
+    static std::size_t class_of(std::size_t size)
+    {
+        return std::bit_width(size) - 1;
+    }
+
+    /**
+     * bytes and Chunks currently allocated, headers not included.
+     */
+    std::size_t live_bytes = 0;
+    std::size_t live_blocks = 0;
+
+    /**
+     * highest live_bytes and live_blocks so far.
+     */
+    std::size_t peak_bytes = 0;
+    std::size_t peak_blocks = 0;
+
+    /**
+     * bytes obtained with mmap or sbrk, less the ones unmapped since.
+     */
+    std::size_t mapped_bytes = 0;
+
+    /**
+     * bytes of free pages given back to the OS with madvise, which stay mapped.
+     */
+    std::size_t purged_bytes = 0;
+
+    /**
+     * number of mmap and sbrk calls.
+     */
+    std::size_t syscalls = 0;
+
+    /**
+     * number of alloc and free calls.
+     */
+    std::size_t allocs = 0;
+    std::size_t frees = 0;
+
+    /**
+     * number of reallocate calls, and how many of them kept the data where it was (or moved it with mremap).
+     */
+    std::size_t reallocs = 0;
+    std::size_t in_place_reallocs = 0;
+
+    /**
+     * number of Chunks looked at by the search algorithms.
+     */
+    std::size_t search_steps = 0;
+
+    /**
+     * allocations served by reusing a free Chunk (hit) or by mapping a new one (miss), per size class.
+     */
+    std::size_t hits[class_count] = {};
+    std::size_t misses[class_count] = {};
+
+    /**
+     * allocations served by the free list of a thread cache (hit) or needing a refill (miss), per size class.
+     */
+    std::size_t cache_hits[class_count] = {};
+    std::size_t cache_misses[class_count] = {};
+
+    /**
+     * blocks freed by a thread that did not own them.
+     */
+    std::size_t remote_frees = 0;
+
+    /**
+     * Returns the share of allocations that reused a free Chunk.
+     */
+    double reuse_ratio() const;
+
+    /**
+     * Returns the average number of Chunks looked at per allocation.
+     */
+    double search_steps_per_alloc() const;
+
+    /**
+     * Adds the counters of another snapshot, the peaks are added as well, so they become an upper bound.
+     */
+    Allocator_Stats &operator+=(const Allocator_Stats &other);
+
+    /**
+     * Returns the snapshot as a single JSON object, leaving out the empty size classes.
+     */
+    std::string to_json() const;
+
+    /**
+     * Returns the snapshot as human readable text, one counter per line.
+     */
+    std::string to_text() const;
+};
+
+#endif //ALLOCATOR_STATS_H
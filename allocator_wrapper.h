@@ -3,12 +3,19 @@
 
 #include <cstddef>
 #include <memory>
+#include <new>
+#include <type_traits>
 #include "allocator.h" 
 
 /**
  * A custom memory allocator wrapper class for type T.
  * This class conforms to the C++ standard allocator requirements,
  * allowing it to be used with STL containers.
+ *
+ * The allocator only holds a pointer to a Memory_Linked_List: copies and rebinds use the same heap, and two allocators
+ * are equal if they use the same heap, so memory allocated by one can be freed by the other. A default constructed
+ * allocator creates a heap of its own, freed with its last copy. Several containers can share a heap, to reuse each
+ * other's freed memory, by binding them to it; a heap is not thread safe, so they must then be used by a single thread.
  */
 template <typename T>
 class allocator_wrapper
@@ -21,37 +28,73 @@ public:
     using size_type = std::size_t;              // Type used to specify sizes.
     using difference_type = std::ptrdiff_t;     // Type used to specify pointer differences.
 
-    // Default constructor and destructor.
-    allocator_wrapper() noexcept = default;
+    // Containers take the heap along when they are assigned or swapped, so they never free memory in the wrong heap.
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    using is_always_equal = std::false_type;
+
+    // Default constructor, with a heap of its own, and destructor.
+    allocator_wrapper() : mll{std::make_shared<Memory_Linked_List>()} {}
     ~allocator_wrapper() noexcept = default;
 
+    // Binds the allocator to a heap that outlives it, and every container using it.
+    allocator_wrapper(Memory_Linked_List& heap) noexcept : mll{std::shared_ptr<Memory_Linked_List>{}, &heap} {}
+
+    // Binds the allocator to a heap owned with its other users.
+    allocator_wrapper(std::shared_ptr<Memory_Linked_List> heap) noexcept : mll{std::move(heap)} {}
+
     // Copy constructor template to allow conversion between different allocator types.
+    // The copy shares the heap, which frees the memory of every copy when the last one goes.
     template <typename U>
-    allocator_wrapper(const allocator_wrapper<U>&) noexcept {}
+    allocator_wrapper(const allocator_wrapper<U>& other) noexcept : mll{other.mll} {}
 
     // Allocates memory for a specified number of objects of type T.
     // Uses the custom Memory_Linked_List allocator's alloc() function.
-    T* allocate(std::size_t size) noexcept
+    T* allocate(std::size_t size)
     {
         // Allocate raw memory using the Memory_Linked_List allocator.
-        intptr_t* ptr = mll.alloc(size * sizeof(T));
+        intptr_t* ptr = mll->alloc(size * sizeof(T));
+        if (ptr == nullptr)
+        {
+            throw std::bad_alloc{};
+        }
         return reinterpret_cast<T*>(ptr); // Cast to the appropriate pointer type.
     }
 
-    // Deallocates memory for a single object of type T.
-    // Uses the custom Memory_Linked_List allocator's free() function.
-    void deallocate(T* data, std::size_t) noexcept
+    // Deallocates memory for size objects of type T.
+    // Uses the custom Memory_Linked_List allocator's sized free() function.
+    void deallocate(T* data, std::size_t size) noexcept
     {
         // Cast back to intptr_t* before freeing the memory.
-        mll.free(reinterpret_cast<intptr_t*>(data));
+        mll->free(reinterpret_cast<intptr_t*>(data), size * sizeof(T));
+    }
+
+    // Allocates count single objects of type T in one pass, for node based containers filled in bursts.
+    // Returns how many were allocated, fewer than count only when out of memory.
+    std::size_t allocate_batch(T** data, std::size_t count)
+    {
+        return mll->alloc_batch(sizeof(T), count, reinterpret_cast<intptr_t**>(data));
+    }
+
+    // Deallocates count single objects of type T at once, whatever allocator of the same heap allocated them.
+    // The pointers are sorted in place.
+    void deallocate_batch(T** data, std::size_t count) noexcept
+    {
+        mll->free_batch(reinterpret_cast<intptr_t**>(data), count);
     }
 
+    // Returns the heap the memory comes from.
+    Memory_Linked_List& heap() const noexcept { return *mll; }
+
     // Equality operator (required for standard allocators).
-    // All instances of this allocator are considered equivalent.
-    bool operator==(const allocator_wrapper&) const noexcept { return true; }
+    // Two allocators are equal if they use the same heap.
+    template <typename U>
+    bool operator==(const allocator_wrapper<U>& other) const noexcept { return mll == other.mll; }
 
     // Inequality operator (required for standard allocators).
-    bool operator!=(const allocator_wrapper&) const noexcept { return false; }
+    template <typename U>
+    bool operator!=(const allocator_wrapper<U>& other) const noexcept { return mll != other.mll; }
 
     // Rebind struct to allow the allocator to allocate memory for a different type U.
     // This is required for standard allocator compatibility.
@@ -62,7 +105,13 @@ public:
     };
 
 private:
-    Memory_Linked_List mll{}; // The custom memory allocator instance used for allocation.
+    // Rebound allocators share the heap of the one they come from.
+    template <typename U>
+    friend class allocator_wrapper;
+
+    // The custom memory allocator instance used for allocation, shared by the copies of the allocator. Empty, only
+    // pointing to the heap, when bound to a heap it does not own.
+    std::shared_ptr<Memory_Linked_List> mll;
 };
 
 #endif //ALLOCATOR_WRAPPER_H
@@ -2,9 +2,52 @@
 #include <chrono>
 #include <vector>
 #include <array>
+#include <random>
+#include <fstream>
+#include <unistd.h>
+#include <thread>
+#include <barrier>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <set>
+#include <string>
+#include <algorithm>
+#include <memory_resource>
+#include <linux/perf_event.h>
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
 #include "Allocation.h"
+#include "memory_resources.h"
+#include "numa_arenas.h"
+#include "relative_pointer.h"
 #include "timer.cpp"
 
+const char *search_mode_name(Memory_Linked_List::search_mode search)
+{
+    switch (search)
+    {
+    case Memory_Linked_List::search_mode::first_fit:
+        return "first_fit";
+    case Memory_Linked_List::search_mode::next_fit:
+        return "next_fit";
+    case Memory_Linked_List::search_mode::best_fit:
+        return "best_fit";
+    case Memory_Linked_List::search_mode::free_list:
+        return "free_list";
+    case Memory_Linked_List::search_mode::segregated:
+        return "segregated";
+    case Memory_Linked_List::search_mode::slab:
+        return "slab";
+    }
+    return "unknown";
+}
+
 void benchmark_allocation(int number_of_allocations, std::size_t size, Memory_Linked_List::mmap_mode mode, Memory_Linked_List::search_mode search = Memory_Linked_List::search_mode::first_fit)
 {
     mll.m_mmap_mode = mode;           // Sets the memory allocation method for the custom allocator.
@@ -21,7 +64,7 @@ void benchmark_allocation(int number_of_allocations, std::size_t size, Memory_Li
 
         std::cout << "Allocation time for " << number_of_allocations << " blocks of size " << size
                   << " utilising " << (mode == Memory_Linked_List::mmap_mode::sbrk ? "sbrk" : "mmap")
-                  << " and " << (search == Memory_Linked_List::search_mode::first_fit ? "first_fit" : (search == Memory_Linked_List::search_mode::next_fit ? "next_fit" : (search == Memory_Linked_List::search_mode::best_fit ? "best_fit" : "free_list"))) << std::endl;
+                  << " and " << search_mode_name(search) << std::endl;
     }
 
     { // Deallocation Time
@@ -34,7 +77,7 @@ void benchmark_allocation(int number_of_allocations, std::size_t size, Memory_Li
         std::cout << std::endl;
         std::cout << "Deallocation time for " << number_of_allocations << " blocks of size " << size
                   << " utilising " << (mode == Memory_Linked_List::mmap_mode::sbrk ? "sbrk" : "mmap")
-                  << " and " << (search == Memory_Linked_List::search_mode::first_fit ? "first_fit" : (search == Memory_Linked_List::search_mode::next_fit ? "nex_fit" : (search == Memory_Linked_List::search_mode::best_fit ? "best_fit" : "free_list"))) << std::endl;
+                  << " and " << search_mode_name(search) << std::endl;
         std::cout << std::endl;
     }
 }
@@ -73,6 +116,1484 @@ void benchmark_std_allocator(int number_of_allocations, std::size_t size)
     }
 }
 
+/*
+ * Measures the cost of a free followed by an alloc of the same size while live_blocks blocks are alive. The linear
+ * search modes get slower as the list grows, the segregated mode should stay flat.
+ * Returns the average time of one free + alloc pair in nanoseconds.
+ */
+double benchmark_live_blocks(std::size_t live_blocks, Memory_Linked_List::search_mode search, Allocator_Stats &stats, std::size_t churn = 10000)
+{
+    Memory_Linked_List heap{};
+    heap.set_search_mode(search);
+
+    std::mt19937 random{42};
+    std::uniform_int_distribution<std::size_t> size_class{3, 8}; // 8 to 256 bytes
+    std::vector<intptr_t *> pointers(live_blocks);
+    std::vector<std::size_t> sizes(live_blocks);
+
+    // fills the heap with the live blocks
+    for (std::size_t i = 0; i < live_blocks; i++)
+    {
+        sizes[i] = std::size_t{1} << size_class(random);
+        pointers[i] = heap.alloc(sizes[i]);
+    }
+
+    std::uniform_int_distribution<std::size_t> victim{0, live_blocks - 1};
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // frees a random block and allocates it again, the number of live blocks stays the same
+    for (std::size_t i = 0; i < churn; i++)
+    {
+        auto index = victim(random);
+        heap.free(pointers[index]);
+        pointers[index] = heap.alloc(sizes[index]);
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+
+    stats = heap.get_stats();
+    return std::chrono::duration<double, std::nano>(end - start).count() / churn;
+}
+
+void runLiveBlockBenchmarks()
+{
+    std::array<Memory_Linked_List::search_mode, 6> search_modes = {Memory_Linked_List::search_mode::first_fit, Memory_Linked_List::search_mode::next_fit, Memory_Linked_List::search_mode::best_fit, Memory_Linked_List::search_mode::free_list, Memory_Linked_List::search_mode::segregated, Memory_Linked_List::search_mode::slab};
+    std::vector<std::size_t> live_block_counts = {100, 1000, 10000, 100000, 1000000};
+
+    std::cout << "Free + alloc cost (ns) against the number of live blocks:" << std::endl;
+    for (auto search : search_modes)
+    {
+        std::cout << search_mode_name(search) << ":" << std::endl;
+        for (std::size_t live_blocks : live_block_counts)
+        {
+            // filling the heap is quadratic for the linear search modes, so they stop early
+            if (search != Memory_Linked_List::search_mode::segregated && search != Memory_Linked_List::search_mode::slab &&
+                live_blocks > 10000)
+            {
+                std::cout << "    " << live_blocks << " live blocks: skipped (linear search)" << std::endl;
+                continue;
+            }
+            Allocator_Stats stats;
+            auto time = benchmark_live_blocks(live_blocks, search, stats);
+            std::cout << "    " << live_blocks << " live blocks: " << time << " ns, "
+                      << stats.search_steps_per_alloc() << " search steps per alloc" << std::endl;
+        }
+    }
+    std::cout << std::endl;
+}
+
+/*
+ * Returns the resident set size of the process in bytes, read from /proc/self/statm.
+ */
+std::size_t resident_bytes()
+{
+    std::ifstream statm{"/proc/self/statm"};
+    std::size_t pages{0}, resident{0};
+    statm >> pages >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+/*
+ * Mixed size churn: keeps live_blocks blocks of random sizes between 16 bytes and 4 KiB alive, and replaces a random
+ * one with a block of a new random size on every step. Without splitting and coalescing, freed blocks rarely fit the
+ * next request and the heap keeps growing. Reports the peak of the live bytes against the peak growth of the RSS.
+ */
+void benchmark_fragmentation(Memory_Linked_List::search_mode search, std::size_t live_blocks = 2000, std::size_t steps = 50000)
+{
+    Memory_Linked_List heap{};
+    heap.set_search_mode(search);
+
+    std::mt19937 random{7};
+    std::uniform_int_distribution<std::size_t> size_class{4, 12}; // 16 bytes to 4 KiB
+    std::uniform_int_distribution<std::size_t> victim{0, live_blocks - 1};
+    std::vector<intptr_t *> pointers(live_blocks, nullptr);
+    std::vector<std::size_t> sizes(live_blocks, 0);
+
+    auto random_size = [&]()
+    {
+        // somewhere between two powers of two, so that the request is not already aligned
+        auto high = std::size_t{1} << size_class(random);
+        return std::uniform_int_distribution<std::size_t>{high / 2 + 1, high}(random);
+    };
+
+    auto rss_start = resident_bytes();
+    std::size_t live_bytes{0}, peak_live_bytes{0}, peak_rss{0};
+
+    for (std::size_t i = 0; i < live_blocks + steps; i++)
+    {
+        // the first live_blocks steps fill the heap, the rest replace a random block
+        auto index = i < live_blocks ? i : victim(random);
+        if (pointers[index] != nullptr)
+        {
+            heap.free(pointers[index]);
+            live_bytes -= sizes[index];
+        }
+
+        sizes[index] = random_size();
+        pointers[index] = heap.alloc(sizes[index]);
+        live_bytes += sizes[index];
+
+        peak_live_bytes = std::max(peak_live_bytes, live_bytes);
+        if (i % 1000 == 0)
+        {
+            peak_rss = std::max(peak_rss, resident_bytes() - rss_start);
+        }
+    }
+    peak_rss = std::max(peak_rss, resident_bytes() - rss_start);
+
+    auto stats = heap.get_stats();
+    std::cout << "    " << search_mode_name(search) << ": peak live " << peak_live_bytes / 1024 << " KiB, peak RSS growth "
+              << peak_rss / 1024 << " KiB (" << static_cast<double>(peak_rss) / peak_live_bytes << "x), reuse ratio "
+              << stats.reuse_ratio() << ", peak in chunks " << stats.peak_bytes / 1024 << " KiB" << std::endl;
+
+    for (auto pointer : pointers)
+    {
+        heap.free(pointer);
+    }
+}
+
+void runFragmentationBenchmarks()
+{
+    std::array<Memory_Linked_List::search_mode, 6> search_modes = {Memory_Linked_List::search_mode::first_fit, Memory_Linked_List::search_mode::next_fit, Memory_Linked_List::search_mode::best_fit, Memory_Linked_List::search_mode::free_list, Memory_Linked_List::search_mode::segregated, Memory_Linked_List::search_mode::slab};
+
+    std::cout << "Peak RSS against live bytes under mixed size churn:" << std::endl;
+    for (auto search : search_modes)
+    {
+        benchmark_fragmentation(search);
+    }
+    std::cout << std::endl;
+}
+
+/*
+ * Internal fragmentation, the bytes lost to rounding: allocates every size of a distribution, with a linked list and
+ * with the thread caches, and compares the bytes asked for with the bytes of the blocks handed out. The loss of the
+ * power of two rounding used before the size classes is given for comparison.
+ */
+void benchmark_internal_fragmentation(const std::string &distribution, const std::vector<std::size_t> &sizes)
+{
+    Memory_Linked_List heap{};
+    heap.set_search_mode(Memory_Linked_List::search_mode::segregated);
+
+    std::size_t requested{0}, power_of_two{0}, cached{0};
+    std::vector<intptr_t *> blocks;
+    std::vector<void *> cache_blocks;
+    for (auto size : sizes)
+    {
+        requested += size;
+        power_of_two += std::bit_ceil(std::max<std::size_t>(size, 8));
+        blocks.push_back(heap.alloc(size));
+        cache_blocks.push_back(Thread_Cache::allocate(size));
+        cached += Thread_Cache::usable_size(cache_blocks.back());
+    }
+    auto in_chunks = heap.get_stats().live_bytes;
+
+    auto lost = [&](std::size_t bytes)
+    { return 100.0 * static_cast<double>(bytes - requested) / static_cast<double>(bytes); };
+    std::cout << "    " << distribution << ": " << requested / 1024 << " KiB asked, lost " << lost(in_chunks)
+              << "% in the linked list, " << lost(cached) << "% in the thread caches, " << lost(power_of_two)
+              << "% with powers of two" << std::endl;
+
+    for (auto block : blocks)
+    {
+        heap.free(block);
+    }
+    for (auto block : cache_blocks)
+    {
+        Thread_Cache::deallocate(block);
+    }
+}
+
+void runInternalFragmentationBenchmarks()
+{
+    std::mt19937 random{11};
+    std::vector<std::size_t> small, mixed, powers, power_law;
+    std::uniform_int_distribution<std::size_t> small_size{8, 512};
+    std::uniform_int_distribution<std::size_t> mixed_size{16, 4096};
+    std::uniform_int_distribution<std::size_t> power{3, 14};
+    for (std::size_t i = 0; i < 20000; i++)
+    {
+        small.push_back(small_size(random));
+        mixed.push_back(mixed_size(random));
+        powers.push_back((std::size_t{1} << power(random)) + 1);
+    }
+    for (const auto &event : generate_power_law(20000, 11))
+    {
+        if (event.type == Trace_Event::kind::alloc)
+            power_law.push_back(event.size);
+    }
+
+    std::cout << "Internal fragmentation, bytes lost to rounding:" << std::endl;
+    benchmark_internal_fragmentation("uniform 8 B to 512 B", small);
+    benchmark_internal_fragmentation("uniform 16 B to 4 KiB", mixed);
+    benchmark_internal_fragmentation("one byte over a power of two", powers);
+    benchmark_internal_fragmentation("power law", power_law);
+    std::cout << std::endl;
+}
+
+/*
+ * Allocates number_of_allocations small blocks, either carving them from regions or giving each block its own
+ * mapping (region_size of 0), and reports the number of syscalls and the time per allocation.
+ */
+void benchmark_regions(Memory_Linked_List::mmap_mode mode, std::size_t region_size, std::size_t number_of_allocations = 10000)
+{
+    Memory_Linked_List heap{};
+    heap.m_mmap_mode = mode;
+    heap.m_region_size = region_size;
+    heap.set_search_mode(Memory_Linked_List::search_mode::segregated);
+
+    std::vector<intptr_t *> pointers(number_of_allocations);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (auto &pointer : pointers)
+    {
+        pointer = heap.alloc(8);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    std::cout << "    " << (mode == Memory_Linked_List::mmap_mode::sbrk ? "sbrk" : "mmap") << ", "
+              << (region_size == 0 ? std::string{"one mapping per chunk"} : std::to_string(region_size >> 20) + " MiB regions")
+              << ": " << heap.get_syscall_count() << " syscalls, " << heap.get_stats().mapped_bytes / 1024 << " KiB mapped, "
+              << std::chrono::duration<double, std::nano>(end - start).count() / number_of_allocations << " ns per allocation" << std::endl;
+
+    for (auto pointer : pointers)
+    {
+        heap.free(pointer);
+    }
+}
+
+void runRegionBenchmarks()
+{
+    std::array<Memory_Linked_List::mmap_mode, 2> modes = {Memory_Linked_List::mmap_mode::sbrk, Memory_Linked_List::mmap_mode::mmap};
+
+    std::cout << "Syscalls and time for 10000 allocations of 8 bytes:" << std::endl;
+    for (auto mode : modes)
+    {
+        benchmark_regions(mode, 0);
+        benchmark_regions(mode, std::size_t{64} << 20);
+    }
+    std::cout << std::endl;
+}
+
+/*
+ * Every thread allocates a round of blocks of random sizes between 8 and 512 bytes, frees half of them itself and
+ * hands the other half to the next thread, which frees them. With the thread caches those are remote frees.
+ * Returns the number of allocations and frees per second, all threads together.
+ */
+double benchmark_threads(std::size_t threads, void *(*allocate)(std::size_t), void (*deallocate)(void *), std::size_t rounds = 2000)
+{
+    constexpr std::size_t blocks_per_round = 64;
+
+    // the blocks handed from every thread to the next one
+    std::vector<std::array<void *, blocks_per_round / 2>> handoff(threads);
+    std::barrier sync{static_cast<std::ptrdiff_t>(threads)};
+
+    auto worker = [&](std::size_t id)
+    {
+        std::mt19937 random{static_cast<unsigned>(id)};
+        std::uniform_int_distribution<std::size_t> size{8, 512};
+        std::array<void *, blocks_per_round> blocks{};
+
+        for (std::size_t round = 0; round < rounds; round++)
+        {
+            for (auto &block : blocks)
+            {
+                block = allocate(size(random));
+            }
+            for (std::size_t i = 0; i < blocks_per_round / 2; i++)
+            {
+                deallocate(blocks[i]);
+                handoff[id][i] = blocks[blocks_per_round / 2 + i];
+            }
+
+            // frees what the previous thread handed over
+            sync.arrive_and_wait();
+            for (auto block : handoff[(id + threads - 1) % threads])
+            {
+                deallocate(block);
+            }
+            sync.arrive_and_wait();
+        }
+    };
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<std::thread> workers;
+    for (std::size_t id = 0; id < threads; id++)
+    {
+        workers.emplace_back(worker, id);
+    }
+    for (auto &thread : workers)
+    {
+        thread.join();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    // one allocation and one free per block
+    auto operations = static_cast<double>(threads * rounds * blocks_per_round * 2);
+    return operations / std::chrono::duration<double>(end - start).count();
+}
+
+void runThreadBenchmarks()
+{
+    auto cores = std::max(1u, std::thread::hardware_concurrency());
+
+    std::cout << "Multithreaded throughput (million operations per second):" << std::endl;
+    for (std::size_t threads = 1; threads <= cores; threads = threads * 2 > cores && threads != cores ? cores : threads * 2)
+    {
+        std::cout << "    " << threads << " threads: thread caches "
+                  << benchmark_threads(threads, Thread_Cache::allocate, Thread_Cache::deallocate) / 1e6
+                  << ", malloc " << benchmark_threads(threads, std::malloc, std::free) / 1e6 << std::endl;
+    }
+
+    std::cout << "Process statistics:" << std::endl;
+    std::cout << Central_Heap::instance().get_stats().to_text() << std::endl;
+}
+
+/*
+ * Pushes number_of_nodes nodes in a list and inserts as many random keys in a set, then erases all of them.
+ * Returns the time in milliseconds.
+ */
+template <template <typename> typename Allocator>
+double benchmark_nodes(std::size_t number_of_nodes)
+{
+    std::list<int, Allocator<int>> nodes;
+    std::set<int, std::less<int>, Allocator<int>> keys;
+    std::mt19937 random{3};
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (std::size_t i = 0; i < number_of_nodes; i++)
+    {
+        nodes.push_back(static_cast<int>(i));
+        keys.insert(static_cast<int>(random()));
+    }
+    while (!nodes.empty())
+    {
+        nodes.pop_front();
+    }
+    while (!keys.empty())
+    {
+        keys.erase(keys.begin());
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+template <typename T>
+using default_pool_allocator = pool_allocator<T>;
+
+void runPoolBenchmarks()
+{
+    std::vector<std::size_t> node_counts = {10000, 1000000};
+
+    std::cout << "Inserting and erasing list and set nodes (ms):" << std::endl;
+    for (std::size_t number_of_nodes : node_counts)
+    {
+        std::cout << "    " << number_of_nodes << " nodes: pool_allocator " << benchmark_nodes<default_pool_allocator>(number_of_nodes)
+                  << ", std::allocator " << benchmark_nodes<std::allocator>(number_of_nodes) << ", allocator_wrapper ";
+
+        // allocator_wrapper uses first_fit, which scans every live node on each insert
+        if (number_of_nodes > 10000)
+            std::cout << "skipped (linear search)" << std::endl;
+        else
+            std::cout << benchmark_nodes<allocator_wrapper>(number_of_nodes) << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+/*
+ * Simulates a request: a map of headers, a list of parsed items and a vector of output, all dropped at the end.
+ */
+template <typename Map, typename List, typename Vector>
+std::size_t simulate_request(Map &headers, List &items, Vector &output, std::mt19937 &random)
+{
+    for (int i = 0; i < 20; i++)
+    {
+        headers[static_cast<int>(random() % 1000)] = static_cast<long>(i);
+    }
+    for (int i = 0; i < 100; i++)
+    {
+        items.push_back(static_cast<double>(random()));
+    }
+    for (auto item : items)
+    {
+        output.push_back(static_cast<long>(item) % 251);
+    }
+    return headers.size() + items.size() + output.size();
+}
+
+/*
+ * Runs number_of_requests requests, either with the global operator new, with a Memory_Linked_List through
+ * allocator_wrapper, or with a Monotonic_Arena reset after every request. Returns the time per request in microseconds.
+ */
+double benchmark_requests(const std::string &allocator, std::size_t number_of_requests = 10000)
+{
+    std::mt19937 random{11};
+    std::size_t checksum{0};
+    Monotonic_Arena arena{};
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (std::size_t i = 0; i < number_of_requests; i++)
+    {
+        if (allocator == "arena")
+        {
+            {
+                arena_map<int, long> headers{arena};
+                arena_list<double> items{arena};
+                arena_vector<long> output{arena};
+                checksum += simulate_request(headers, items, output, random);
+            }
+            // everything the request allocated is freed at once
+            arena.reset();
+        }
+        else if (allocator == "allocator_wrapper")
+        {
+            map<int, long> headers;
+            list<double> items;
+            vector<long> output;
+            checksum += simulate_request(headers, items, output, random);
+        }
+        else
+        {
+            std::map<int, long> headers;
+            std::list<double> items;
+            std::vector<long> output;
+            checksum += simulate_request(headers, items, output, random);
+        }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    // keeps the work from being optimised away
+    if (checksum == 0)
+        std::cout << checksum;
+
+    return std::chrono::duration<double, std::micro>(end - start).count() / number_of_requests;
+}
+
+void runRequestBenchmarks()
+{
+    std::cout << "Request simulation (us per request):" << std::endl;
+    for (std::string allocator : {"operator new", "allocator_wrapper", "arena"})
+    {
+        std::cout << "    " << allocator << ": " << benchmark_requests(allocator) << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+/*
+ * Keeps maps and lists of about live_nodes nodes each, and number_of_operations times erases a random node of a random
+ * container and inserts another one. Returns the time in milliseconds.
+ */
+template <typename Map, typename List>
+double benchmark_churn(std::vector<Map> &maps, std::vector<List> &lists, std::size_t number_of_operations = 200000,
+                       std::size_t live_nodes = 2000)
+{
+    std::mt19937 random{17};
+    for (std::size_t i = 0; i < maps.size(); i++)
+    {
+        for (std::size_t j = 0; j < live_nodes; j++)
+        {
+            maps[i][static_cast<int>(random())] = static_cast<long>(j);
+            lists[i].push_back(static_cast<long>(j));
+        }
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (std::size_t i = 0; i < number_of_operations; i++)
+    {
+        auto &map = maps[random() % maps.size()];
+        auto &list = lists[random() % lists.size()];
+
+        // the first key after a random one, so the map keeps its size
+        auto node = map.lower_bound(static_cast<int>(random()));
+        map.erase(node == map.end() ? map.begin() : node);
+        map[static_cast<int>(random())] = static_cast<long>(i);
+
+        list.pop_front();
+        list.push_back(static_cast<long>(i));
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void runChurnBenchmarks()
+{
+    const std::size_t number_of_containers = 8;
+
+    std::cout << "Map and list churn, " << number_of_containers << " maps and lists (ms):" << std::endl;
+    {
+        std::vector<std::map<int, long>> maps(number_of_containers);
+        std::vector<std::list<long>> lists(number_of_containers);
+        std::cout << "    std::allocator: " << benchmark_churn(maps, lists) << std::endl;
+    }
+    {
+        // every default constructed allocator_wrapper creates a heap of its own
+        std::vector<map<int, long>> maps(number_of_containers);
+        std::vector<list<long>> lists(number_of_containers);
+        std::cout << "    allocator_wrapper, a heap per container: " << benchmark_churn(maps, lists) << std::endl;
+    }
+    {
+        // one segregated heap for every container, first_fit would scan all their live nodes on each insert
+        Memory_Linked_List heap{};
+        heap.m_search_mode = Memory_Linked_List::search_mode::segregated;
+
+        std::vector<map<int, long>> maps;
+        std::vector<list<long>> lists;
+        for (std::size_t i = 0; i < number_of_containers; i++)
+        {
+            maps.emplace_back(allocator_wrapper<std::pair<const int, long>>{heap});
+            lists.emplace_back(allocator_wrapper<long>{heap});
+        }
+        std::cout << "    allocator_wrapper, one segregated heap: " << benchmark_churn(maps, lists) << " (mapped "
+                  << heap.get_stats().mapped_bytes / 1024 << " KiB)" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+/*
+ * Runs number_of_requests requests with std::pmr containers on a memory resource, calling reset() after each of them
+ * for the resources that only free everything at once. Returns the time per request in microseconds.
+ */
+template <typename Reset>
+double benchmark_pmr_requests(std::pmr::memory_resource &resource, Reset reset, std::size_t number_of_requests = 10000)
+{
+    std::mt19937 random{11};
+    std::size_t checksum{0};
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (std::size_t i = 0; i < number_of_requests; i++)
+    {
+        {
+            std::pmr::map<int, long> headers{&resource};
+            std::pmr::list<double> items{&resource};
+            std::pmr::vector<long> output{&resource};
+            checksum += simulate_request(headers, items, output, random);
+        }
+        reset();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    // keeps the work from being optimised away
+    if (checksum == 0)
+        std::cout << checksum;
+
+    return std::chrono::duration<double, std::micro>(end - start).count() / number_of_requests;
+}
+
+/*
+ * Runs benchmark_churn() with std::pmr maps and lists on a memory resource. Returns the time in milliseconds.
+ */
+double benchmark_pmr_churn(std::pmr::memory_resource &resource, std::size_t number_of_containers = 8)
+{
+    std::vector<std::pmr::map<int, long>> maps;
+    std::vector<std::pmr::list<long>> lists;
+    for (std::size_t i = 0; i < number_of_containers; i++)
+    {
+        maps.emplace_back(&resource);
+        lists.emplace_back(&resource);
+    }
+    return benchmark_churn(maps, lists);
+}
+
+void runPmrBenchmarks()
+{
+    auto nothing = [] {};
+
+    std::cout << "std::pmr request simulation (us per request) and map and list churn (ms):" << std::endl;
+    for (auto search : {Memory_Linked_List::search_mode::first_fit, Memory_Linked_List::search_mode::next_fit,
+                        Memory_Linked_List::search_mode::best_fit, Memory_Linked_List::search_mode::free_list,
+                        Memory_Linked_List::search_mode::segregated})
+    {
+        Heap_Resource heap{search};
+        std::cout << "    Heap_Resource " << search_mode_name(search) << ": " << benchmark_pmr_requests(heap, nothing);
+
+        // the other modes search through every free chunk, which takes minutes with the live nodes of the churn
+        if (search == Memory_Linked_List::search_mode::segregated)
+        {
+            Heap_Resource churn{search};
+            std::cout << ", churn " << benchmark_pmr_churn(churn);
+        }
+        std::cout << std::endl;
+    }
+    {
+        Pool_Resource pool{};
+        Pool_Resource churn{};
+        std::cout << "    Pool_Resource: " << benchmark_pmr_requests(pool, nothing) << ", churn "
+                  << benchmark_pmr_churn(churn) << std::endl;
+    }
+    {
+        std::pmr::unsynchronized_pool_resource pool{};
+        std::pmr::unsynchronized_pool_resource churn{};
+        std::cout << "    std::pmr::unsynchronized_pool_resource: " << benchmark_pmr_requests(pool, nothing)
+                  << ", churn " << benchmark_pmr_churn(churn) << std::endl;
+    }
+    {
+        Arena_Resource arena{};
+        std::cout << "    Arena_Resource: " << benchmark_pmr_requests(arena, [&] { arena.arena().reset(); }) << std::endl;
+    }
+    {
+        std::pmr::monotonic_buffer_resource monotonic{};
+        std::cout << "    std::pmr::monotonic_buffer_resource: "
+                  << benchmark_pmr_requests(monotonic, [&] { monotonic.release(); }) << std::endl;
+    }
+    std::cout << "    std::pmr::new_delete_resource: " << benchmark_pmr_requests(*std::pmr::new_delete_resource(), nothing)
+              << ", churn " << benchmark_pmr_churn(*std::pmr::new_delete_resource()) << std::endl;
+    std::cout << std::endl;
+}
+
+/*
+ * Allocates number_of_blocks blocks and frees all of them, in allocation order, with or without their size.
+ * Returns the time of the frees in milliseconds.
+ */
+double benchmark_deallocation(Memory_Linked_List::search_mode search, bool sized, std::size_t number_of_blocks = 1000000)
+{
+    Memory_Linked_List heap{};
+    heap.set_search_mode(search);
+
+    std::vector<intptr_t *> pointers(number_of_blocks);
+    for (auto &pointer : pointers)
+    {
+        pointer = heap.alloc(32);
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (auto pointer : pointers)
+    {
+        if (sized)
+            heap.free(pointer, 32);
+        else
+            heap.free(pointer);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void runDeallocationBenchmarks()
+{
+    std::array<Memory_Linked_List::search_mode, 2> search_modes = {Memory_Linked_List::search_mode::free_list, Memory_Linked_List::search_mode::segregated};
+
+    std::cout << "Freeing 1000000 blocks (ms):" << std::endl;
+    for (auto search : search_modes)
+    {
+        std::cout << "    " << search_mode_name(search) << ": free(data) " << benchmark_deallocation(search, false)
+                  << ", free(data, size) " << benchmark_deallocation(search, true) << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+/*
+ * Grows number_of_buffers buffers side by side, appending append_size bytes to each of them in turn, like vectors
+ * filled with push_back (doubling, the capacity doubles when full) or strings built with appends (the buffer grows
+ * to the exact new length). A buffer grows either like std::vector does today, with alloc + copy + free, or with
+ * reallocate. Returns the time in milliseconds.
+ */
+double benchmark_growth(Memory_Linked_List::search_mode search, bool doubling, bool in_place, Allocator_Stats &stats,
+                        std::size_t number_of_buffers = 8, std::size_t appends = 5000, std::size_t append_size = 24)
+{
+    Memory_Linked_List heap{};
+    heap.set_search_mode(search);
+
+    std::vector<intptr_t *> buffers(number_of_buffers, nullptr);
+    std::vector<std::size_t> lengths(number_of_buffers, 0);
+    std::vector<std::size_t> capacities(number_of_buffers, 0);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (std::size_t i = 0; i < appends; i++)
+    {
+        for (std::size_t b = 0; b < number_of_buffers; b++)
+        {
+            auto length = lengths[b] + append_size;
+            if (length > capacities[b])
+            {
+                auto capacity = doubling ? std::max(length, 2 * capacities[b]) : length;
+                if (in_place)
+                {
+                    buffers[b] = heap.reallocate(buffers[b], capacity);
+                }
+                else
+                {
+                    auto grown = heap.alloc(capacity);
+                    if (buffers[b] != nullptr)
+                    {
+                        std::memcpy(grown, buffers[b], lengths[b]);
+                        heap.free(buffers[b]);
+                    }
+                    buffers[b] = grown;
+                }
+                capacities[b] = capacity;
+            }
+            std::memset(reinterpret_cast<char *>(buffers[b]) + lengths[b], 'x', append_size);
+            lengths[b] = length;
+        }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    stats = heap.get_stats();
+    for (auto buffer : buffers)
+    {
+        heap.free(buffer);
+    }
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void runGrowthBenchmarks()
+{
+    std::array<Memory_Linked_List::search_mode, 3> search_modes = {Memory_Linked_List::search_mode::first_fit, Memory_Linked_List::search_mode::free_list, Memory_Linked_List::search_mode::segregated};
+
+    std::cout << "Growing 8 buffers side by side, alloc + copy + free against reallocate (ms):" << std::endl;
+    for (auto doubling : {true, false})
+    {
+        std::cout << "    " << (doubling ? "push_back (doubling)" : "string append (exact)") << ":" << std::endl;
+        for (auto search : search_modes)
+        {
+            Allocator_Stats copy_stats, stats;
+            auto copy_time = benchmark_growth(search, doubling, false, copy_stats);
+            auto time = benchmark_growth(search, doubling, true, stats);
+            std::cout << "        " << search_mode_name(search) << ": copy " << copy_time << ", reallocate " << time
+                      << " (" << stats.in_place_reallocs << " of " << stats.reallocs << " in place)" << std::endl;
+        }
+    }
+    std::cout << std::endl;
+}
+
+/*
+ * Benchmarks threads each incrementing their own counter, the counters allocated one after the other from one heap.
+ * Small blocks share cache lines, so every increment invalidates the line in the caches of the other threads; in the
+ * cache line aligned mode every counter has a line of its own.
+ */
+double benchmark_false_sharing(std::size_t threads, bool cache_line_aligned, std::size_t increments = 10000000)
+{
+    Memory_Linked_List heap{};
+    heap.m_cache_line_aligned = cache_line_aligned;
+
+    std::vector<volatile std::uint64_t *> counters;
+    for (std::size_t t = 0; t < threads; t++)
+    {
+        counters.push_back(reinterpret_cast<volatile std::uint64_t *>(heap.alloc(sizeof(std::uint64_t))));
+        *counters.back() = 0;
+    }
+
+    std::vector<std::thread> workers;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (std::size_t t = 0; t < threads; t++)
+    {
+        workers.emplace_back([counter = counters[t], increments]
+                             {
+                                 for (std::size_t i = 0; i < increments; i++)
+                                 {
+                                     *counter = *counter + 1;
+                                 } });
+    }
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    for (auto counter : counters)
+    {
+        heap.free(const_cast<intptr_t *>(reinterpret_cast<volatile intptr_t *>(counter)));
+    }
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void runFalseSharingBenchmarks()
+{
+    std::cout << "Threads incrementing their own counter, packed against cache line aligned blocks (ms):" << std::endl;
+    for (std::size_t threads : {2, 4})
+    {
+        auto packed = benchmark_false_sharing(threads, false);
+        auto aligned = benchmark_false_sharing(threads, true);
+        std::cout << "    " << threads << " threads: packed " << packed << ", aligned " << aligned << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+/*
+ * Counts the hardware cache misses of the calling thread, of the last level cache by default, or of another cache
+ * such as the data TLB. The kernel may not allow it (perf_event_paranoid), and virtual machines often have no counters
+ * at all, in which case nothing is counted.
+ */
+class Cache_Miss_Counter
+{
+public:
+    Cache_Miss_Counter(std::uint32_t type = PERF_TYPE_HARDWARE, std::uint64_t config = PERF_COUNT_HW_CACHE_MISSES)
+    {
+        perf_event_attr attributes{};
+        attributes.size = sizeof(attributes);
+        attributes.type = type;
+        attributes.config = config;
+        attributes.disabled = 1;
+        attributes.exclude_kernel = 1;
+        m_file = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+    }
+
+    ~Cache_Miss_Counter()
+    {
+        if (m_file >= 0)
+            close(m_file);
+    }
+
+    bool available() const
+    {
+        return m_file >= 0;
+    }
+
+    void start()
+    {
+        ioctl(m_file, PERF_EVENT_IOC_RESET, 0);
+        ioctl(m_file, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    std::uint64_t stop()
+    {
+        std::uint64_t misses{0};
+        ioctl(m_file, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(m_file, &misses, sizeof(misses)) != sizeof(misses))
+            return 0;
+        return misses;
+    }
+
+private:
+    int m_file;
+};
+
+/*
+ * Allocates number_of_objects objects of the same size and returns the bytes each one takes beyond its size: the
+ * median distance between objects allocated one after the other, which are carved next to each other. The cache misses
+ * per allocation are written to misses, or -1 if they can not be counted.
+ */
+template <typename Allocate, typename Deallocate>
+double benchmark_overhead(std::size_t size, Allocate allocate, Deallocate deallocate, double &misses,
+                          std::size_t number_of_objects = 10000)
+{
+    std::vector<char *> objects(number_of_objects);
+    Cache_Miss_Counter counter{};
+
+    if (counter.available())
+        counter.start();
+    for (auto &object : objects)
+    {
+        object = static_cast<char *>(allocate(size));
+    }
+    misses = counter.available() ? static_cast<double>(counter.stop()) / number_of_objects : -1.0;
+
+    // free lists hand blocks out in either direction
+    std::vector<std::size_t> distances;
+    for (std::size_t i = 1; i < number_of_objects; i++)
+    {
+        distances.push_back(std::max(objects[i], objects[i - 1]) - std::min(objects[i], objects[i - 1]));
+    }
+    std::nth_element(distances.begin(), distances.begin() + distances.size() / 2, distances.end());
+    auto distance = distances[distances.size() / 2];
+
+    for (auto object : objects)
+    {
+        deallocate(object);
+    }
+    return static_cast<double>(distance) - static_cast<double>(size);
+}
+
+void runOverheadBenchmarks()
+{
+    std::cout << "Bytes of metadata per live object (and cache misses per allocation):" << std::endl;
+    for (std::size_t size : {8, 16, 32, 64, 256})
+    {
+        Memory_Linked_List heap{};
+        heap.set_search_mode(Memory_Linked_List::search_mode::segregated);
+        double heap_misses, cache_misses;
+        auto heap_overhead = benchmark_overhead(
+            size, [&](std::size_t bytes)
+            { return static_cast<void *>(heap.alloc(bytes)); },
+            [&](char *object)
+            { heap.free(reinterpret_cast<intptr_t *>(object)); },
+            heap_misses);
+        auto cache_overhead = benchmark_overhead(size, Thread_Cache::allocate, [](char *object)
+                                                 { Thread_Cache::deallocate(object); },
+                                                 cache_misses);
+
+        std::cout << "    " << size << " bytes: linked list " << heap_overhead << ", thread caches " << cache_overhead;
+        if (heap_misses >= 0)
+            std::cout << " (" << heap_misses << " and " << cache_misses << " misses)";
+        std::cout << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+/*
+ * Keeps live_objects objects of 8 to 256 bytes alive and number_of_operations times frees a random one and allocates
+ * another of a random size, writing its first word. Returns the time per operation in nanoseconds, and writes the cache
+ * misses per operation to misses, or -1 if they can not be counted.
+ */
+double benchmark_small_churn(Memory_Linked_List::search_mode search, double &misses, std::size_t live_objects = 4000,
+                             std::size_t number_of_operations = 200000)
+{
+    Memory_Linked_List heap{};
+    heap.set_search_mode(search);
+    std::mt19937 random{23};
+    std::uniform_int_distribution<std::size_t> sizes{8, 256};
+
+    std::vector<intptr_t *> objects(live_objects);
+    for (auto &object : objects)
+    {
+        object = heap.alloc(sizes(random));
+        object[0] = 1;
+    }
+
+    Cache_Miss_Counter counter{};
+    if (counter.available())
+        counter.start();
+    auto start = std::chrono::high_resolution_clock::now();
+    for (std::size_t i = 0; i < number_of_operations; i++)
+    {
+        auto &object = objects[random() % live_objects];
+        heap.free(object);
+        object = heap.alloc(sizes(random));
+        object[0] = static_cast<intptr_t>(i);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    misses = counter.available() ? static_cast<double>(counter.stop()) / number_of_operations : -1.0;
+
+    for (auto object : objects)
+    {
+        heap.free(object);
+    }
+    return std::chrono::duration<double, std::nano>(end - start).count() / number_of_operations;
+}
+
+void runSmallChurnBenchmarks()
+{
+    std::cout << "Small object churn, 8 to 256 bytes (ns per free and alloc, and cache misses):" << std::endl;
+    for (auto search : {Memory_Linked_List::search_mode::first_fit, Memory_Linked_List::search_mode::free_list,
+                        Memory_Linked_List::search_mode::segregated, Memory_Linked_List::search_mode::slab})
+    {
+        double misses;
+        std::cout << "    " << search_mode_name(search) << ": " << benchmark_small_churn(search, misses);
+        if (misses >= 0)
+            std::cout << " (" << misses << " misses)";
+        std::cout << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+/*
+ * Allocates bursts of burst_size objects of the same size and frees them all, number_of_bursts times, with
+ * alloc_batch() and free_batch() or with alloc() and free() one object at a time. Returns the time per object
+ * allocated and freed in nanoseconds.
+ */
+double benchmark_batch(Memory_Linked_List::search_mode search, std::size_t size, bool batched,
+                       std::size_t burst_size = 256, std::size_t number_of_bursts = 2000)
+{
+    Memory_Linked_List heap{};
+    heap.set_search_mode(search);
+    std::vector<intptr_t *> objects(burst_size);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (std::size_t i = 0; i < number_of_bursts; i++)
+    {
+        if (batched)
+        {
+            heap.alloc_batch(size, burst_size, objects.data());
+        }
+        else
+        {
+            for (auto &object : objects)
+            {
+                object = heap.alloc(size);
+            }
+        }
+        for (auto object : objects)
+        {
+            object[0] = static_cast<intptr_t>(i);
+        }
+
+        // frees in a shuffled order, like objects of a container that were not freed in the order they came
+        std::reverse(objects.begin() + burst_size / 2, objects.end());
+        if (batched)
+        {
+            heap.free_batch(objects.data(), burst_size);
+        }
+        else
+        {
+            for (auto object : objects)
+            {
+                heap.free(object, size);
+            }
+        }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / (number_of_bursts * burst_size);
+}
+
+void runBatchBenchmarks()
+{
+    std::cout << "Bursts of 256 objects, allocated and freed one by one or in a batch (ns per object):" << std::endl;
+    for (auto search : {Memory_Linked_List::search_mode::free_list, Memory_Linked_List::search_mode::segregated,
+                        Memory_Linked_List::search_mode::slab})
+    {
+        for (std::size_t size : {16, 64, 1000})
+        {
+            std::cout << "    " << search_mode_name(search) << ", " << size << " bytes: "
+                      << benchmark_batch(search, size, false) << " single, " << benchmark_batch(search, size, true)
+                      << " batch" << std::endl;
+        }
+    }
+    std::cout << std::endl;
+}
+
+/*
+ * Allocates number_of_allocations blocks of 16 bytes to 64 KiB in a segregated heap whose profiler samples every
+ * interval bytes (0 for off), then frees every other one. Returns the time per alloc and free in nanoseconds, and
+ * writes the bytes left live, the bytes the profile estimates of them and its number of samples.
+ */
+double benchmark_profile(std::size_t interval, std::size_t &live_bytes, std::size_t &estimated_bytes,
+                         std::size_t &samples, std::size_t number_of_allocations = 200000)
+{
+    Memory_Linked_List heap{};
+    heap.set_search_mode(Memory_Linked_List::search_mode::segregated);
+    heap.set_sample_interval(interval);
+
+    // spread evenly over the powers of two, drawn before the clock starts
+    std::mt19937 generator{7};
+    std::uniform_int_distribution<int> log_size{4, 16};
+    std::vector<std::size_t> sizes(number_of_allocations);
+    for (auto &size : sizes)
+    {
+        size = std::size_t{1} << log_size(generator);
+    }
+    std::vector<intptr_t *> objects(number_of_allocations);
+
+    live_bytes = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (std::size_t i = 0; i < number_of_allocations; i++)
+    {
+        objects[i] = heap.alloc(sizes[i]);
+    }
+    for (std::size_t i = 0; i < number_of_allocations; i += 2)
+    {
+        heap.free(objects[i]);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    for (std::size_t i = 1; i < number_of_allocations; i += 2)
+    {
+        live_bytes += sizes[i];
+    }
+    estimated_bytes = heap.get_profile().estimated_bytes();
+    samples = heap.get_profile().sample_count();
+    return std::chrono::duration<double, std::nano>(end - start).count() / (number_of_allocations * 3 / 2);
+}
+
+void runProfileBenchmarks()
+{
+    std::cout << "Heap profiler, blocks of 16 bytes to 64 KiB, half of them freed (ns per alloc and free):" << std::endl;
+    for (std::size_t interval : {std::size_t{0}, Heap_Profile::default_interval, std::size_t{64} << 10})
+    {
+        std::size_t live_bytes, estimated_bytes, samples;
+        auto time = benchmark_profile(interval, live_bytes, estimated_bytes, samples);
+        if (interval == 0)
+        {
+            std::cout << "    off: " << time << std::endl;
+            continue;
+        }
+        std::cout << "    every " << (interval >> 10) << " KiB: " << time << ", " << samples << " live samples for "
+                  << (estimated_bytes >> 20) << " MiB of the " << (live_bytes >> 20) << " MiB live" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+/*
+ * Returns the page faults taken by the process so far, the ones that read from disk included.
+ */
+std::size_t page_faults()
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt + usage.ru_majflt;
+}
+
+/*
+ * Returns the bytes of the process backed by transparent huge pages, read from /proc/self/smaps_rollup.
+ */
+std::size_t huge_page_bytes()
+{
+    std::ifstream smaps{"/proc/self/smaps_rollup"};
+    std::string field;
+    std::size_t kib{0};
+    while (smaps >> field)
+    {
+        if (field == "AnonHugePages:")
+        {
+            smaps >> kib;
+            break;
+        }
+    }
+    return kib * 1024;
+}
+
+/*
+ * Allocates a buffer of buffer_bytes from a heap with the mapping policies given, writes every page of it once, then
+ * does random 8 byte increments all over it. Reports the page faults of the allocation and of the first touch, the
+ * time per random access, which mostly depends on TLB misses in a buffer this big, and the dTLB misses when they can
+ * be counted.
+ */
+void benchmark_mapping(const char *name, bool huge_pages, bool populate, bool no_reserve,
+                       std::size_t buffer_bytes = std::size_t{256} << 20, std::size_t accesses = 4000000)
+{
+    Memory_Linked_List heap{};
+    heap.m_huge_pages = huge_pages;
+    heap.m_populate = populate;
+    heap.m_no_reserve = no_reserve;
+
+    auto huge_start = huge_page_bytes();
+    auto faults_start = page_faults();
+    auto buffer = reinterpret_cast<std::uint64_t *>(heap.alloc(buffer_bytes));
+    auto faults_alloc = page_faults() - faults_start;
+
+    // one write per page
+    faults_start = page_faults();
+    auto start = std::chrono::high_resolution_clock::now();
+    auto words = buffer_bytes / sizeof(std::uint64_t);
+    for (std::size_t i = 0; i < words; i += 512)
+    {
+        buffer[i] = i;
+    }
+    auto touch_time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    auto faults_touch = page_faults() - faults_start;
+    auto huge = huge_page_bytes() - std::min(huge_start, huge_page_bytes());
+
+    // a linear congruential generator, cheaper than the accesses it drives
+    Cache_Miss_Counter tlb_misses{PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)};
+    if (tlb_misses.available())
+        tlb_misses.start();
+    std::uint64_t state{1};
+    start = std::chrono::high_resolution_clock::now();
+    for (std::size_t i = 0; i < accesses; i++)
+    {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        buffer[(state >> 16) % words]++;
+    }
+    auto access_time = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count();
+    auto misses = tlb_misses.available() ? static_cast<double>(tlb_misses.stop()) / accesses : -1.0;
+
+    std::cout << "    " << name << ": " << faults_alloc << " faults in alloc, " << faults_touch << " in first touch ("
+              << touch_time << " ms), random access " << access_time / accesses << " ns, " << huge / (1024 * 1024)
+              << " MiB in huge pages";
+    if (misses >= 0)
+        std::cout << ", " << misses << " dTLB misses per access";
+    std::cout << std::endl;
+
+    heap.free(reinterpret_cast<intptr_t *>(buffer));
+}
+
+void runMappingBenchmarks()
+{
+    std::cout << "Mapping policies, 256 MiB buffer touched once then accessed at random:" << std::endl;
+    benchmark_mapping("default", false, false, false);
+    benchmark_mapping("MAP_NORESERVE", false, false, true);
+    benchmark_mapping("MAP_POPULATE", false, true, false);
+    benchmark_mapping("huge pages", true, false, false);
+    benchmark_mapping("huge pages, pre-faulted", true, true, false);
+    std::cout << std::endl;
+}
+
+/*
+ * RSS trajectory through a spike then a quiet period: allocates spike_bytes in blocks of 1 to 64 KiB, frees all but
+ * every 16th, then keeps doing a little work (small blocks allocated and freed) for idle_steps steps of 20 ms. The RSS
+ * growth is sampled after the spike, after the frees, along the quiet period, after trim() and once the heap is
+ * destroyed. Returns the samples in KiB.
+ */
+std::vector<std::size_t> benchmark_purge(std::chrono::milliseconds decay_time, bool lazy, std::size_t spike_bytes = std::size_t{64} << 20,
+                                         std::size_t idle_steps = 10)
+{
+    std::vector<std::size_t> samples;
+    auto rss_start = resident_bytes();
+    auto sample = [&]()
+    {
+        auto rss = resident_bytes();
+        samples.push_back(rss > rss_start ? (rss - rss_start) / 1024 : 0);
+    };
+
+    {
+        Memory_Linked_List heap{};
+        heap.set_search_mode(Memory_Linked_List::search_mode::segregated);
+        heap.m_decay_time = decay_time;
+        heap.m_lazy_purge = lazy;
+
+        std::mt19937 random{5};
+        std::uniform_int_distribution<std::size_t> block_size{1024, 65536};
+        std::vector<intptr_t *> blocks;
+        for (std::size_t total = 0; total < spike_bytes;)
+        {
+            auto size = block_size(random);
+            auto block = heap.alloc(size);
+            std::memset(block, 1, size);
+            blocks.push_back(block);
+            total += size;
+        }
+        sample();
+
+        // a few survivors are scattered over the whole spike
+        for (std::size_t i = 0; i < blocks.size(); i++)
+        {
+            if (i % 16 != 0)
+            {
+                heap.free(blocks[i]);
+            }
+        }
+        sample();
+
+        for (std::size_t step = 0; step < idle_steps; step++)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds{20});
+            for (std::size_t i = 0; i < 300; i++)
+            {
+                heap.free(heap.alloc(64));
+            }
+            sample();
+        }
+
+        heap.trim();
+        sample();
+
+        for (std::size_t i = 0; i < blocks.size(); i += 16)
+        {
+            heap.free(blocks[i]);
+        }
+    }
+    sample();
+    return samples;
+}
+
+void runPurgeBenchmarks()
+{
+    std::cout << "RSS growth through a 64 MiB spike then 200 ms of light work (KiB): after the spike, after the frees, "
+                 "every 40 ms, after trim(), after the heap is destroyed:"
+              << std::endl;
+    struct Policy
+    {
+        const char *name;
+        std::chrono::milliseconds decay_time;
+        bool lazy;
+    };
+    for (auto policy : {Policy{"never purged", std::chrono::milliseconds::max(), false},
+                        Policy{"decay 50 ms, MADV_DONTNEED", std::chrono::milliseconds{50}, false},
+                        Policy{"decay 50 ms, MADV_FREE", std::chrono::milliseconds{50}, true}})
+    {
+        auto samples = benchmark_purge(policy.decay_time, policy.lazy);
+        std::cout << "    " << policy.name << ":";
+        for (std::size_t i = 0; i < samples.size(); i++)
+        {
+            // every other sample of the quiet period
+            if (i < 2 || i >= samples.size() - 2 || i % 2 == 1)
+                std::cout << " " << samples[i];
+        }
+        std::cout << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+/*
+ * Bandwidth of a thread running on cpu_node over memory of memory_node: the thread is pinned to the CPUs of its node,
+ * takes a buffer from alloc_on_node(), writes it once so its pages are placed, then reads it passes times. Returns
+ * the read bandwidth in GB/s, and writes the node the first page of the buffer ended up on to placed_on.
+ */
+double benchmark_numa_bandwidth(Numa_Arenas &arenas, std::size_t cpu_node, std::size_t memory_node, int &placed_on,
+                                std::size_t bytes = std::size_t{64} << 20, std::size_t passes = 4)
+{
+    double bandwidth{0};
+    std::thread worker{[&]
+                       {
+                           cpu_set_t cpus;
+                           CPU_ZERO(&cpus);
+                           for (auto cpu : arenas.topology().cpus_of(cpu_node))
+                               CPU_SET(cpu, &cpus);
+                           if (CPU_COUNT(&cpus) != 0)
+                               pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+
+                           auto buffer = static_cast<std::uint64_t *>(arenas.alloc_on_node(bytes, memory_node));
+                           auto words = bytes / sizeof(std::uint64_t);
+                           std::memset(buffer, 1, bytes);
+
+                           placed_on = -1;
+                           syscall(SYS_get_mempolicy, &placed_on, nullptr, 0, buffer, MPOL_F_NODE | MPOL_F_ADDR);
+
+                           std::uint64_t sum{0};
+                           auto start = std::chrono::high_resolution_clock::now();
+                           for (std::size_t pass = 0; pass < passes; pass++)
+                           {
+                               for (std::size_t i = 0; i < words; i++)
+                                   sum += buffer[i];
+                           }
+                           auto end = std::chrono::high_resolution_clock::now();
+
+                           // the sum is used, so the reads are not optimised away
+                           bandwidth = sum == 0 ? 0 : bytes * passes / std::chrono::duration<double, std::nano>(end - start).count();
+                           arenas.free(buffer);
+                       }};
+    worker.join();
+    return bandwidth;
+}
+
+void runNumaBenchmarks()
+{
+    // the code paths of several nodes run on a fake topology when the machine has a single node
+    auto topology = Numa_Topology::detect();
+    auto fake = topology.node_count() == 1;
+    Numa_Arenas arenas{fake ? Numa_Topology::fake(2) : topology};
+
+    std::cout << "NUMA arenas, read bandwidth from every node over the memory of every node (GB/s)"
+              << (fake ? ", single node machine so on 2 fake nodes whose memory is on node 0:" : ":") << std::endl;
+    for (std::size_t cpu_node = 0; cpu_node < arenas.topology().node_count(); cpu_node++)
+    {
+        std::cout << "    CPUs of node " << cpu_node << ":";
+        for (std::size_t memory_node = 0; memory_node < arenas.topology().node_count(); memory_node++)
+        {
+            int placed_on{-1};
+            auto bandwidth = benchmark_numa_bandwidth(arenas, cpu_node, memory_node, placed_on);
+            std::cout << " node " << memory_node << " " << bandwidth << " (placed on " << placed_on << ")";
+        }
+        std::cout << std::endl;
+    }
+
+    auto block = arenas.alloc(64);
+    std::cout << "    alloc() from node " << arenas.current_node() << " takes from arena " << Numa_Arenas::node_of(block)
+              << std::endl;
+    arenas.free(block);
+    std::cout << std::endl;
+}
+
+/*
+ * A node of the list the persistent heap benchmark builds, linked with a Relative_Pointer so it stays right when the
+ * file is mapped somewhere else. The rest of its 256 bytes is its payload.
+ */
+struct Persistent_Node
+{
+    Relative_Pointer<Persistent_Node> next;
+    std::uint64_t value;
+    std::uint64_t payload[30];
+};
+
+/*
+ * The root object of the persistent heap benchmark.
+ */
+struct Persistent_Root
+{
+    Relative_Pointer<Persistent_Node> first;
+    std::uint64_t count;
+};
+
+/*
+ * Fills heap with bytes of nodes in a list, the root object first. Returns the time it took in ms.
+ */
+double benchmark_persistent_build(Memory_Linked_List &heap, std::size_t bytes)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    auto root = reinterpret_cast<Persistent_Root *>(heap.alloc(sizeof(Persistent_Root)));
+    root->first = nullptr;
+    root->count = 0;
+    for (std::size_t i = 0; i < bytes / sizeof(Persistent_Node); i++)
+    {
+        auto node = reinterpret_cast<Persistent_Node *>(heap.alloc(sizeof(Persistent_Node)));
+        node->value = i;
+        std::fill(std::begin(node->payload), std::end(node->payload), i);
+        node->next = root->first.get();
+        root->first = node;
+        root->count++;
+    }
+    heap.set_root(root);
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+/*
+ * Opens the heap file at path, at base or where it was made, and walks the list from its root object. Returns the
+ * time open_file() took in ms, writes the time of the walk to walk_time, and to intact whether every node was found as
+ * it was written.
+ */
+double benchmark_persistent_open(const char *path, void *base, bool &recovered, double &walk_time, bool &intact)
+{
+    Memory_Linked_List heap{};
+    auto start = std::chrono::high_resolution_clock::now();
+    auto opened = heap.open_file(path, 0, base);
+    auto end = std::chrono::high_resolution_clock::now();
+    recovered = heap.was_recovered();
+
+    // the nodes were pushed at the front, the values count down
+    intact = opened && heap.get_root() != nullptr;
+    std::size_t nodes{0};
+    auto root = static_cast<Persistent_Root *>(heap.get_root());
+    for (auto node = intact ? root->first.get() : nullptr; node != nullptr; node = node->next.get())
+    {
+        nodes++;
+        intact &= node->value == root->count - nodes && node->payload[29] == node->value;
+    }
+    intact &= root != nullptr && nodes == root->count;
+    walk_time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - end).count();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void runPersistentBenchmarks()
+{
+    const char *path = "/tmp/allocator_persistent.heap";
+    constexpr std::size_t bytes = std::size_t{1} << 30;
+    unlink(path);
+
+    std::cout << "Persistent heap, a list of 256 byte nodes filling 1 GiB, segregated (ms):" << std::endl;
+    {
+        Memory_Linked_List heap{};
+        heap.set_search_mode(Memory_Linked_List::search_mode::segregated);
+        std::cout << "    rebuilt in an anonymous heap: " << benchmark_persistent_build(heap, bytes) << std::endl;
+    }
+    auto heap = std::make_unique<Memory_Linked_List>();
+    heap->set_search_mode(Memory_Linked_List::search_mode::segregated);
+    if (!heap->open_file(path, 2 * bytes))
+    {
+        std::cout << "    " << path << " can not be opened" << std::endl << std::endl;
+        return;
+    }
+    std::cout << "    built in a file heap: " << benchmark_persistent_build(*heap, bytes) << std::endl;
+
+    // the destructor writes the file back to the disk
+    auto start = std::chrono::high_resolution_clock::now();
+    heap.reset();
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "    closed, written to the disk: " << std::chrono::duration<double, std::milli>(end - start).count()
+              << std::endl;
+
+    bool recovered, intact;
+    double walk_time;
+    auto time = benchmark_persistent_open(path, nullptr, recovered, walk_time, intact);
+    std::cout << "    reopened after a close: " << time << (recovered ? " recovered" : "") << ", walked in " << walk_time
+              << (intact ? "" : ", NOT INTACT") << std::endl;
+
+    // a process that stops without closing the heap, after some more allocations
+    auto child = fork();
+    if (child == 0)
+    {
+        Memory_Linked_List heap{};
+        heap.open_file(path, 0);
+        for (std::size_t i = 0; i < 1000; i++)
+        {
+            heap.alloc(64);
+        }
+        _exit(0);
+    }
+    waitpid(child, nullptr, 0);
+    time = benchmark_persistent_open(path, nullptr, recovered, walk_time, intact);
+    std::cout << "    reopened after a crash: " << time << (recovered ? " recovered" : "") << ", walked in " << walk_time
+              << (intact ? "" : ", NOT INTACT") << std::endl;
+
+    time = benchmark_persistent_open(path, reinterpret_cast<void *>(Memory_Linked_List::file_base + (std::size_t{1} << 40)),
+                                     recovered, walk_time, intact);
+    std::cout << "    reopened at another address: " << time << (recovered ? " recovered" : "") << ", walked in "
+              << walk_time << (intact ? "" : ", NOT INTACT") << std::endl;
+    std::cout << std::endl;
+    unlink(path);
+}
+
 void runBenchmarks()
 {
 
@@ -82,7 +1603,7 @@ void runBenchmarks()
      * A vector holding the differnent allocation sizes.
      */
     std::array<Memory_Linked_List::mmap_mode, 2> modes = {Memory_Linked_List::mmap_mode::sbrk, Memory_Linked_List::mmap_mode::mmap};
-    std::array<Memory_Linked_List::search_mode, 4> search_modes = {Memory_Linked_List::search_mode::first_fit, Memory_Linked_List::search_mode::next_fit, Memory_Linked_List::search_mode::best_fit, Memory_Linked_List::search_mode::free_list};
+    std::array<Memory_Linked_List::search_mode, 6> search_modes = {Memory_Linked_List::search_mode::first_fit, Memory_Linked_List::search_mode::next_fit, Memory_Linked_List::search_mode::best_fit, Memory_Linked_List::search_mode::free_list, Memory_Linked_List::search_mode::segregated, Memory_Linked_List::search_mode::slab};
     std::vector<std::size_t> allocationSizes = {1, 10, 100, 1000};
 
     /*
@@ -100,7 +1621,7 @@ void runBenchmarks()
             {
 
                 std::cout << "Benchmarking with" << (mode == Memory_Linked_List::mmap_mode::sbrk ? " sbrk" : " mmap")
-                          << " and " << (search == Memory_Linked_List::search_mode::first_fit ? "first_fit" : (search == Memory_Linked_List::search_mode::next_fit ? "next_fit" : (search == Memory_Linked_List::search_mode::best_fit ? "best_fit" : "free_list")))
+                          << " and " << search_mode_name(search)
                           << ":" << std::endl;
 
                 benchmark_allocation(100, size, mode, search);
@@ -118,4 +1639,25 @@ void runBenchmarks()
             std::cout << std::endl;
         }
     };
+
+    runLiveBlockBenchmarks();
+    runFragmentationBenchmarks();
+    runInternalFragmentationBenchmarks();
+    runRegionBenchmarks();
+    runThreadBenchmarks();
+    runPoolBenchmarks();
+    runRequestBenchmarks();
+    runChurnBenchmarks();
+    runPmrBenchmarks();
+    runDeallocationBenchmarks();
+    runGrowthBenchmarks();
+    runFalseSharingBenchmarks();
+    runOverheadBenchmarks();
+    runSmallChurnBenchmarks();
+    runBatchBenchmarks();
+    runProfileBenchmarks();
+    runPurgeBenchmarks();
+    runMappingBenchmarks();
+    runNumaBenchmarks();
+    runPersistentBenchmarks();
 }
\ No newline at end of file
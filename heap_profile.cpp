@@ -0,0 +1,335 @@
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <ostream>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <unwind.h>
+#include "heap_profile.h"
+
+/**
+ * Where _Unwind_Backtrace() writes the frames of a call stack.
+ */
+class Unwind_State
+{
+public:
+    void **frames;
+    std::size_t depth;
+
+    /**
+     * frames left to skip, the ones of the profiler and the heap.
+     */
+    std::size_t skip;
+};
+
+/**
+ * Called by _Unwind_Backtrace() for every frame, from the innermost one.
+ */
+static _Unwind_Reason_Code collect_frame(_Unwind_Context *context, void *argument)
+{
+    auto state = static_cast<Unwind_State *>(argument);
+    if (state->skip > 0)
+    {
+        state->skip--;
+        return _URC_NO_REASON;
+    }
+
+    auto address = _Unwind_GetIP(context);
+    if (address == 0 || state->depth == Heap_Sample::max_depth)
+    {
+        return _URC_END_OF_STACK;
+    }
+    state->frames[state->depth++] = reinterpret_cast<void *>(address);
+    return _URC_NO_REASON;
+}
+
+Heap_Profile::Heap_Profile() : m_samples{nullptr},
+                               m_capacity{0},
+                               m_count{0},
+                               m_interval{default_interval},
+                               m_enabled{false}
+{
+    // different for every heap and every run, never 0 or xorshift would only draw 0
+    auto now = static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+    m_random = ((reinterpret_cast<std::uint64_t>(this) ^ now) * 0x9e3779b97f4a7c15) | 1;
+}
+
+Heap_Profile::~Heap_Profile()
+{
+    if (m_samples != nullptr)
+    {
+        munmap(m_samples, m_capacity * sizeof(Heap_Sample));
+    }
+}
+
+std::size_t Heap_Profile::interval() const
+{
+    return m_enabled ? m_interval : 0;
+}
+
+void Heap_Profile::set_interval(std::size_t bytes)
+{
+    m_enabled = bytes != 0;
+    if (m_enabled)
+    {
+        m_interval = bytes;
+    }
+}
+
+std::ptrdiff_t Heap_Profile::next_countdown()
+{
+    if (!m_enabled)
+    {
+        return PTRDIFF_MAX;
+    }
+
+    // xorshift64*, then a uniform number in (0, 1] from its 53 high bits
+    m_random ^= m_random >> 12;
+    m_random ^= m_random << 25;
+    m_random ^= m_random >> 27;
+    auto uniform = static_cast<double>(((m_random * 0x2545f4914f6cdd1d) >> 11) + 1) / 9007199254740992.0;
+
+    // the gap until the next sampled byte is geometric, the continuous exponential is close enough
+    auto countdown = -std::log(uniform) * static_cast<double>(m_interval);
+    return static_cast<std::ptrdiff_t>(std::clamp(countdown, 1.0, static_cast<double>(PTRDIFF_MAX / 2)));
+}
+
+bool Heap_Profile::record(intptr_t *data, std::size_t size)
+{
+    // kept at most half full, so searches stay short
+    if ((m_count + 1) * 2 > m_capacity && !grow())
+    {
+        return false;
+    }
+
+    auto &sample = m_samples[slot_of(data)];
+    sample.data = data;
+    sample.size = size;
+
+    // skips this function and the function of the heap that sampled the allocation
+    Unwind_State state{sample.frames, 0, 2};
+    _Unwind_Backtrace(collect_frame, &state);
+    sample.depth = state.depth;
+    m_count++;
+    return true;
+}
+
+void Heap_Profile::erase(intptr_t *data)
+{
+    if (m_count == 0)
+    {
+        return;
+    }
+    auto hole = slot_of(data);
+    if (m_samples[hole].data != data)
+    {
+        return;
+    }
+
+    // the samples after it that would not be found past the hole anymore are moved into it (backward shift)
+    auto mask = m_capacity - 1;
+    for (auto next = (hole + 1) & mask; m_samples[next].data != nullptr; next = (next + 1) & mask)
+    {
+        auto home = home_of(m_samples[next].data);
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            m_samples[hole] = m_samples[next];
+            hole = next;
+        }
+    }
+    m_samples[hole].data = nullptr;
+    m_count--;
+}
+
+void Heap_Profile::move(intptr_t *data, intptr_t *moved, std::size_t size)
+{
+    if (m_count == 0)
+    {
+        return;
+    }
+    auto slot = slot_of(data);
+    if (m_samples[slot].data != data)
+    {
+        return;
+    }
+
+    // the size alone changes when the memory stays
+    if (moved == data)
+    {
+        m_samples[slot].size = size;
+        return;
+    }
+    auto sample = m_samples[slot];
+    erase(data);
+    sample.data = moved;
+    sample.size = size;
+    m_samples[slot_of(moved)] = sample;
+    m_count++;
+}
+
+std::size_t Heap_Profile::sample_count() const
+{
+    return m_count;
+}
+
+std::size_t Heap_Profile::estimated_bytes() const
+{
+    double bytes{0};
+    for (std::size_t i = 0; i < m_capacity; i++)
+    {
+        if (m_samples[i].data != nullptr)
+        {
+            bytes += weight(m_samples[i].size);
+        }
+    }
+    return static_cast<std::size_t>(std::llround(bytes));
+}
+
+void Heap_Profile::write(std::ostream &out, format as) const
+{
+    // lines are formatted on the stack, so dumping the profile never allocates
+    char line[256];
+
+    if (as == format::pprof)
+    {
+        std::size_t bytes{0};
+        for (std::size_t i = 0; i < m_capacity; i++)
+        {
+            if (m_samples[i].data != nullptr)
+            {
+                bytes += m_samples[i].size;
+            }
+        }
+
+        // live and allocated are the same, only live samples are kept. pprof scales the samples back with the rate
+        std::snprintf(line, sizeof(line), "heap profile: %6zu: %8zu [%6zu: %8zu] @ heap_v2/%zu\n", m_count, bytes,
+                      m_count, bytes, m_interval);
+        out << line;
+        for (std::size_t i = 0; i < m_capacity; i++)
+        {
+            const auto &sample = m_samples[i];
+            if (sample.data == nullptr)
+            {
+                continue;
+            }
+            std::snprintf(line, sizeof(line), "%6d: %8zu [%6d: %8zu] @", 1, sample.size, 1, sample.size);
+            out << line;
+            for (std::size_t frame = 0; frame < sample.depth; frame++)
+            {
+                std::snprintf(line, sizeof(line), " %p", sample.frames[frame]);
+                out << line;
+            }
+            out << '\n';
+        }
+
+        // pprof finds the binaries the addresses are in with the mappings of the process
+        out << "\nMAPPED_LIBRARIES:\n";
+        auto maps = ::open("/proc/self/maps", O_RDONLY);
+        if (maps >= 0)
+        {
+            ssize_t read_bytes;
+            while ((read_bytes = ::read(maps, line, sizeof(line))) > 0)
+            {
+                out.write(line, read_bytes);
+            }
+            ::close(maps);
+        }
+        out.flush();
+        return;
+    }
+
+    for (std::size_t i = 0; i < m_capacity; i++)
+    {
+        const auto &sample = m_samples[i];
+        if (sample.data == nullptr)
+        {
+            continue;
+        }
+
+        // from the outermost frame, named after the call instruction right before the return address
+        for (auto frame = sample.depth; frame-- > 0;)
+        {
+            auto call = static_cast<char *>(sample.frames[frame]) - 1;
+            Dl_info info{};
+            if (dladdr(call, &info) != 0 && info.dli_sname != nullptr)
+            {
+                out << info.dli_sname;
+            }
+            else if (info.dli_fname != nullptr && info.dli_fbase != nullptr)
+            {
+                auto name = std::strrchr(info.dli_fname, '/');
+                std::snprintf(line, sizeof(line), "[%s+0x%zx]", name != nullptr ? name + 1 : info.dli_fname,
+                              static_cast<std::size_t>(call - static_cast<char *>(info.dli_fbase)));
+                out << line;
+            }
+            else
+            {
+                std::snprintf(line, sizeof(line), "[%p]", static_cast<void *>(call));
+                out << line;
+            }
+            out << (frame == 0 ? ' ' : ';');
+        }
+        out << std::llround(weight(sample.size)) << '\n';
+    }
+    out.flush();
+}
+
+double Heap_Profile::weight(std::size_t size) const
+{
+    // an allocation of size bytes holds a sampled byte with odds 1 - exp(-size / interval)
+    auto odds = -std::expm1(-static_cast<double>(size) / static_cast<double>(m_interval));
+    return odds > 0 ? static_cast<double>(size) / odds : 0.0;
+}
+
+std::size_t Heap_Profile::home_of(const intptr_t *data) const
+{
+    // Fibonacci hashing, the high bits of the product are the best mixed
+    auto hash = (reinterpret_cast<std::uintptr_t>(data) >> 3) * 0x9e3779b97f4a7c15;
+    return static_cast<std::size_t>(hash >> (64 - std::countr_zero(m_capacity)));
+}
+
+std::size_t Heap_Profile::slot_of(const intptr_t *data) const
+{
+    auto mask = m_capacity - 1;
+    auto slot = home_of(data);
+    while (m_samples[slot].data != nullptr && m_samples[slot].data != data)
+    {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+bool Heap_Profile::grow()
+{
+    auto capacity = m_capacity == 0 ? initial_capacity : m_capacity * 2;
+    auto samples = mmap(nullptr, capacity * sizeof(Heap_Sample), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                        -1, 0);
+    if (samples == MAP_FAILED)
+    {
+        return false;
+    }
+
+    // the new mapping is zeroed, every slot empty
+    auto old_samples = m_samples;
+    auto old_capacity = m_capacity;
+    m_samples = static_cast<Heap_Sample *>(samples);
+    m_capacity = capacity;
+    for (std::size_t i = 0; i < old_capacity; i++)
+    {
+        if (old_samples[i].data != nullptr)
+        {
+            m_samples[slot_of(old_samples[i].data)] = old_samples[i];
+        }
+    }
+    if (old_samples != nullptr)
+    {
+        munmap(old_samples, old_capacity * sizeof(Heap_Sample));
+    }
+    return true;
+}
@@ -0,0 +1,216 @@
+#ifndef HEAP_PROFILE_H
+#define HEAP_PROFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+
+/**
+ * A live allocation picked by the heap profiler, with the call stack it was allocated from.
+ */
+class Heap_Sample
+{
+public:
+    /**
+     * deepest call stack kept, the frames further from the allocation are dropped.
+     */
+    static constexpr std::size_t max_depth = 32;
+
+    /**
+     * the memory, nullptr for an empty slot of the table.
+     */
+    intptr_t *data;
+
+    /**
+     * the size given to alloc.
+     */
+    std::size_t size;
+
+    /**
+     * number of frames.
+     */
+    std::size_t depth;
+
+    /**
+     * return addresses, the innermost first.
+     */
+    void *frames[max_depth];
+};
+
+/**
+ * The sampling heap profiler of a Memory_Linked_List.
+ *
+ * About one allocated byte in interval() is picked: the number of bytes between two samples is drawn from a
+ * geometric distribution, so allocations are picked in proportion to their size without following any pattern of the
+ * program. The heap only counts the bytes it allocates down to the next sample, the profiler is called for the sampled
+ * allocations alone. Their call stacks are walked with the unwinder of the C++ runtime (_Unwind_Backtrace), which
+ * needs no frame pointers and never allocates, and they are kept in a hash table until they are freed.
+ *
+ * The table is mapped on its own, outside of the heap and its counters, so the profiler never allocates from the heap
+ * it watches. write() dumps the live samples in the legacy heap profile format of pprof, or as folded stacks for
+ * flame graphs.
+ */
+class Heap_Profile
+{
+public:
+    /**
+     * the formats write() can dump.
+     *
+     * pprof is the text heap profile of gperftools, which pprof reads and symbolises with the binary:
+     * pprof ./program heap.prof. Every sample is a line holding its size and its return addresses, followed by the
+     * mappings of the process.
+     *
+     * folded is a line per sample, the functions from the outermost one separated by semicolons then the estimated
+     * bytes, the input of flamegraph.pl. Functions are named with dladdr(), mangled, so only the exported ones have a
+     * name, the others are written as an address.
+     */
+    enum class format
+    {
+        pprof,
+        folded,
+    };
+
+    /**
+     * the sampling interval suggested, the one of tcmalloc.
+     */
+    static constexpr std::size_t default_interval = std::size_t{512} << 10;
+
+    /**
+     * Creates a profiler that is off, and has no table yet.
+     */
+    Heap_Profile();
+
+    /**
+     * A profiler owns its table, it can not be copied.
+     */
+    Heap_Profile(const Heap_Profile &) = delete;
+    Heap_Profile &operator=(const Heap_Profile &) = delete;
+
+    /**
+     * Unmaps the table.
+     */
+    ~Heap_Profile();
+
+    /**
+     * Returns the mean number of bytes allocated between two samples, 0 when the profiler is off.
+     */
+    std::size_t interval() const;
+
+    /**
+     * Sets the mean number of bytes allocated between two samples, 0 turns the profiler off. The samples taken so far
+     * are kept until they are freed.
+     */
+    void set_interval(std::size_t bytes);
+
+    /**
+     * Draws the number of bytes to allocate before the next sample.
+     *
+     * @return a number of bytes of mean interval(), at least 1, or PTRDIFF_MAX when the profiler is off.
+     */
+    std::ptrdiff_t next_countdown();
+
+    /**
+     * Adds a sampled allocation, with its call stack. The frames of this function and of the heap function calling
+     * it are left out, so the stack starts at the heap function the memory was asked from, like alloc().
+     *
+     * @param data the memory allocated.
+     * @param size the size given to alloc.
+     * @return false if the table could not grow, the allocation is then not sampled.
+     */
+    bool record(intptr_t *data, std::size_t size);
+
+    /**
+     * Removes a sampled allocation that is freed.
+     *
+     * @param data the memory, a sample that is not in the table is ignored.
+     */
+    void erase(intptr_t *data);
+
+    /**
+     * Follows a sampled allocation resized in place, or moved with mremap, keeping its call stack.
+     *
+     * @param data the memory before it was resized.
+     * @param moved the memory after.
+     * @param size the new size.
+     */
+    void move(intptr_t *data, intptr_t *moved, std::size_t size);
+
+    /**
+     * Returns the number of live samples.
+     */
+    std::size_t sample_count() const;
+
+    /**
+     * Returns the live bytes the samples stand for, every sample weighted by the inverse of the odds it had of being
+     * picked.
+     */
+    std::size_t estimated_bytes() const;
+
+    /**
+     * Dumps the live samples.
+     *
+     * @param out where the profile is written.
+     * @param as the format of the profile.
+     */
+    void write(std::ostream &out, format as = format::pprof) const;
+
+private:
+    /**
+     * Returns how many bytes a sample of this size stands for, its size divided by the odds it had of being picked.
+     */
+    double weight(std::size_t size) const;
+
+    /**
+     * Returns the slot of the table a pointer hashes to, where its search starts.
+     */
+    std::size_t home_of(const intptr_t *data) const;
+
+    /**
+     * Returns the slot of the table where a pointer is, or the empty slot where it would go.
+     */
+    std::size_t slot_of(const intptr_t *data) const;
+
+    /**
+     * Maps a table twice as big, or the first one, and moves the samples into it.
+     *
+     * @return false if out of memory.
+     */
+    bool grow();
+
+    /**
+     * number of slots of the first table.
+     */
+    static constexpr std::size_t initial_capacity = 256;
+
+    /**
+     * the table of samples, open addressing with linear probing, keyed by address.
+     */
+    Heap_Sample *m_samples;
+
+    /**
+     * number of slots of the table, a power of two.
+     */
+    std::size_t m_capacity;
+
+    /**
+     * number of live samples.
+     */
+    std::size_t m_count;
+
+    /**
+     * mean number of bytes between two samples, kept when the profiler is turned off to weigh the samples left.
+     */
+    std::size_t m_interval;
+
+    /**
+     * whether allocations are being sampled.
+     */
+    bool m_enabled;
+
+    /**
+     * state of the xorshift generator the intervals are drawn with.
+     */
+    std::uint64_t m_random;
+};
+
+#endif //HEAP_PROFILE_H
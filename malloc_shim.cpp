@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <unistd.h>
+#include "thread_cache.h"
+
+/*
+ * The C allocation functions, built into liballocator.so so the allocator can be preloaded under any program:
+ *
+ *     LD_PRELOAD=./liballocator.so ls -l
+ *
+ * They go through the thread caches like operator new does. Thread caches align blocks on 16 bytes, and memalign and
+ * friends ask for more, so every block starts with a small prefix that free can find the block from: the pointer
+ * handed out is rounded up to the alignment asked for (16 bytes for malloc, like glibc), and the distance back to the
+ * block is stored in the 8 bytes right before it.
+ *
+ * Bootstrap and reentrancy: creating the Central_Heap or the cache of a thread calls into libc (pthread_atfork,
+ * atexit, thread_local destructors), which may call malloc again. Such nested calls, recognised with a thread_local
+ * flag, are served from a small static buffer that is never freed.
+ */
+
+/**
+ * alignment of malloc, calloc and realloc.
+ */
+static constexpr std::size_t default_alignment = 16;
+
+/**
+ * the biggest size handed out, like glibc: the prefix, the Block header and the rounding to a size class are added
+ * underneath, and must not wrap around.
+ */
+static constexpr std::size_t max_size = PTRDIFF_MAX;
+
+/**
+ * set while the calling thread is inside the allocator. initial-exec TLS, so reading it never allocates.
+ */
+static thread_local bool tls_busy __attribute__((tls_model("initial-exec"))) = false;
+
+/**
+ * memory for the nested calls, handed out with a bump pointer.
+ */
+alignas(4096) static char bootstrap_buffer[1 << 20];
+static std::atomic<std::size_t> bootstrap_used{0};
+
+static bool is_bootstrap(void *pointer)
+{
+    auto address = static_cast<char *>(pointer);
+    return address >= bootstrap_buffer && address < bootstrap_buffer + sizeof(bootstrap_buffer);
+}
+
+/**
+ * Returns memory from the bootstrap buffer, with its size in the 8 bytes before it, or nullptr when it is full.
+ */
+static void *bootstrap_alloc(std::size_t size, std::size_t alignment)
+{
+    auto needed = (size + alignment + sizeof(std::size_t) + 15) & ~std::size_t{15};
+    auto offset = bootstrap_used.fetch_add(needed, std::memory_order_relaxed);
+    if (offset + needed > sizeof(bootstrap_buffer))
+    {
+        return nullptr;
+    }
+
+    auto start = reinterpret_cast<std::uintptr_t>(bootstrap_buffer + offset) + sizeof(std::size_t);
+    auto pointer = reinterpret_cast<char *>((start + alignment - 1) & ~(alignment - 1));
+    reinterpret_cast<std::size_t *>(pointer)[-1] = size;
+    return pointer;
+}
+
+/**
+ * Allocates size bytes aligned on alignment, a power of two, and sets errno on failure.
+ */
+static void *shim_alloc(std::size_t size, std::size_t alignment)
+{
+    alignment = alignment < default_alignment ? default_alignment : alignment;
+
+    // room for the prefix: blocks are aligned on 16 bytes, so it is never more than alignment bytes
+    if (size > max_size || size > SIZE_MAX - alignment)
+    {
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    if (tls_busy)
+    {
+        auto pointer = bootstrap_alloc(size, alignment);
+        if (pointer == nullptr)
+        {
+            errno = ENOMEM;
+        }
+        return pointer;
+    }
+
+    tls_busy = true;
+    auto block = static_cast<char *>(Thread_Cache::allocate(size + alignment));
+    tls_busy = false;
+    if (block == nullptr)
+    {
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    auto start = reinterpret_cast<std::uintptr_t>(block) + sizeof(std::size_t);
+    auto pointer = reinterpret_cast<char *>((start + alignment - 1) & ~(alignment - 1));
+    reinterpret_cast<std::size_t *>(pointer)[-1] = pointer - block;
+    return pointer;
+}
+
+/**
+ * Returns the block a pointer from shim_alloc() was cut from.
+ */
+static void *block_of(void *pointer)
+{
+    return static_cast<char *>(pointer) - static_cast<std::size_t *>(pointer)[-1];
+}
+
+static std::size_t usable_size(void *pointer)
+{
+    if (is_bootstrap(pointer))
+    {
+        return static_cast<std::size_t *>(pointer)[-1];
+    }
+
+    auto block = block_of(pointer);
+    return Thread_Cache::usable_size(block) - (static_cast<char *>(pointer) - static_cast<char *>(block));
+}
+
+static bool is_power_of_two(std::size_t value)
+{
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+extern "C"
+{
+    void *malloc(std::size_t size)
+    {
+        return shim_alloc(size, default_alignment);
+    }
+
+    void free(void *pointer)
+    {
+        // the bootstrap buffer is never freed
+        if (pointer == nullptr || is_bootstrap(pointer))
+        {
+            return;
+        }
+
+        // free may be called inside the allocator too, so the flag is put back as it was
+        auto busy = tls_busy;
+        tls_busy = true;
+        Thread_Cache::deallocate(block_of(pointer));
+        tls_busy = busy;
+    }
+
+    void *calloc(std::size_t count, std::size_t size)
+    {
+        if (size != 0 && count > SIZE_MAX / size)
+        {
+            errno = ENOMEM;
+            return nullptr;
+        }
+
+        auto pointer = shim_alloc(count * size, default_alignment);
+        if (pointer != nullptr)
+        {
+            std::memset(pointer, 0, count * size);
+        }
+        return pointer;
+    }
+
+    void *realloc(void *pointer, std::size_t size)
+    {
+        if (pointer == nullptr)
+        {
+            return malloc(size);
+        }
+        if (size == 0)
+        {
+            free(pointer);
+            return nullptr;
+        }
+
+        auto old_size = usable_size(pointer);
+        if (is_bootstrap(pointer) || tls_busy)
+        {
+            auto moved = malloc(size);
+            if (moved != nullptr)
+            {
+                std::memcpy(moved, pointer, old_size < size ? old_size : size);
+                free(pointer);
+            }
+            return moved;
+        }
+
+        // the thread caches resize the block, in place when they can, the prefix moving along with the data
+        auto block = static_cast<char *>(block_of(pointer));
+        auto offset = static_cast<std::size_t>(static_cast<char *>(pointer) - block);
+        if (size > max_size || size > SIZE_MAX - offset - default_alignment)
+        {
+            errno = ENOMEM;
+            return nullptr;
+        }
+
+        tls_busy = true;
+        auto resized = static_cast<char *>(Thread_Cache::reallocate(block, std::max(offset, default_alignment) + size));
+        tls_busy = false;
+        if (resized == nullptr)
+        {
+            errno = ENOMEM;
+            return nullptr;
+        }
+
+        // a block that moved may not have the same alignment anymore, realloc only keeps the one of malloc
+        auto start = reinterpret_cast<std::uintptr_t>(resized) + sizeof(std::size_t);
+        auto aligned = reinterpret_cast<char *>((start + default_alignment - 1) & ~(default_alignment - 1));
+        if (aligned != resized + offset)
+        {
+            std::memmove(aligned, resized + offset, old_size < size ? old_size : size);
+            reinterpret_cast<std::size_t *>(aligned)[-1] = aligned - resized;
+        }
+        return aligned;
+    }
+
+    void *reallocarray(void *pointer, std::size_t count, std::size_t size)
+    {
+        if (size != 0 && count > SIZE_MAX / size)
+        {
+            errno = ENOMEM;
+            return nullptr;
+        }
+        return realloc(pointer, count * size);
+    }
+
+    int posix_memalign(void **out, std::size_t alignment, std::size_t size)
+    {
+        if (!is_power_of_two(alignment) || alignment % sizeof(void *) != 0)
+        {
+            return EINVAL;
+        }
+
+        auto saved = errno;
+        auto pointer = shim_alloc(size, alignment);
+        errno = saved;
+        if (pointer == nullptr)
+        {
+            return ENOMEM;
+        }
+        *out = pointer;
+        return 0;
+    }
+
+    void *aligned_alloc(std::size_t alignment, std::size_t size)
+    {
+        if (!is_power_of_two(alignment))
+        {
+            errno = EINVAL;
+            return nullptr;
+        }
+        return shim_alloc(size, alignment);
+    }
+
+    void *memalign(std::size_t alignment, std::size_t size)
+    {
+        return aligned_alloc(alignment, size);
+    }
+
+    void *valloc(std::size_t size)
+    {
+        return shim_alloc(size, sysconf(_SC_PAGESIZE));
+    }
+
+    void *pvalloc(std::size_t size)
+    {
+        auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        return shim_alloc((size + page - 1) & ~(page - 1), page);
+    }
+
+    std::size_t malloc_usable_size(void *pointer)
+    {
+        return pointer == nullptr ? 0 : usable_size(pointer);
+    }
+
+    /**
+     * Gives the free memory of the shared heap back to the OS, returns 1 if there was any, like glibc. The padding to
+     * keep is ignored, the heap keeps the region it carves from anyway.
+     */
+    int malloc_trim(std::size_t)
+    {
+        return Central_Heap::instance().trim() != 0 ? 1 : 0;
+    }
+}
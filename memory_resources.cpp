@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <new>
+#include "memory_resources.h"
+
+/**
+ * every Chunk of a Memory_Linked_List is aligned on 8 bytes.
+ */
+static constexpr std::size_t heap_alignment = 8;
+
+Heap_Resource::Heap_Resource(Memory_Linked_List::search_mode search)
+{
+    m_heap.m_search_mode = search;
+}
+
+Memory_Linked_List &Heap_Resource::heap()
+{
+    return m_heap;
+}
+
+void *Heap_Resource::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+    auto pointer = alignment <= heap_alignment ? m_heap.alloc(bytes) : m_heap.alloc_aligned(bytes, alignment);
+    if (pointer == nullptr)
+    {
+        throw std::bad_alloc{};
+    }
+    return pointer;
+}
+
+void Heap_Resource::do_deallocate(void *pointer, std::size_t bytes, std::size_t alignment)
+{
+    // an aligned Chunk may not start where a Chunk of that size would, so its size is read from its header
+    if (alignment <= heap_alignment)
+    {
+        m_heap.free(static_cast<intptr_t *>(pointer), bytes);
+    }
+    else
+    {
+        m_heap.free(static_cast<intptr_t *>(pointer));
+    }
+}
+
+bool Heap_Resource::do_is_equal(const std::pmr::memory_resource &other) const noexcept
+{
+    return this == &other;
+}
+
+Pool_Resource::Pool_Resource(std::size_t slab_size, std::pmr::memory_resource *upstream) : m_slabs{nullptr},
+                                                                                           m_slab_size{std::max(slab_size, sizeof(Slab) + max_pooled_size)},
+                                                                                           m_upstream{upstream}
+{
+}
+
+Pool_Resource::~Pool_Resource()
+{
+    release();
+}
+
+void Pool_Resource::release()
+{
+    while (m_slabs != nullptr)
+    {
+        auto next = m_slabs->next;
+        m_upstream->deallocate(m_slabs, m_slab_size, pool_alignment);
+        m_slabs = next;
+    }
+    m_free.fill(nullptr);
+}
+
+std::size_t Pool_Resource::pool_of(std::size_t bytes, std::size_t alignment)
+{
+    if (bytes > max_pooled_size || alignment > pool_alignment)
+    {
+        return pool_count;
+    }
+
+    auto pool = Size_Classes::index(bytes < alignment ? alignment : bytes);
+    while (pool < pool_count && Size_Classes::size(pool) % alignment != 0)
+    {
+        pool++;
+    }
+    return pool;
+}
+
+void Pool_Resource::grow(std::size_t pool)
+{
+    auto size = Size_Classes::size(pool);
+    auto slots = (m_slab_size - sizeof(Slab)) / size;
+    auto slab = static_cast<Slab *>(m_upstream->allocate(m_slab_size, pool_alignment));
+    slab->next = m_slabs;
+    m_slabs = slab;
+
+    // links the slots from the last to the first, so they are handed out in address order
+    auto first = reinterpret_cast<char *>(slab + 1);
+    for (std::size_t i = slots; i-- > 0;)
+    {
+        auto slot = reinterpret_cast<Slot *>(first + i * size);
+        slot->next = m_free[pool];
+        m_free[pool] = slot;
+    }
+}
+
+void *Pool_Resource::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+    auto pool = pool_of(bytes, alignment);
+    if (pool == pool_count)
+    {
+        return m_upstream->allocate(bytes, alignment);
+    }
+
+    if (m_free[pool] == nullptr)
+    {
+        grow(pool);
+    }
+    auto slot = m_free[pool];
+    m_free[pool] = slot->next;
+    return slot;
+}
+
+void Pool_Resource::do_deallocate(void *pointer, std::size_t bytes, std::size_t alignment)
+{
+    auto pool = pool_of(bytes, alignment);
+    if (pool == pool_count)
+    {
+        m_upstream->deallocate(pointer, bytes, alignment);
+        return;
+    }
+
+    auto slot = static_cast<Slot *>(pointer);
+    slot->next = m_free[pool];
+    m_free[pool] = slot;
+}
+
+bool Pool_Resource::do_is_equal(const std::pmr::memory_resource &other) const noexcept
+{
+    return this == &other;
+}
+
+Arena_Resource::Arena_Resource(std::size_t buffer_size) : m_arena{buffer_size}
+{
+}
+
+Monotonic_Arena &Arena_Resource::arena()
+{
+    return m_arena;
+}
+
+void *Arena_Resource::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+    auto pointer = m_arena.allocate(bytes, alignment);
+    if (pointer == nullptr)
+    {
+        throw std::bad_alloc{};
+    }
+    return pointer;
+}
+
+void Arena_Resource::do_deallocate(void *, std::size_t, std::size_t)
+{
+    // nothing is freed until the arena is reset
+}
+
+bool Arena_Resource::do_is_equal(const std::pmr::memory_resource &other) const noexcept
+{
+    return this == &other;
+}
@@ -0,0 +1,195 @@
+#ifndef MEMORY_RESOURCES_H
+#define MEMORY_RESOURCES_H
+
+#include <array>
+#include <cstddef>
+#include <memory_resource>
+#include "allocator.h"
+#include "monotonic_arena.h"
+#include "size_classes.h"
+
+/**
+ * The allocators of this project as std::pmr::memory_resource, so std::pmr containers can pick their strategy at run
+ * time:
+ *
+ *     Heap_Resource resource{Memory_Linked_List::search_mode::best_fit};
+ *     std::pmr::map<int, long> headers{&resource};
+ *
+ * None of them is thread safe, like std::pmr::unsynchronized_pool_resource: a resource must be used by one thread at
+ * a time. A resource is only equal to itself.
+ */
+
+/**
+ * A memory resource over a Memory_Linked_List of its own, with any search mode.
+ */
+class Heap_Resource : public std::pmr::memory_resource
+{
+public:
+    /**
+     * Creates the heap. No memory is taken until the first allocation.
+     *
+     * @param search the search mode of the heap.
+     */
+    explicit Heap_Resource(Memory_Linked_List::search_mode search = Memory_Linked_List::search_mode::segregated);
+
+    /**
+     * Returns the heap, to change its settings before the first allocation or to read its stats.
+     */
+    Memory_Linked_List &heap();
+
+private:
+    /**
+     * Allocates from the heap, with alloc_aligned() for alignments above 8 bytes. Throws std::bad_alloc when out of
+     * memory.
+     */
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+
+    /**
+     * Frees to the heap, with its size unless it was aligned.
+     */
+    void do_deallocate(void *pointer, std::size_t bytes, std::size_t alignment) override;
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+
+    Memory_Linked_List m_heap;
+};
+
+/**
+ * A memory resource handing out same size slots, one pool per size class up to max_pooled_size.
+ *
+ * Like Slot_Pool, free slots are threaded through an intrusive free list, so allocating and freeing are a pop and a
+ * push and a slot has no header. Slabs are taken from the upstream resource and only given back by release() or
+ * the destructor. Bigger blocks, or blocks aligned on more than 16 bytes, go straight to the upstream resource.
+ */
+class Pool_Resource : public std::pmr::memory_resource
+{
+public:
+    /**
+     * the biggest block kept in a pool.
+     */
+    static constexpr std::size_t max_pooled_size = 1024;
+
+    /**
+     * Creates empty pools. No memory is taken until the first allocation.
+     *
+     * @param slab_size the size of the slabs slots are carved from, at least enough for one slot of every pool.
+     * @param upstream where slabs and big blocks come from.
+     */
+    explicit Pool_Resource(std::size_t slab_size = std::size_t{64} << 10,
+                           std::pmr::memory_resource *upstream = std::pmr::get_default_resource());
+
+    Pool_Resource(const Pool_Resource &) = delete;
+    Pool_Resource &operator=(const Pool_Resource &) = delete;
+
+    /**
+     * Gives every slab back.
+     */
+    ~Pool_Resource() override;
+
+    /**
+     * Gives every slab back, freeing every pooled block at once. Big blocks must still be deallocated.
+     */
+    void release();
+
+private:
+    /**
+     * Pops a slot from the pool of the block, creating a new slab if it is empty.
+     */
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+
+    /**
+     * Pushes the slot on the free list of its pool.
+     */
+    void do_deallocate(void *pointer, std::size_t bytes, std::size_t alignment) override;
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+
+    /**
+     * A free slot, holding the link to the next free slot.
+     */
+    struct Slot
+    {
+        Slot *next;
+    };
+
+    /**
+     * Header at the start of every slab, 16 bytes so the slots after it are aligned on 16 bytes.
+     */
+    struct alignas(16) Slab
+    {
+        Slab *next;
+    };
+
+    /**
+     * the biggest alignment a pool gives.
+     */
+    static constexpr std::size_t pool_alignment = alignof(Slab);
+
+    /**
+     * number of pools, one per size class up to max_pooled_size.
+     */
+    static constexpr std::size_t pool_count = Size_Classes::index(max_pooled_size) + 1;
+
+    /**
+     * Returns the pool of a block, or pool_count if it does not go in a pool. The class of the size is taken, or the
+     * first one after it whose size is a multiple of the alignment, so every slot of the pool is aligned.
+     */
+    static std::size_t pool_of(std::size_t bytes, std::size_t alignment);
+
+    /**
+     * Takes a new slab from upstream and threads all of its slots in the free list of a pool. Throws what upstream
+     * throws when out of memory.
+     */
+    void grow(std::size_t pool);
+
+    /**
+     * the first free slot of every pool.
+     */
+    std::array<Slot *, pool_count> m_free{};
+
+    /**
+     * the slabs taken from upstream.
+     */
+    Slab *m_slabs;
+
+    /**
+     * the size of every slab.
+     */
+    std::size_t m_slab_size;
+
+    /**
+     * where slabs and big blocks come from.
+     */
+    std::pmr::memory_resource *m_upstream;
+};
+
+/**
+ * A memory resource over a Monotonic_Arena of its own: deallocating does nothing, the memory comes back when the
+ * arena is reset.
+ */
+class Arena_Resource : public std::pmr::memory_resource
+{
+public:
+    /**
+     * Creates the arena. No memory is taken until the first allocation.
+     *
+     * @param buffer_size size of the first buffer of the arena.
+     */
+    explicit Arena_Resource(std::size_t buffer_size = std::size_t{64} << 10);
+
+    /**
+     * Returns the arena, to reset or rewind it.
+     */
+    Monotonic_Arena &arena();
+
+private:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+
+    void do_deallocate(void *pointer, std::size_t bytes, std::size_t alignment) override;
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+
+    Monotonic_Arena m_arena;
+};
+
+#endif //MEMORY_RESOURCES_H
@@ -0,0 +1,101 @@
+#include <algorithm>
+#include "monotonic_arena.h"
+#include "thread_cache.h"
+
+Monotonic_Arena::Monotonic_Arena(std::size_t buffer_size) : m_first{nullptr},
+                                                            m_current{nullptr},
+                                                            m_position{nullptr},
+                                                            m_next_size{buffer_size}
+{
+}
+
+Monotonic_Arena::~Monotonic_Arena()
+{
+    // gives every buffer of the chain back
+    auto buffer = m_first;
+    while (buffer != nullptr)
+    {
+        auto next = buffer->next;
+        Central_Heap::instance().free(reinterpret_cast<intptr_t *>(buffer));
+        buffer = next;
+    }
+}
+
+void *Monotonic_Arena::allocate(std::size_t size, std::size_t alignment)
+{
+    // the current buffer is full, or there is none yet
+    if (m_current == nullptr || align_up(m_position, alignment) + size > m_current->end)
+    {
+        if (!grow(size, alignment))
+        {
+            return nullptr;
+        }
+    }
+
+    // bumps the pointer
+    auto pointer = align_up(m_position, alignment);
+    m_position = pointer + size;
+    return pointer;
+}
+
+Monotonic_Arena::Marker Monotonic_Arena::mark() const
+{
+    return Marker{m_current, m_position};
+}
+
+void Monotonic_Arena::rewind(Marker marker)
+{
+    // the buffers after the marker stay in the chain, to be reused
+    m_current = static_cast<Buffer *>(marker.buffer);
+    m_position = marker.position;
+}
+
+void Monotonic_Arena::reset()
+{
+    m_current = m_first;
+    m_position = m_first != nullptr ? m_first->begin() : nullptr;
+}
+
+bool Monotonic_Arena::grow(std::size_t size, std::size_t alignment)
+{
+    // reuses the next buffer of the chain if the allocation fits in it
+    auto next = m_current != nullptr ? m_current->next : m_first;
+    if (next != nullptr && align_up(next->begin(), alignment) + size <= next->end)
+    {
+        m_current = next;
+        m_position = next->begin();
+        return true;
+    }
+
+    // chains a new buffer, big enough for the allocation
+    auto buffer_size = std::max(m_next_size, sizeof(Buffer) + size + alignment);
+    auto buffer = reinterpret_cast<Buffer *>(Central_Heap::instance().alloc(buffer_size));
+    if (buffer == nullptr)
+    {
+        return false;
+    }
+    buffer->end = reinterpret_cast<char *>(buffer) + buffer_size;
+    m_next_size = buffer_size * 2;
+
+    // puts it right after the current buffer
+    if (m_current == nullptr)
+    {
+        buffer->next = m_first;
+        m_first = buffer;
+    }
+    else
+    {
+        buffer->next = m_current->next;
+        m_current->next = buffer;
+    }
+
+    m_current = buffer;
+    m_position = buffer->begin();
+    return true;
+}
+
+char *Monotonic_Arena::align_up(char *position, std::size_t alignment)
+{
+    auto address = reinterpret_cast<std::uintptr_t>(position);
+    return reinterpret_cast<char *>((address + alignment - 1) & ~(alignment - 1));
+}
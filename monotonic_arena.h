@@ -0,0 +1,206 @@
+#ifndef MONOTONIC_ARENA_H
+#define MONOTONIC_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+
+/**
+ * A monotonic (linear) arena for memory that all dies at the same time, like the objects of a request.
+ *
+ * Allocating moves a bump pointer forward in the current buffer, and nothing is ever freed on its own. reset() or
+ * rewind() free everything allocated since the start or since a Marker in O(1), by moving the bump pointer back.
+ *
+ * When a buffer is full, the arena chains a new one, taken from the Central_Heap (so through Memory_Linked_List and
+ * its memory_map). Buffers are kept after a reset, so a reused arena stops asking for memory once it is warm. They are
+ * only given back when the arena is destroyed.
+ */
+class Monotonic_Arena
+{
+public:
+    /**
+     * A position in the arena, to rewind to.
+     */
+    class Marker
+    {
+    public:
+        /**
+         * the buffer the bump pointer was in.
+         */
+        void *buffer;
+
+        /**
+         * the bump pointer.
+         */
+        char *position;
+    };
+
+    /**
+     * Creates an empty arena. No memory is taken until the first allocation.
+     *
+     * @param buffer_size size of the first buffer, every new buffer is twice as big as the last one.
+     */
+    explicit Monotonic_Arena(std::size_t buffer_size = std::size_t{64} << 10);
+
+    Monotonic_Arena(const Monotonic_Arena &) = delete;
+    Monotonic_Arena &operator=(const Monotonic_Arena &) = delete;
+
+    /**
+     * Gives every buffer back to the Central_Heap.
+     */
+    ~Monotonic_Arena();
+
+    /**
+     * Allocates memory by moving the bump pointer.
+     *
+     * @param size the number of bytes needed.
+     * @param alignment the alignment of the memory, a power of two.
+     * @return a pointer to the memory, or nullptr if out of memory.
+     */
+    void *allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t));
+
+    /**
+     * Returns the current position, everything allocated after it can be freed with rewind().
+     */
+    Marker mark() const;
+
+    /**
+     * Frees everything allocated since the marker was taken.
+     *
+     * @param marker a marker taken from this arena, since the last reset.
+     */
+    void rewind(Marker marker);
+
+    /**
+     * Frees everything, keeping the buffers for the next allocations.
+     */
+    void reset();
+
+private:
+    /**
+     * Header at the start of every buffer. The memory follows it.
+     */
+    class Buffer
+    {
+    public:
+        /**
+         * the next buffer in the chain.
+         */
+        Buffer *next;
+
+        /**
+         * the end of the buffer.
+         */
+        char *end;
+
+        /**
+         * Returns the first byte that can be allocated.
+         */
+        char *begin()
+        {
+            return reinterpret_cast<char *>(this + 1);
+        }
+    };
+
+    /**
+     * Moves to the next buffer of the chain that can hold the allocation, chaining a new buffer if there is none.
+     *
+     * @param size the number of bytes needed.
+     * @param alignment the alignment of the memory.
+     * @return false if out of memory.
+     */
+    bool grow(std::size_t size, std::size_t alignment);
+
+    /**
+     * Returns the position rounded up to the alignment.
+     */
+    static char *align_up(char *position, std::size_t alignment);
+
+    /**
+     * the first buffer of the chain.
+     */
+    Buffer *m_first;
+
+    /**
+     * the buffer allocations are made from.
+     */
+    Buffer *m_current;
+
+    /**
+     * the bump pointer, in m_current.
+     */
+    char *m_position;
+
+    /**
+     * the size of the next buffer to chain.
+     */
+    std::size_t m_next_size;
+};
+
+/**
+ * An allocator bound to a Monotonic_Arena, so that standard containers can allocate from it.
+ *
+ * deallocate() does nothing: the memory comes back when the arena is reset. The allocator only holds a pointer to
+ * the arena, so copies and rebinds use the same arena, and two allocators are equal if they use the same arena.
+ */
+template <typename T>
+class arena_allocator
+{
+public:
+    // Type aliases required for standard allocator interface.
+    using value_type = T;
+    using pointer = T *;
+    using const_pointer = const T *;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+
+    // Containers keep the arena they were created with.
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    arena_allocator(Monotonic_Arena &arena) noexcept : m_arena{&arena} {}
+
+    // Copy constructor template to allow conversion between different allocator types.
+    template <typename U>
+    arena_allocator(const arena_allocator<U> &other) noexcept : m_arena{other.m_arena} {}
+
+    // Allocates memory from the arena.
+    T *allocate(std::size_t size)
+    {
+        auto pointer = m_arena->allocate(size * sizeof(T), alignof(T));
+        if (pointer == nullptr)
+        {
+            throw std::bad_alloc{};
+        }
+        return static_cast<T *>(pointer);
+    }
+
+    // Nothing is freed until the arena is reset.
+    void deallocate(T *, std::size_t) noexcept {}
+
+    // Rebind struct to allow the allocator to allocate memory for a different type U.
+    template <typename U>
+    struct rebind
+    {
+        using other = arena_allocator<U>;
+    };
+
+    template <typename U>
+    bool operator==(const arena_allocator<U> &other) const noexcept { return m_arena == other.m_arena; }
+
+    template <typename U>
+    bool operator!=(const arena_allocator<U> &other) const noexcept { return m_arena != other.m_arena; }
+
+private:
+    template <typename U>
+    friend class arena_allocator;
+
+    /**
+     * the arena the memory comes from.
+     */
+    Monotonic_Arena *m_arena;
+};
+
+#endif //MONOTONIC_ARENA_H
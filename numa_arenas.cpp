@@ -0,0 +1,199 @@
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <sched.h>
+#include <unistd.h>
+#include "numa_arenas.h"
+
+Numa_Topology Numa_Topology::detect()
+{
+    Numa_Topology topology;
+    std::ifstream online{"/sys/devices/system/node/online"};
+    std::string nodes;
+    if (online >> nodes)
+    {
+        for (auto node : parse_list(nodes))
+        {
+            // nodes with memory but no CPU have an empty list
+            std::ifstream cpulist{"/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"};
+            std::string cpus;
+            cpulist >> cpus;
+            topology.m_cpus.push_back(parse_list(cpus));
+            topology.m_memory_nodes.push_back(static_cast<int>(node));
+        }
+    }
+
+    // no NUMA support in the kernel, a single node
+    if (topology.m_cpus.empty())
+    {
+        std::vector<std::size_t> cpus;
+        for (long cpu = 0; cpu < sysconf(_SC_NPROCESSORS_CONF); cpu++)
+        {
+            cpus.push_back(static_cast<std::size_t>(cpu));
+        }
+        topology.m_cpus.push_back(cpus);
+        topology.m_memory_nodes.push_back(0);
+    }
+
+    topology.index_cpus();
+    return topology;
+}
+
+Numa_Topology Numa_Topology::fake(std::size_t node_count)
+{
+    auto machine = detect();
+    auto cpu_count = static_cast<std::size_t>(std::max(sysconf(_SC_NPROCESSORS_CONF), 1L));
+
+    // every CPU needs a node, no nodes is taken as a single one
+    node_count = std::max<std::size_t>(node_count, 1);
+
+    Numa_Topology topology;
+    topology.m_cpus.resize(node_count);
+    for (std::size_t cpu = 0; cpu < cpu_count; cpu++)
+    {
+        topology.m_cpus[cpu * node_count / cpu_count].push_back(cpu);
+    }
+
+    // the memory of the fake nodes goes to the nodes of the machine in turn
+    for (std::size_t node = 0; node < node_count; node++)
+    {
+        topology.m_memory_nodes.push_back(machine.m_memory_nodes[node % machine.node_count()]);
+    }
+
+    topology.index_cpus();
+    return topology;
+}
+
+void Numa_Topology::index_cpus()
+{
+    m_node_of_cpu.clear();
+    for (std::size_t node = 0; node < m_cpus.size(); node++)
+    {
+        for (auto cpu : m_cpus[node])
+        {
+            if (cpu >= m_node_of_cpu.size())
+            {
+                m_node_of_cpu.resize(cpu + 1, 0);
+            }
+            m_node_of_cpu[cpu] = node;
+        }
+    }
+}
+
+std::size_t Numa_Topology::node_count() const
+{
+    return m_cpus.size();
+}
+
+std::size_t Numa_Topology::node_of_cpu(std::size_t cpu) const
+{
+    return cpu < m_node_of_cpu.size() ? m_node_of_cpu[cpu] : 0;
+}
+
+const std::vector<std::size_t> &Numa_Topology::cpus_of(std::size_t node) const
+{
+    return m_cpus[node];
+}
+
+int Numa_Topology::memory_node(std::size_t node) const
+{
+    return m_memory_nodes[node];
+}
+
+std::vector<std::size_t> Numa_Topology::parse_list(const std::string &list)
+{
+    std::vector<std::size_t> values;
+    std::size_t position{0};
+
+    // ranges separated by commas, a range is a single number or first-last
+    while (position < list.size())
+    {
+        auto comma = list.find(',', position);
+        auto range = list.substr(position, comma == std::string::npos ? std::string::npos : comma - position);
+        position = comma == std::string::npos ? list.size() : comma + 1;
+
+        if (range.empty())
+        {
+            continue;
+        }
+        auto dash = range.find('-');
+        auto first = std::stoul(range.substr(0, dash));
+        auto last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+        for (auto value = first; value <= last; value++)
+        {
+            values.push_back(value);
+        }
+    }
+    return values;
+}
+
+Numa_Arenas::Numa_Arenas(Numa_Topology topology) : m_topology{std::move(topology)},
+                                                   m_arenas{new Arena[m_topology.node_count()]}
+{
+    for (std::size_t node = 0; node < m_topology.node_count(); node++)
+    {
+        m_arenas[node].heap.m_numa_node = m_topology.memory_node(node);
+    }
+}
+
+void *Numa_Arenas::alloc(std::size_t size)
+{
+    return alloc_on_node(size, current_node());
+}
+
+void *Numa_Arenas::alloc_on_node(std::size_t size, std::size_t node)
+{
+    if (node >= m_topology.node_count() || size > SIZE_MAX - header_size)
+    {
+        return nullptr;
+    }
+
+    intptr_t *data;
+    {
+        std::lock_guard<std::mutex> lock{m_arenas[node].mutex};
+        data = m_arenas[node].heap.alloc(size + header_size);
+    }
+    if (data == nullptr)
+    {
+        return nullptr;
+    }
+
+    // the block remembers its node, for free()
+    *reinterpret_cast<std::size_t *>(data) = node;
+    return reinterpret_cast<char *>(data) + header_size;
+}
+
+void Numa_Arenas::free(void *pointer)
+{
+    if (pointer == nullptr)
+    {
+        return;
+    }
+
+    auto &arena = m_arenas[node_of(pointer)];
+    std::lock_guard<std::mutex> lock{arena.mutex};
+    arena.heap.free(reinterpret_cast<intptr_t *>(static_cast<char *>(pointer) - header_size));
+}
+
+std::size_t Numa_Arenas::node_of(void *pointer)
+{
+    return *reinterpret_cast<std::size_t *>(static_cast<char *>(pointer) - header_size);
+}
+
+std::size_t Numa_Arenas::current_node() const
+{
+    // getcpu through the vDSO, no syscall
+    auto cpu = sched_getcpu();
+    return cpu < 0 ? 0 : m_topology.node_of_cpu(static_cast<std::size_t>(cpu));
+}
+
+const Numa_Topology &Numa_Arenas::topology() const
+{
+    return m_topology;
+}
+
+Allocator_Stats Numa_Arenas::get_stats(std::size_t node)
+{
+    std::lock_guard<std::mutex> lock{m_arenas[node].mutex};
+    return m_arenas[node].heap.get_stats();
+}
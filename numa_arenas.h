@@ -0,0 +1,169 @@
+#ifndef NUMA_ARENAS_H
+#define NUMA_ARENAS_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "allocator.h"
+
+/**
+ * Which NUMA node every CPU belongs to, and the node memory is placed on for each of them.
+ *
+ * detect() reads the topology of the machine from /sys/devices/system/node. fake() splits the CPUs into any number of
+ * nodes, so the per-node code paths can run on a machine with a single node; the memory of every fake node is then
+ * placed on a real one, in turn.
+ */
+class Numa_Topology
+{
+public:
+    /**
+     * Returns the topology of the machine, a single node holding every CPU if it can not be read.
+     */
+    static Numa_Topology detect();
+
+    /**
+     * Returns a topology of node_count nodes, the CPUs split between them in contiguous blocks.
+     *
+     * @param node_count the number of nodes, 0 is taken as 1.
+     */
+    static Numa_Topology fake(std::size_t node_count);
+
+    /**
+     * Returns the number of nodes.
+     */
+    std::size_t node_count() const;
+
+    /**
+     * Returns the node of a CPU, node 0 for a CPU it does not know.
+     */
+    std::size_t node_of_cpu(std::size_t cpu) const;
+
+    /**
+     * Returns the CPUs of a node.
+     */
+    const std::vector<std::size_t> &cpus_of(std::size_t node) const;
+
+    /**
+     * Returns the node of the machine the memory of a node is placed on, the node itself unless it is fake.
+     */
+    int memory_node(std::size_t node) const;
+
+    /**
+     * Parses a list of CPUs or nodes in the format of sysfs, like "0-3,8-11".
+     */
+    static std::vector<std::size_t> parse_list(const std::string &list);
+
+private:
+    /**
+     * Fills m_node_of_cpu from m_cpus.
+     */
+    void index_cpus();
+
+    /**
+     * the CPUs of every node.
+     */
+    std::vector<std::vector<std::size_t>> m_cpus;
+
+    /**
+     * the node of every CPU.
+     */
+    std::vector<std::size_t> m_node_of_cpu;
+
+    /**
+     * the node of the machine of every node.
+     */
+    std::vector<int> m_memory_nodes;
+};
+
+/**
+ * One Memory_Linked_List per NUMA node, each placing its memory on its node (Memory_Linked_List::m_numa_node), so the
+ * threads of a node read local memory instead of memory from wherever it was first touched.
+ *
+ * alloc() takes memory from the node of the CPU the calling thread runs on (getcpu), alloc_on_node() from any node.
+ * Every block starts with the node it comes from, so free() can be called from any thread and any node. Each arena
+ * has a lock of its own, so threads of different nodes never wait for each other.
+ */
+class Numa_Arenas
+{
+public:
+    /**
+     * Creates an arena per node. No memory is taken until the first allocation.
+     *
+     * @param topology the nodes, the one of the machine by default.
+     */
+    explicit Numa_Arenas(Numa_Topology topology = Numa_Topology::detect());
+
+    Numa_Arenas(const Numa_Arenas &) = delete;
+    Numa_Arenas &operator=(const Numa_Arenas &) = delete;
+
+    /**
+     * Allocates memory on the node of the calling thread.
+     *
+     * @param size the number of bytes needed.
+     * @return a pointer to the memory, aligned on 8 bytes, or nullptr if out of memory.
+     */
+    void *alloc(std::size_t size);
+
+    /**
+     * Allocates memory on a chosen node.
+     *
+     * @param size the number of bytes needed.
+     * @param node a node of the topology.
+     * @return a pointer to the memory, or nullptr if out of memory or if the node does not exist.
+     */
+    void *alloc_on_node(std::size_t size, std::size_t node);
+
+    /**
+     * Frees memory from alloc() or alloc_on_node(), from any thread.
+     *
+     * @param pointer the memory, nullptr does nothing.
+     */
+    void free(void *pointer);
+
+    /**
+     * Returns the node a block was allocated on.
+     */
+    static std::size_t node_of(void *pointer);
+
+    /**
+     * Returns the node of the CPU the calling thread runs on.
+     */
+    std::size_t current_node() const;
+
+    /**
+     * Returns the nodes the arenas follow.
+     */
+    const Numa_Topology &topology() const;
+
+    /**
+     * Returns a snapshot of the counters of the arena of a node.
+     */
+    Allocator_Stats get_stats(std::size_t node);
+
+private:
+    /**
+     * the heap of a node and its lock.
+     */
+    class Arena
+    {
+    public:
+        std::mutex mutex;
+        Memory_Linked_List heap;
+    };
+
+    /**
+     * the node of a block, in the 8 bytes before it.
+     */
+    static constexpr std::size_t header_size = sizeof(std::size_t);
+
+    Numa_Topology m_topology;
+
+    /**
+     * one arena per node.
+     */
+    std::unique_ptr<Arena[]> m_arenas;
+};
+
+#endif //NUMA_ARENAS_H
@@ -0,0 +1,276 @@
+#ifndef POOL_ALLOCATOR_H
+#define POOL_ALLOCATOR_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include "thread_cache.h"
+
+/**
+ * A pool of same size slots, carved from slabs of BlockCount slots each.
+ *
+ * Free slots are threaded through an intrusive free list stored in the slots themselves, so allocating and freeing are
+ * a pop and a push, and a slot has no header at all. Slabs come from the Central_Heap and are never given back, as
+ * the containers of other threads may still hold slots from them.
+ *
+ * Every thread has its own pool for each slot size, so the pool needs no lock. A slot freed by another thread simply
+ * joins the free list of that thread. When a thread exits, its free slots are kept for the next pool created.
+ *
+ * @tparam SlotSize the size of a slot, at least the size of a pointer.
+ * @tparam BlockCount the number of slots in a slab.
+ */
+template <std::size_t SlotSize, std::size_t BlockCount>
+class Slot_Pool
+{
+public:
+    static_assert(SlotSize >= sizeof(void *), "a slot must be able to hold the free list link");
+    static_assert(BlockCount > 0, "a slab must hold at least one slot");
+
+    /**
+     * Returns the pool of the calling thread.
+     *
+     * The pool is never destroyed, like the Central_Heap: containers with static storage free their nodes after the
+     * thread_local objects of the main thread are gone. A Pool_Exit gives its free slots away when the thread exits
+     * instead, and the slots freed after that go straight to the orphans.
+     */
+    static Slot_Pool &local()
+    {
+        alignas(Slot_Pool) static thread_local char storage[sizeof(Slot_Pool)];
+        static thread_local Slot_Pool *pool = nullptr;
+        if (pool == nullptr)
+        {
+            pool = new (storage) Slot_Pool{};
+
+            // registers the pool to be given away when the thread exits
+            static thread_local Pool_Exit pool_exit{pool};
+        }
+        return *pool;
+    }
+
+    /**
+     * Pops a slot from the free list, creating a new slab if it is empty.
+     *
+     * @return a pointer to the slot, or nullptr if out of memory.
+     */
+    void *allocate()
+    {
+        if (m_free == nullptr && !grow())
+        {
+            return nullptr;
+        }
+
+        auto slot = m_free;
+        m_free = slot->next;
+        return slot;
+    }
+
+    /**
+     * Pushes a slot on the free list.
+     *
+     * @param pointer the slot being freed.
+     */
+    void deallocate(void *pointer)
+    {
+        auto slot = static_cast<Slot *>(pointer);
+
+        // the thread is exiting, the slot is kept for the next pool created
+        if (m_exited)
+        {
+            std::lock_guard<std::mutex> lock{orphan_mutex};
+            slot->next = orphans;
+            orphans = slot;
+            return;
+        }
+
+        slot->next = m_free;
+        m_free = slot;
+    }
+
+    Slot_Pool(const Slot_Pool &) = delete;
+    Slot_Pool &operator=(const Slot_Pool &) = delete;
+
+private:
+    /**
+     * A free slot, holding the link to the next free slot.
+     */
+    struct Slot
+    {
+        Slot *next;
+    };
+
+    /**
+     * Gives the pool of a thread away when the thread exits.
+     */
+    class Pool_Exit
+    {
+    public:
+        explicit Pool_Exit(Slot_Pool *pool) : m_pool{pool}
+        {
+        }
+
+        ~Pool_Exit()
+        {
+            m_pool->release();
+        }
+
+    private:
+        Slot_Pool *m_pool;
+    };
+
+    /**
+     * Gives the free slots of an exiting thread to the next pool created.
+     */
+    void release()
+    {
+        m_exited = true;
+        if (m_free == nullptr)
+        {
+            return;
+        }
+
+        auto last = m_free;
+        while (last->next != nullptr)
+        {
+            last = last->next;
+        }
+
+        std::lock_guard<std::mutex> lock{orphan_mutex};
+        last->next = orphans;
+        orphans = m_free;
+        m_free = nullptr;
+    }
+
+    /**
+     * Takes the free slots left by exited threads.
+     */
+    Slot_Pool()
+    {
+        std::lock_guard<std::mutex> lock{orphan_mutex};
+        m_free = orphans;
+        orphans = nullptr;
+    }
+
+    /**
+     * Gets a new slab from the Central_Heap and threads all of its slots in the free list.
+     *
+     * @return false if out of memory.
+     */
+    bool grow()
+    {
+        auto slab = reinterpret_cast<char *>(Central_Heap::instance().alloc(SlotSize * BlockCount));
+        if (slab == nullptr)
+        {
+            return false;
+        }
+
+        // links the slots from the last to the first, so they are handed out in address order
+        for (std::size_t i = BlockCount; i-- > 0;)
+        {
+            deallocate(slab + i * SlotSize);
+        }
+        return true;
+    }
+
+    /**
+     * the first free slot.
+     */
+    Slot *m_free{nullptr};
+
+    /**
+     * set once the thread has exited and its free slots were given away.
+     */
+    bool m_exited{false};
+
+    /**
+     * free slots left by exited threads, and the lock protecting them.
+     */
+    static inline Slot *orphans = nullptr;
+    static inline std::mutex orphan_mutex{};
+};
+
+/**
+ * A fixed size object pool allocator for node based containers (std::list, std::map, std::set...).
+ *
+ * These containers allocate their nodes one at a time, which is what the pool is made for: a single object comes from
+ * a Slot_Pool in O(1), with no header. Anything else (an array, which node containers never ask for) goes through
+ * the global operator new.
+ *
+ * The allocator is stateless: all the pool_allocators with the same slot size share the pool of the thread, so they
+ * all compare equal and any of them can free what another one allocated.
+ *
+ * @tparam T the type of object allocated.
+ * @tparam BlockCount the number of objects in a slab.
+ */
+template <typename T, std::size_t BlockCount = 1024>
+class pool_allocator
+{
+public:
+    // Type aliases required for standard allocator interface.
+    using value_type = T;
+    using pointer = T *;
+    using const_pointer = const T *;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using is_always_equal = std::true_type;
+
+    static_assert(alignof(T) <= alignof(intptr_t), "the pool only guarantees the alignment of intptr_t");
+
+    pool_allocator() noexcept = default;
+
+    // Copy constructor template to allow conversion between different allocator types.
+    template <typename U>
+    pool_allocator(const pool_allocator<U, BlockCount> &) noexcept {}
+
+    // Allocates one object from the pool, or an array with operator new.
+    T *allocate(std::size_t n)
+    {
+        if (n != 1)
+        {
+            return static_cast<T *>(::operator new(n * sizeof(T)));
+        }
+
+        auto slot = pool::local().allocate();
+        if (slot == nullptr)
+        {
+            throw std::bad_alloc{};
+        }
+        return static_cast<T *>(slot);
+    }
+
+    // Gives the object back to the pool, the size tells whether it came from the pool.
+    void deallocate(T *data, std::size_t n) noexcept
+    {
+        if (n != 1)
+        {
+            ::operator delete(data);
+            return;
+        }
+        pool::local().deallocate(data);
+    }
+
+    // Rebind struct to allow the allocator to allocate memory for a different type U.
+    template <typename U>
+    struct rebind
+    {
+        using other = pool_allocator<U, BlockCount>;
+    };
+
+    template <typename U>
+    bool operator==(const pool_allocator<U, BlockCount> &) const noexcept { return true; }
+
+    template <typename U>
+    bool operator!=(const pool_allocator<U, BlockCount> &) const noexcept { return false; }
+
+private:
+    /**
+     * the size of a slot, big enough for a T or a free list link, and a multiple of the alignment of T.
+     */
+    static constexpr std::size_t slot_size = (std::max(sizeof(T), sizeof(void *)) + alignof(T) - 1) / alignof(T) * alignof(T);
+
+    using pool = Slot_Pool<slot_size, BlockCount>;
+};
+
+#endif //POOL_ALLOCATOR_H
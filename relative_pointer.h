@@ -0,0 +1,86 @@
+#ifndef RELATIVE_POINTER_H
+#define RELATIVE_POINTER_H
+
+#include <cstdint>
+
+/**
+ * A pointer that holds the distance from itself to the object it points to, instead of its address.
+ *
+ * An object of a file heap (see Memory_Linked_List::open_file()) pointing to another object of the same heap moves
+ * with it when the file is mapped at another address, so a Relative_Pointer stored in the heap stays right where a
+ * plain pointer would point to the old address. A distance of 0 stands for nullptr, a Relative_Pointer can not point
+ * to itself.
+ *
+ * Copying one computes the distance again from the copy, so they can be copied in and out of the heap like pointers.
+ */
+template <typename T>
+class Relative_Pointer
+{
+public:
+    Relative_Pointer() : m_offset{0}
+    {
+    }
+
+    Relative_Pointer(T *pointer)
+    {
+        set(pointer);
+    }
+
+    Relative_Pointer(const Relative_Pointer &other)
+    {
+        set(other.get());
+    }
+
+    Relative_Pointer &operator=(const Relative_Pointer &other)
+    {
+        set(other.get());
+        return *this;
+    }
+
+    Relative_Pointer &operator=(T *pointer)
+    {
+        set(pointer);
+        return *this;
+    }
+
+    /**
+     * Returns the object pointed to, at the address it has in this run.
+     */
+    T *get() const
+    {
+        if (m_offset == 0)
+        {
+            return nullptr;
+        }
+        return reinterpret_cast<T *>(reinterpret_cast<std::uintptr_t>(this) + m_offset);
+    }
+
+    T &operator*() const
+    {
+        return *get();
+    }
+
+    T *operator->() const
+    {
+        return get();
+    }
+
+    explicit operator bool() const
+    {
+        return m_offset != 0;
+    }
+
+private:
+    void set(T *pointer)
+    {
+        m_offset = pointer == nullptr ? 0 : reinterpret_cast<std::uintptr_t>(pointer) -
+                                                reinterpret_cast<std::uintptr_t>(this);
+    }
+
+    /**
+     * the address of the object less the address of this pointer, wrapping around, 0 for nullptr.
+     */
+    std::uintptr_t m_offset;
+};
+
+#endif //RELATIVE_POINTER_H
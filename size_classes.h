@@ -0,0 +1,149 @@
+#ifndef SIZE_CLASSES_H
+#define SIZE_CLASSES_H
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * The sizes that allocations are rounded up to.
+ *
+ * Rounding to powers of two wastes up to half of every block (1025 bytes take 2048). Instead, every power of two is
+ * split in steps_per_doubling steps of a quarter of it: 8, 16, 24, ..., 64 then 80, 96, 112, 128, 160, 192, ... Each
+ * class is at most 1.25 times the one before, so at most 20% of a block is lost to rounding.
+ *
+ * The tables are built at compile time. Sizes up to lookup_limit, the most common ones, find their class with a single
+ * table load, bigger ones with a few bit operations.
+ */
+class Size_Classes
+{
+public:
+    /**
+     * number of classes between two powers of two.
+     */
+    static constexpr std::size_t steps_per_doubling = 4;
+
+    /**
+     * number of classes, from 8 bytes up to max_size.
+     */
+    static constexpr std::size_t count = 64;
+
+    /**
+     * size of the biggest class, 1 MiB.
+     */
+    static constexpr std::size_t max_size = std::size_t{1} << 20;
+
+    /**
+     * sizes up to this are looked up in a table.
+     */
+    static constexpr std::size_t lookup_limit = 4096;
+
+    /**
+     * Returns the size of a class.
+     *
+     * @param index a class, less than count.
+     */
+    static constexpr std::size_t size(std::size_t index)
+    {
+        return s_sizes[index];
+    }
+
+    /**
+     * Returns the smallest class a size fits in.
+     *
+     * @param size a number of bytes, at most max_size.
+     * @return the index of the class.
+     */
+    static constexpr std::size_t index(std::size_t size)
+    {
+        if (size <= lookup_limit)
+        {
+            return s_lookup[(size + 7) >> 3];
+        }
+        return computed_index(size);
+    }
+
+    /**
+     * Rounds a size up to its class. Sizes bigger than max_size keep being rounded to a quarter of their power of two.
+     * The rounding of a size close to SIZE_MAX wraps around, Memory_Linked_List refuses such sizes before rounding
+     * them (see Memory_Linked_List::max_alloc_size).
+     *
+     * @param size a number of bytes, at most PTRDIFF_MAX.
+     * @return the rounded size, at least 8.
+     */
+    static constexpr std::size_t round(std::size_t size)
+    {
+        if (size <= max_size)
+        {
+            return s_sizes[index(size)];
+        }
+        auto step = std::size_t{1} << (std::bit_width(size - 1) - 3);
+        return (size + step - 1) & ~(step - 1);
+    }
+
+private:
+    /**
+     * Returns the class of a size bigger than 64 bytes. With 2^(k-1) < size <= 2^k, the class is one of the 4 steps
+     * after 2^(k-1), and the 8 classes up to 64 bytes come before the steps of 2^7.
+     */
+    static constexpr std::size_t computed_index(std::size_t size)
+    {
+        auto k = static_cast<std::size_t>(std::bit_width(size - 1));
+        auto step = ((size - 1) >> (k - 3)) - 3;
+        return 7 + (k - 7) * steps_per_doubling + step;
+    }
+
+    static constexpr std::array<std::size_t, count> make_sizes()
+    {
+        std::array<std::size_t, count> sizes{};
+
+        // every multiple of 8 up to 64, then the steps of a quarter of every power of two
+        for (std::size_t i = 0; i < 8; i++)
+        {
+            sizes[i] = 8 * (i + 1);
+        }
+        for (std::size_t i = 8; i < count; i++)
+        {
+            auto power = std::size_t{64} << ((i - 8) / steps_per_doubling);
+            sizes[i] = power + (power / steps_per_doubling) * ((i - 8) % steps_per_doubling + 1);
+        }
+        return sizes;
+    }
+
+    static constexpr std::array<std::uint8_t, lookup_limit / 8 + 1> make_lookup()
+    {
+        std::array<std::uint8_t, lookup_limit / 8 + 1> lookup{};
+
+        // entry n is the class of the sizes from 8n - 7 to 8n, 0 also goes in the first class
+        std::size_t index = 0;
+        for (std::size_t n = 0; n < lookup.size(); n++)
+        {
+            while (s_sizes[index] < 8 * n)
+            {
+                index++;
+            }
+            lookup[n] = static_cast<std::uint8_t>(index);
+        }
+        return lookup;
+    }
+
+    /**
+     * the size of every class, and the class of every multiple of 8 up to lookup_limit. Defined after the class, as
+     * they are built by its functions.
+     */
+    static const std::array<std::size_t, count> s_sizes;
+    static const std::array<std::uint8_t, lookup_limit / 8 + 1> s_lookup;
+};
+
+inline constexpr std::array<std::size_t, Size_Classes::count> Size_Classes::s_sizes = Size_Classes::make_sizes();
+inline constexpr std::array<std::uint8_t, Size_Classes::lookup_limit / 8 + 1> Size_Classes::s_lookup =
+    Size_Classes::make_lookup();
+
+static_assert(Size_Classes::size(Size_Classes::count - 1) == Size_Classes::max_size, "the last class is max_size");
+static_assert(Size_Classes::index(1025) == Size_Classes::index(1280) && Size_Classes::round(1025) == 1280,
+              "1025 bytes take 1280");
+static_assert(Size_Classes::index(Size_Classes::lookup_limit + 1) == Size_Classes::index(Size_Classes::lookup_limit) + 1,
+              "the table and the computed classes agree");
+
+#endif //SIZE_CLASSES_H
@@ -0,0 +1,588 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "thread_cache.h"
+
+/**
+ * The cache of the calling thread. A plain pointer, so reading it needs no initialisation check.
+ */
+static thread_local Thread_Cache *tls_cache = nullptr;
+
+/**
+ * Gives the cache of a thread back to the Central_Heap when the thread exits.
+ */
+class Thread_Exit
+{
+public:
+    ~Thread_Exit()
+    {
+        if (tls_cache != nullptr)
+        {
+            tls_cache->flush();
+            Central_Heap::instance().abandon(tls_cache);
+
+            // blocks freed later by this thread go through the remote free queue
+            tls_cache = nullptr;
+        }
+    }
+};
+
+/**
+ * Dumps the statistics when the process exits, if asked for by ALLOCATOR_STATS.
+ */
+static void dump_stats_at_exit()
+{
+    auto format = std::getenv("ALLOCATOR_STATS");
+    Central_Heap::instance().dump_stats(std::strcmp(format, "json") == 0);
+}
+
+Central_Heap::Central_Heap() : m_orphans{nullptr},
+                               m_caches{nullptr},
+                               m_tiny_bump{},
+                               m_tiny_end{},
+                               m_tiny_free{},
+                               m_tiny_bytes{0}
+{
+    // every refill asks for blocks of a single size, which the segregated bins serve in O(1)
+    m_heap.set_search_mode(Memory_Linked_List::search_mode::segregated);
+
+    // the tiny ranges only take memory once touched, tiny blocks come with a header if they can not be reserved
+    auto size = tiny_class_count << tiny_range_shift;
+    auto range = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (range != MAP_FAILED)
+    {
+        for (std::size_t i = 0; i < tiny_class_count; i++)
+        {
+            m_tiny_bump[i] = static_cast<char *>(range) + (i << tiny_range_shift);
+            m_tiny_end[i] = m_tiny_bump[i] + (std::size_t{1} << tiny_range_shift);
+        }
+        s_tiny_base = reinterpret_cast<std::uintptr_t>(range);
+        s_tiny_size = size;
+    }
+
+    if (std::getenv("ALLOCATOR_STATS") != nullptr)
+    {
+        std::atexit(dump_stats_at_exit);
+    }
+    pthread_atfork(prepare_fork, after_fork, after_fork);
+}
+
+Central_Heap &Central_Heap::instance()
+{
+    // never destroyed: its heap unmaps everything when destroyed, and blocks are still freed after exit() runs the
+    // destructors of static objects
+    alignas(Central_Heap) static char storage[sizeof(Central_Heap)];
+    static auto heap = new (storage) Central_Heap{};
+    return *heap;
+}
+
+intptr_t *Central_Heap::alloc(std::size_t size)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_heap.alloc(size);
+}
+
+void Central_Heap::free(intptr_t *data)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_heap.free(data);
+}
+
+intptr_t *Central_Heap::alloc_aligned(std::size_t size, std::size_t alignment, std::size_t offset)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_heap.alloc_aligned(size, alignment, offset);
+}
+
+intptr_t *Central_Heap::reallocate(intptr_t *data, std::size_t size)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_heap.reallocate(data, size);
+}
+
+std::size_t Central_Heap::trim()
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_heap.trim();
+}
+
+std::size_t Central_Heap::alloc_batch(std::size_t size, std::size_t count, intptr_t **out)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_heap.alloc_batch(size, count, out);
+}
+
+std::size_t Central_Heap::alloc_tiny_batch(std::size_t size_class, std::size_t count, Block **out)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    auto size = Size_Classes::size(size_class);
+
+    // blocks given back first, then new ones from the range of the class
+    std::size_t i = 0;
+    for (; i < count && m_tiny_free[size_class] != nullptr; i++)
+    {
+        out[i] = m_tiny_free[size_class];
+        m_tiny_free[size_class] = Block::next(out[i]);
+    }
+    for (; i < count && m_tiny_end[size_class] - m_tiny_bump[size_class] >= static_cast<std::ptrdiff_t>(size); i++)
+    {
+        out[i] = reinterpret_cast<Block *>(m_tiny_bump[size_class]) - 1;
+        m_tiny_bump[size_class] += size;
+        m_tiny_bytes += size;
+    }
+    return i;
+}
+
+void Central_Heap::free_batch(Block *first, std::size_t count, std::size_t size_class)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    // tiny blocks are never given back to the heap, the list is put in front of the blocks kept for other caches
+    if (size_class < tiny_class_count)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        auto last = first;
+        for (std::size_t i = 1; i < count; i++)
+        {
+            last = Block::next(last);
+        }
+        Block::next(last) = m_tiny_free[size_class];
+        m_tiny_free[size_class] = first;
+        return;
+    }
+
+    // the links are read before the frees overwrite the payloads, up to a batch at a time as a flush may free more
+    intptr_t *data[Thread_Cache::batch_size];
+    auto block = first;
+    while (count != 0)
+    {
+        auto length = std::min(count, Thread_Cache::batch_size);
+        for (std::size_t i = 0; i < length; i++)
+        {
+            data[i] = Block::data(block);
+            block = Block::next(block);
+        }
+        m_heap.free_batch(data, length);
+        count -= length;
+    }
+}
+
+Thread_Cache *Central_Heap::adopt()
+{
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+
+        // reuses the cache of an exited thread
+        if (m_orphans != nullptr)
+        {
+            auto cache = m_orphans;
+            m_orphans = cache->m_next_orphan;
+            return cache;
+        }
+    }
+
+    // thread caches are never freed, so they are allocated from the heap itself
+    auto memory = alloc(sizeof(Thread_Cache));
+    if (memory == nullptr)
+    {
+        return nullptr;
+    }
+    auto cache = new (memory) Thread_Cache{};
+
+    std::lock_guard<std::mutex> lock{m_mutex};
+    cache->m_next_cache = m_caches;
+    m_caches = cache;
+    return cache;
+}
+
+void Central_Heap::abandon(Thread_Cache *cache)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    cache->m_next_orphan = m_orphans;
+    m_orphans = cache;
+}
+
+Allocator_Stats Central_Heap::get_stats()
+{
+    Allocator_Stats stats;
+    Thread_Cache *caches;
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        stats = m_heap.get_stats();
+        caches = m_caches;
+
+        // tiny blocks are never given back, so they stay live and mapped, like blocks held by the caches
+        stats.live_bytes += m_tiny_bytes;
+        stats.peak_bytes += m_tiny_bytes;
+        stats.mapped_bytes += m_tiny_bytes;
+    }
+
+    // caches are never destroyed and only added at the front, so the list can be read without the lock
+    for (auto cache = caches; cache != nullptr; cache = cache->m_next_cache)
+    {
+        for (std::size_t i = 0; i < Thread_Cache::class_count; i++)
+        {
+            auto size_class = Allocator_Stats::class_of(Size_Classes::size(i));
+            stats.cache_hits[size_class] += cache->m_hits[i].load(std::memory_order_relaxed);
+            stats.cache_misses[size_class] += cache->m_misses[i].load(std::memory_order_relaxed);
+        }
+        stats.remote_frees += cache->m_remote_free_count.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+void Central_Heap::dump_stats(bool json)
+{
+    auto stats = get_stats();
+    if (json)
+        std::cerr << stats.to_json() << std::endl;
+    else
+        std::cerr << stats.to_text();
+}
+
+void Central_Heap::prepare_fork()
+{
+    instance().m_mutex.lock();
+}
+
+void Central_Heap::after_fork()
+{
+    // the thread that called fork() holds the lock, in the parent and in the child
+    instance().m_mutex.unlock();
+}
+
+Thread_Cache::Thread_Cache() : m_free{},
+                               m_count{},
+                               m_remote_frees{nullptr},
+                               m_next_orphan{nullptr},
+                               m_next_cache{nullptr},
+                               m_hits{},
+                               m_misses{},
+                               m_remote_free_count{0}
+{
+}
+
+void *Thread_Cache::allocate(std::size_t size)
+{
+    // large blocks go straight to the central heap, with room for the header
+    if (size > max_class_size)
+    {
+        if (size > SIZE_MAX - sizeof(Block) - Block::padding)
+        {
+            return nullptr;
+        }
+        auto data = Central_Heap::instance().alloc(sizeof(Block) + Block::padding + size);
+        if (data == nullptr)
+        {
+            return nullptr;
+        }
+        auto block = Block::place(data);
+        block->owner = nullptr;
+        block->size_class = large_class;
+        return block + 1;
+    }
+
+    auto cache = current();
+    if (cache == nullptr)
+    {
+        return nullptr;
+    }
+
+    // slow path, the free list is empty
+    auto size_class = class_of(size);
+    if (cache->m_free[size_class] == nullptr)
+    {
+        count(cache->m_misses[size_class]);
+        if (!cache->refill(size_class))
+        {
+            return nullptr;
+        }
+    }
+    else
+    {
+        count(cache->m_hits[size_class]);
+    }
+
+    // fast path, pops the first block of the free list
+    auto block = cache->m_free[size_class];
+    cache->m_free[size_class] = Block::next(block);
+    cache->m_count[size_class]--;
+    return block + 1;
+}
+
+void *Thread_Cache::allocate_aligned(std::size_t size, std::size_t alignment)
+{
+    if (alignment <= alignof(Block))
+    {
+        return allocate(size);
+    }
+
+    // the header goes right before the aligned memory
+    if (size > SIZE_MAX - sizeof(Block))
+    {
+        return nullptr;
+    }
+    // the memory is aligned on more than 16 bytes, so the Block needs no padding
+    auto data = Central_Heap::instance().alloc_aligned(sizeof(Block) + size, alignment, sizeof(Block));
+    if (data == nullptr)
+    {
+        return nullptr;
+    }
+    auto block = Block::place(data);
+    block->owner = nullptr;
+    block->size_class = large_class;
+    return block + 1;
+}
+
+void Thread_Cache::deallocate(void *pointer)
+{
+    if (pointer == nullptr)
+    {
+        return;
+    }
+
+    release(static_cast<Block *>(pointer) - 1, class_of_block(pointer));
+}
+
+void Thread_Cache::deallocate(void *pointer, std::size_t size)
+{
+    if (pointer == nullptr)
+    {
+        return;
+    }
+
+    // allocate() picked the class from the same size
+    release(static_cast<Block *>(pointer) - 1, size > max_class_size ? large_class : class_of(size));
+}
+
+void *Thread_Cache::reallocate(void *pointer, std::size_t size)
+{
+    if (pointer == nullptr)
+    {
+        return allocate(size);
+    }
+
+    auto block = static_cast<Block *>(pointer) - 1;
+    auto large = class_of_block(pointer) == large_class;
+
+    // still fits the size class
+    if (!large && size <= usable_size(pointer))
+    {
+        return pointer;
+    }
+
+    // stays large, the header moves along with the data
+    if (large && size > max_class_size)
+    {
+        if (size > SIZE_MAX - sizeof(Block) - Block::padding)
+        {
+            return nullptr;
+        }
+        auto offset = block->offset;
+        auto data = Central_Heap::instance().reallocate(Block::data(block), sizeof(Block) + Block::padding + size);
+        if (data == nullptr)
+        {
+            return nullptr;
+        }
+
+        // memory that moved may need the other padding, the header and the data are moved along
+        auto moved = reinterpret_cast<char *>(data) + offset;
+        auto resized = Block::boundary(data);
+        if (reinterpret_cast<char *>(resized) != moved)
+        {
+            std::memmove(resized, moved, sizeof(Block) + size);
+            Block::place(data);
+        }
+        return resized + 1;
+    }
+
+    // changes between a size class and the Central_Heap, or to a bigger class
+    auto moved = allocate(size);
+    if (moved != nullptr)
+    {
+        std::memcpy(moved, pointer, std::min(size, usable_size(pointer)));
+        deallocate(pointer);
+    }
+    return moved;
+}
+
+std::size_t Thread_Cache::usable_size(void *pointer)
+{
+    auto block = static_cast<Block *>(pointer) - 1;
+    auto size_class = class_of_block(pointer);
+
+    // large blocks use their whole Chunk
+    if (size_class == large_class)
+    {
+        return Memory_Linked_List::get_header(Block::data(block))->size - block->offset - sizeof(Block);
+    }
+    return Size_Classes::size(size_class);
+}
+
+std::size_t Thread_Cache::class_of_block(void *pointer)
+{
+    if (Central_Heap::is_tiny(pointer))
+    {
+        return Central_Heap::tiny_class_of(pointer);
+    }
+    return (static_cast<Block *>(pointer) - 1)->size_class;
+}
+
+void Thread_Cache::release(Block *block, std::size_t size_class)
+{
+    // large blocks go straight back to the central heap
+    if (size_class == large_class)
+    {
+        Central_Heap::instance().free(Block::data(block));
+        return;
+    }
+
+    // tiny blocks have no owner, they are kept by the thread freeing them, or by the central heap once it has exited
+    if (size_class < Central_Heap::tiny_class_count && tls_cache == nullptr)
+    {
+        Central_Heap::instance().free_batch(block, 1, size_class);
+        return;
+    }
+    auto cache = size_class < Central_Heap::tiny_class_count ? tls_cache : block->owner;
+
+    // the block belongs to another thread, it is sent back to its owner
+    if (cache != tls_cache)
+    {
+        cache->remote_free(block);
+        return;
+    }
+
+    // fast path, pushes the block on its free list
+    Block::next(block) = cache->m_free[size_class];
+    cache->m_free[size_class] = block;
+
+    // gives some blocks back when the list gets too long
+    if (++cache->m_count[size_class] > max_cached)
+    {
+        cache->drain(size_class);
+    }
+}
+
+Thread_Cache *Thread_Cache::current()
+{
+    if (tls_cache == nullptr)
+    {
+        // registers the cache to be given back when the thread exits
+        static thread_local Thread_Exit thread_exit{};
+        tls_cache = Central_Heap::instance().adopt();
+    }
+    return tls_cache;
+}
+
+std::size_t Thread_Cache::class_of(std::size_t size)
+{
+    // a table lookup for the sizes of the thread caches, in steps of 16 bytes so every block is aligned on 16 bytes
+    return Size_Classes::index((std::max<std::size_t>(size, 1) + 15) & ~std::size_t{15});
+}
+
+bool Thread_Cache::refill(std::size_t size_class)
+{
+    // blocks freed by other threads are free already, so they are used first
+    collect_remote_frees();
+    if (m_free[size_class] != nullptr)
+    {
+        return true;
+    }
+
+    // tiny blocks need no header, they are linked as they are
+    if (size_class < Central_Heap::tiny_class_count)
+    {
+        Block *tiny[batch_size];
+        auto count = Central_Heap::instance().alloc_tiny_batch(size_class, batch_size, tiny);
+        for (std::size_t i = 0; i < count; i++)
+        {
+            Block::next(tiny[i]) = m_free[size_class];
+            m_free[size_class] = tiny[i];
+        }
+        m_count[size_class] += count;
+
+        // the range of the class is used up, blocks with a header are used instead
+        if (count != 0)
+        {
+            return true;
+        }
+    }
+
+    intptr_t *batch[batch_size];
+    auto block_size = sizeof(Block) + Block::padding + Size_Classes::size(size_class);
+    auto count = Central_Heap::instance().alloc_batch(block_size, batch_size, batch);
+
+    // links the new blocks in the free list, they belong to this cache from now on
+    for (std::size_t i = 0; i < count; i++)
+    {
+        auto block = Block::place(batch[i]);
+        block->owner = this;
+        block->size_class = size_class;
+        Block::next(block) = m_free[size_class];
+        m_free[size_class] = block;
+    }
+    m_count[size_class] += count;
+
+    return count != 0;
+}
+
+void Thread_Cache::drain(std::size_t size_class)
+{
+    // cuts the first batch_size blocks off the free list
+    auto first = m_free[size_class];
+    auto last = first;
+    for (std::size_t i = 1; i < batch_size; i++)
+    {
+        last = Block::next(last);
+    }
+    m_free[size_class] = Block::next(last);
+    m_count[size_class] -= batch_size;
+
+    Central_Heap::instance().free_batch(first, batch_size, size_class);
+}
+
+void Thread_Cache::collect_remote_frees()
+{
+    // takes the whole queue at once, so the producers never see a half emptied list
+    auto block = m_remote_frees.exchange(nullptr, std::memory_order_acquire);
+
+    while (block != nullptr)
+    {
+        auto next = Block::next(block);
+        Block::next(block) = m_free[block->size_class];
+        m_free[block->size_class] = block;
+        m_count[block->size_class]++;
+        block = next;
+    }
+}
+
+void Thread_Cache::remote_free(Block *block)
+{
+    m_remote_free_count.fetch_add(1, std::memory_order_relaxed);
+
+    // Treiber stack push, retried until no other thread pushed in between
+    auto top = m_remote_frees.load(std::memory_order_relaxed);
+    do
+    {
+        Block::next(block) = top;
+    } while (!m_remote_frees.compare_exchange_weak(top, block, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void Thread_Cache::flush()
+{
+    collect_remote_frees();
+
+    for (std::size_t size_class = 0; size_class < class_count; size_class++)
+    {
+        Central_Heap::instance().free_batch(m_free[size_class], m_count[size_class], size_class);
+        m_free[size_class] = nullptr;
+        m_count[size_class] = 0;
+    }
+}
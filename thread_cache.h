@@ -0,0 +1,489 @@
+#ifndef THREAD_CACHE_H
+#define THREAD_CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include "allocator.h"
+
+class Thread_Cache;
+
+/**
+ * Block is the header put in front of every block handed out by the thread caches.
+ *
+ * It remembers which Thread_Cache the block belongs to, so a block freed by another thread can be sent back to its
+ * owner, and its size class, so it can go back to the right free list without asking the Memory_Linked_List.
+ *
+ * Blocks are aligned on 16 bytes, the alignment of operator new and malloc. The Memory_Linked_List only aligns on 8
+ * bytes, so every block asks it for padding more bytes, and the Block goes on the first 16 byte boundary.
+ *
+ * Blocks of the tiny classes have no header, see Central_Heap::is_tiny(). They are still handled through a Block
+ * pointer right before them, so the free lists treat every class the same, but its fields are never read or written.
+ */
+class alignas(16) Block
+{
+public:
+    /**
+     * the Thread_Cache that owns the block, nullptr for large blocks that come straight from the Central_Heap.
+     */
+    Thread_Cache *owner;
+
+    /**
+     * index of the size class of the block.
+     */
+    std::uint32_t size_class;
+
+    /**
+     * bytes between the memory from the Memory_Linked_List and the Block, 0 or 8.
+     */
+    std::uint32_t offset;
+
+    /**
+     * bytes asked for on top of the header, to move the Block on 16 bytes.
+     */
+    static constexpr std::size_t padding = 8;
+
+    /**
+     * Returns the link to the next block of a free list, stored in the payload since the block is free.
+     *
+     * @param block a free block.
+     * @return a reference to the link.
+     */
+    static Block *&next(Block *block)
+    {
+        return *reinterpret_cast<Block **>(block + 1);
+    }
+
+    /**
+     * Returns where the Block of memory from the Memory_Linked_List goes, its first 16 byte boundary.
+     */
+    static Block *boundary(intptr_t *data)
+    {
+        return reinterpret_cast<Block *>((reinterpret_cast<std::uintptr_t>(data) + 15) & ~std::uintptr_t{15});
+    }
+
+    /**
+     * Puts a Block on the first 16 byte boundary of memory from the Memory_Linked_List.
+     *
+     * @param data memory of at least sizeof(Block) + padding bytes.
+     * @return the Block, with its offset set.
+     */
+    static Block *place(intptr_t *data)
+    {
+        auto block = boundary(data);
+        block->offset = reinterpret_cast<char *>(block) - reinterpret_cast<char *>(data);
+        return block;
+    }
+
+    /**
+     * Returns the memory from the Memory_Linked_List a Block was put in, to free it.
+     */
+    static intptr_t *data(Block *block)
+    {
+        return reinterpret_cast<intptr_t *>(reinterpret_cast<char *>(block) - block->offset);
+    }
+};
+/**
+ * The Central_Heap is a single Memory_Linked_List shared by every thread, protected by a mutex.
+ *
+ * Thread caches only go to it when their own free lists are empty or too long, and then they move a whole batch of
+ * blocks under a single lock. Large blocks skip the thread caches and are allocated here directly.
+ *
+ * Blocks of the tiny classes, where a header would cost as much as the block, are not taken from the
+ * Memory_Linked_List. Every tiny class has a range of address space of its own, reserved at once and only backed by
+ * memory once touched, that is carved with a bump pointer. The class of a block is found from its address, so it
+ * needs no header.
+ */
+class Central_Heap
+{
+public:
+    /**
+     * number of tiny classes, 8, 16, 24 and 32 bytes. Only 16 and 32 get blocks, as blocks are aligned on 16 bytes, so
+     * the ranges of 8 and 24 are reserved but never touched.
+     */
+    static constexpr std::size_t tiny_class_count = 4;
+
+    /**
+     * each tiny class has 2^tiny_range_shift = 256 MiB of address space. Once it is used up, the blocks of the class
+     * come with a header again.
+     */
+    static constexpr std::size_t tiny_range_shift = 28;
+
+    /**
+     * Returns whether memory is a block of a tiny class, with no header.
+     */
+    static bool is_tiny(const void *pointer)
+    {
+        return reinterpret_cast<std::uintptr_t>(pointer) - s_tiny_base < s_tiny_size;
+    }
+
+    /**
+     * Returns the size class of a tiny block.
+     *
+     * @param pointer memory for which is_tiny() is true.
+     */
+    static std::size_t tiny_class_of(const void *pointer)
+    {
+        return (reinterpret_cast<std::uintptr_t>(pointer) - s_tiny_base) >> tiny_range_shift;
+    }
+
+    /**
+     * Returns the heap shared by the whole process, created on first use and never destroyed.
+     */
+    static Central_Heap &instance();
+
+    /**
+     * Allocates one block under the lock.
+     *
+     * @param size the number of bytes needed.
+     * @return a pointer to the memory, or nullptr if out of memory.
+     */
+    intptr_t *alloc(std::size_t size);
+
+    /**
+     * Frees one block under the lock.
+     *
+     * @param data the block being freed.
+     */
+    void free(intptr_t *data);
+
+    /**
+     * Allocates one aligned block under the lock, see Memory_Linked_List::alloc_aligned().
+     */
+    intptr_t *alloc_aligned(std::size_t size, std::size_t alignment, std::size_t offset);
+
+    /**
+     * Resizes one block under the lock, see Memory_Linked_List::reallocate().
+     *
+     * @param data the block being resized.
+     * @param size the new number of bytes.
+     * @return a pointer to the block, or nullptr if out of memory.
+     */
+    intptr_t *reallocate(intptr_t *data, std::size_t size);
+
+    /**
+     * Gives the free memory of the shared heap back to the OS under the lock, see Memory_Linked_List::trim(). Blocks
+     * held by the thread caches and tiny blocks are not free there, so they stay.
+     *
+     * @return the number of bytes given back.
+     */
+    std::size_t trim();
+
+    /**
+     * Allocates count blocks of the same size under a single lock, see Memory_Linked_List::alloc_batch().
+     *
+     * @param size the number of bytes of each block.
+     * @param count the number of blocks wanted.
+     * @param out where the pointers to the blocks are written.
+     * @return the number of blocks allocated, less than count if out of memory.
+     */
+    std::size_t alloc_batch(std::size_t size, std::size_t count, intptr_t **out);
+
+    /**
+     * Takes count blocks of a tiny class under a single lock, first from the ones given back by the thread caches,
+     * then from the range of the class.
+     *
+     * @param size_class a tiny class.
+     * @param count the number of blocks wanted.
+     * @param out where the blocks are written, as a Block pointer right before each of them.
+     * @return the number of blocks taken, less than count once the range is used up.
+     */
+    std::size_t alloc_tiny_batch(std::size_t size_class, std::size_t count, Block **out);
+
+    /**
+     * Frees a linked list of blocks of the same class under a single lock, see Memory_Linked_List::free_batch().
+     * Blocks of the tiny classes are kept for other thread caches instead.
+     *
+     * @param first the first block, the blocks are linked with Block::next.
+     * @param count the number of blocks in the list.
+     * @param size_class the class of the blocks.
+     */
+    void free_batch(Block *first, std::size_t count, std::size_t size_class);
+
+    /**
+     * Gives a Thread_Cache to a new thread, reusing one left by a thread that exited if there is one.
+     */
+    Thread_Cache *adopt();
+
+    /**
+     * Keeps the Thread_Cache of an exiting thread for the next thread. Thread caches are never destroyed, as other
+     * threads may still send blocks back to them.
+     *
+     * @param cache the cache of the exiting thread, already flushed.
+     */
+    void abandon(Thread_Cache *cache);
+
+    /**
+     * Returns a snapshot of the whole process: the counters of the shared heap plus the hits, misses and remote frees
+     * of every thread cache. The caches are read with relaxed loads, so the snapshot is only roughly consistent.
+     */
+    Allocator_Stats get_stats();
+
+    /**
+     * Writes get_stats() to stderr, as JSON if json is set, as text otherwise. Setting the ALLOCATOR_STATS environment
+     * variable to json or text calls it when the process exits.
+     *
+     * @param json the format of the dump.
+     */
+    void dump_stats(bool json);
+
+    /**
+     * Fork handlers, registered with pthread_atfork. The heap is locked around fork(), so the child never inherits it
+     * locked by a thread that does not exist there. The caches of the other threads are lost in the child, along with
+     * the blocks they hold.
+     */
+    static void prepare_fork();
+    static void after_fork();
+
+private:
+    Central_Heap();
+
+    /**
+     * protects everything below.
+     */
+    std::mutex m_mutex;
+
+    /**
+     * the heap shared by all threads.
+     */
+    Memory_Linked_List m_heap;
+
+    /**
+     * thread caches left by threads that exited, linked through Thread_Cache::m_next_orphan.
+     */
+    Thread_Cache *m_orphans;
+
+    /**
+     * every thread cache ever created, linked through Thread_Cache::m_next_cache.
+     */
+    Thread_Cache *m_caches;
+
+    /**
+     * the next block and the end of the range of every tiny class.
+     */
+    char *m_tiny_bump[tiny_class_count];
+    char *m_tiny_end[tiny_class_count];
+
+    /**
+     * tiny blocks given back by the thread caches, linked with Block::next.
+     */
+    Block *m_tiny_free[tiny_class_count];
+
+    /**
+     * bytes carved from the tiny ranges, which are never given back.
+     */
+    std::size_t m_tiny_bytes;
+
+    /**
+     * the start and size of the tiny ranges, both 0 if they could not be reserved. Set once, by the constructor.
+     */
+    inline static std::uintptr_t s_tiny_base = 0;
+    inline static std::size_t s_tiny_size = 0;
+};
+
+/**
+ * Thread_Cache is the thread safe front end of the allocator.
+ *
+ * Every thread has its own cache, with a free list per size class (see Size_Classes). Allocating and freeing a block the
+ * thread owns only touches these lists, with no lock and no atomic. The lists are refilled from and drained to the
+ * Central_Heap in batches.
+ *
+ * A block freed by another thread is pushed on the remote free queue of its owner, a lock free stack that many threads
+ * can push to (multiple producers), but only the owner takes from, all at once (single consumer). Tiny blocks have no
+ * owner, they go to the cache of the thread that frees them.
+ */
+class Thread_Cache
+{
+public:
+    /**
+     * Allocates memory from the cache of the calling thread.
+     *
+     * @param size the number of bytes needed.
+     * @return a pointer to the memory, or nullptr if out of memory.
+     */
+    static void *allocate(std::size_t size);
+
+    /**
+     * Allocates memory aligned on a power of two. Blocks of the size classes are only aligned on 16 bytes, so bigger
+     * alignments are served by the Central_Heap, like large blocks. The memory is freed with deallocate().
+     *
+     * @param size the number of bytes needed.
+     * @param alignment a power of two.
+     * @return a pointer to the memory, or nullptr if out of memory.
+     */
+    static void *allocate_aligned(std::size_t size, std::size_t alignment);
+
+    /**
+     * Frees memory allocated by allocate(), from any thread.
+     *
+     * @param pointer the memory being freed, nullptr is ignored.
+     */
+    static void deallocate(void *pointer);
+
+    /**
+     * Frees memory allocated by allocate(), from any thread, when its size is known (sized delete). The size class
+     * comes from the size instead of the header of the block.
+     *
+     * @param pointer the memory being freed, nullptr is ignored.
+     * @param size the size given to allocate().
+     */
+    static void deallocate(void *pointer, std::size_t size);
+
+    /**
+     * Resizes memory allocated by allocate(). A block that still fits its size class stays where it is, and a large
+     * block is resized by the Central_Heap, in place when it can. Other blocks are copied to a new block.
+     *
+     * @param pointer the memory being resized, nullptr allocates new memory.
+     * @param size the new number of bytes.
+     * @return a pointer to the memory, or nullptr if out of memory, in which case pointer is left untouched.
+     */
+    static void *reallocate(void *pointer, std::size_t size);
+
+    /**
+     * Returns the number of bytes that can be used in a block, at least the size given to allocate().
+     *
+     * @param pointer memory allocated by allocate().
+     */
+    static std::size_t usable_size(void *pointer);
+
+    /**
+     * size of the biggest class. Bigger blocks go straight to the Central_Heap.
+     */
+    static constexpr std::size_t max_class_size = std::size_t{32} << 10;
+
+    /**
+     * number of size classes, the classes of Size_Classes up to max_class_size.
+     */
+    static constexpr std::size_t class_count = Size_Classes::index(max_class_size) + 1;
+
+    /**
+     * size_class of the blocks that do not belong to a thread cache.
+     */
+    static constexpr std::size_t large_class = class_count;
+
+    /**
+     * number of blocks moved from or to the Central_Heap at once.
+     */
+    static constexpr std::size_t batch_size = 32;
+
+    /**
+     * a free list longer than this gives batch_size blocks back to the Central_Heap.
+     */
+    static constexpr std::size_t max_cached = 2 * batch_size;
+
+private:
+    friend class Central_Heap;
+    friend class Thread_Exit;
+
+    Thread_Cache();
+
+    /**
+     * Returns the cache of the calling thread, creating it if it has none.
+     */
+    static Thread_Cache *current();
+
+    /**
+     * Returns the size class of a size, rounded up to 16 bytes first so the blocks of the class stay aligned.
+     *
+     * @param size the number of bytes needed, at most the biggest class.
+     * @return the index of the smallest class that fits it.
+     */
+    static std::size_t class_of(std::size_t size);
+
+    /**
+     * Returns the size class of a block, from its address for tiny blocks and from its header otherwise.
+     *
+     * @param pointer memory allocated by allocate().
+     */
+    static std::size_t class_of_block(void *pointer);
+
+    /**
+     * Frees a block, pushing it on the free list of its class or sending it back to its owner.
+     *
+     * @param block the block being freed.
+     * @param size_class the class of the block.
+     */
+    static void release(Block *block, std::size_t size_class);
+
+    /**
+     * Fills an empty free list, first with the blocks freed by other threads, then with a batch from the
+     * Central_Heap.
+     *
+     * @param size_class the class of the empty free list.
+     * @return false if out of memory.
+     */
+    bool refill(std::size_t size_class);
+
+    /**
+     * Gives batch_size blocks of a free list back to the Central_Heap.
+     *
+     * @param size_class the class of the free list.
+     */
+    void drain(std::size_t size_class);
+
+    /**
+     * Moves all the blocks freed by other threads to the free lists.
+     */
+    void collect_remote_frees();
+
+    /**
+     * Pushes a block freed by another thread on the remote free queue. This is the only function called on a cache
+     * by a thread that does not own it.
+     *
+     * @param block the block being freed.
+     */
+    void remote_free(Block *block);
+
+    /**
+     * Gives every block back to the Central_Heap, when the thread exits.
+     */
+    void flush();
+
+    /**
+     * Adds one to a counter only written by the owner of the cache, with no atomic read modify write.
+     */
+    static void count(std::atomic<std::size_t> &counter)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    /**
+     * the first free block of every size class.
+     */
+    Block *m_free[class_count];
+
+    /**
+     * the number of blocks in every free list.
+     */
+    std::size_t m_count[class_count];
+
+    /**
+     * the top of the remote free queue.
+     */
+    std::atomic<Block *> m_remote_frees;
+
+    /**
+     * next cache in the list of caches left by exited threads.
+     */
+    Thread_Cache *m_next_orphan;
+
+    /**
+     * next cache in the list of every cache.
+     */
+    Thread_Cache *m_next_cache;
+
+    /**
+     * allocations served by a free list (hits), or needing a refill (misses), per size class. They are atomics only so
+     * that Central_Heap::get_stats() can read them from another thread.
+     */
+    std::atomic<std::size_t> m_hits[class_count];
+    std::atomic<std::size_t> m_misses[class_count];
+
+    /**
+     * blocks sent back to this cache by other threads.
+     */
+    std::atomic<std::size_t> m_remote_free_count;
+};
+
+#endif //THREAD_CACHE_H
@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <unistd.h>
+#include "trace.h"
+
+bool read_trace(const std::string &path, std::vector<Trace_Event> &events)
+{
+    std::ifstream file{path};
+    if (!file)
+    {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream fields{line};
+        char type{0};
+        Trace_Event event{};
+        fields >> type >> event.id;
+
+        if (type == 'a')
+        {
+            event.type = Trace_Event::kind::alloc;
+            fields >> event.size;
+        }
+        else if (type == 'f')
+        {
+            event.type = Trace_Event::kind::free;
+        }
+        else
+        {
+            continue;
+        }
+
+        fields >> event.timestamp >> event.thread;
+        if (fields)
+        {
+            events.push_back(event);
+        }
+    }
+    return true;
+}
+
+bool write_trace(const std::string &path, const std::vector<Trace_Event> &events)
+{
+    std::ofstream file{path};
+    for (const auto &event : events)
+    {
+        if (event.type == Trace_Event::kind::alloc)
+        {
+            file << "a " << event.id << " " << event.size;
+        }
+        else
+        {
+            file << "f " << event.id;
+        }
+        file << " " << event.timestamp << " " << event.thread << "\n";
+    }
+    return static_cast<bool>(file);
+}
+
+/**
+ * Adds the events of a synthetic trace: every allocation is freed at the step given by its lifetime, the steps being
+ * 100 ns apart.
+ */
+class Trace_Builder
+{
+public:
+    void alloc(std::uint64_t id, std::size_t size, std::uint32_t thread)
+    {
+        events.push_back(Trace_Event{Trace_Event::kind::alloc, id, size, events.size() * 100, thread});
+    }
+
+    void free(std::uint64_t id, std::uint32_t thread)
+    {
+        events.push_back(Trace_Event{Trace_Event::kind::free, id, 0, events.size() * 100, thread});
+    }
+
+    std::vector<Trace_Event> events;
+};
+
+std::vector<Trace_Event> generate_power_law(std::size_t allocations, std::uint32_t seed)
+{
+    std::mt19937_64 random{seed};
+    std::uniform_real_distribution<double> uniform{0.0, 1.0};
+    std::geometric_distribution<std::size_t> short_lifetime{0.1};
+    std::uniform_int_distribution<std::size_t> long_lifetime{0, allocations};
+
+    // allocations waiting to be freed, the one freed first on top
+    using Pending = std::pair<std::size_t, std::uint64_t>;
+    std::priority_queue<Pending, std::vector<Pending>, std::greater<>> pending;
+    Trace_Builder trace;
+
+    for (std::uint64_t id = 0; id < allocations; id++)
+    {
+        while (!pending.empty() && pending.top().first <= id)
+        {
+            trace.free(pending.top().second, 0);
+            pending.pop();
+        }
+
+        // Pareto distribution with alpha = 1.1: 8 bytes at least, half of the blocks under 16 bytes, 1 MiB at most
+        auto size = 8.0 * std::pow(1.0 - uniform(random), -1.0 / 1.1);
+        trace.alloc(id, static_cast<std::size_t>(std::min(size, 1048576.0)), 0);
+
+        // 90% of the blocks die young, the others live for a random part of the trace
+        auto lifetime = uniform(random) < 0.9 ? short_lifetime(random) : long_lifetime(random);
+        pending.push({id + 1 + lifetime, id});
+    }
+
+    while (!pending.empty())
+    {
+        trace.free(pending.top().second, 0);
+        pending.pop();
+    }
+    return trace.events;
+}
+
+std::vector<Trace_Event> generate_producer_consumer(std::size_t allocations, std::uint32_t seed)
+{
+    std::mt19937_64 random{seed};
+    std::discrete_distribution<std::size_t> message_size{50, 30, 15, 4, 1};
+    const std::size_t sizes[] = {64, 256, 1024, 4096, 65536};
+    std::uniform_int_distribution<int> depth_change{-4, 4};
+
+    std::deque<std::uint64_t> queue;
+    std::size_t depth{32};
+    Trace_Builder trace;
+
+    for (std::uint64_t id = 0; id < allocations; id++)
+    {
+        // the producer (thread 0) allocates a message and queues it
+        trace.alloc(id, sizes[message_size(random)], 0);
+        queue.push_back(id);
+
+        // the consumer (thread 1) frees the oldest messages when the queue is longer than it can hold, which changes
+        // over time
+        depth = std::clamp<std::size_t>(depth + depth_change(random), 1, 256);
+        while (queue.size() > depth)
+        {
+            trace.free(queue.front(), 1);
+            queue.pop_front();
+        }
+    }
+
+    while (!queue.empty())
+    {
+        trace.free(queue.front(), 1);
+        queue.pop_front();
+    }
+    return trace.events;
+}
+
+/**
+ * State of the recorder, protected by trace_mutex. It lives in static storage, as the recorder must not allocate.
+ */
+static std::mutex trace_mutex;
+static int trace_file = -1;
+static char trace_buffer[1 << 16];
+static std::size_t trace_length = 0;
+static std::chrono::steady_clock::time_point trace_start;
+
+/**
+ * the number given to the next thread that allocates.
+ */
+static std::atomic<std::uint32_t> trace_threads{0};
+
+/**
+ * Writes the buffer to the file. trace_mutex must be held.
+ */
+static void flush_trace()
+{
+    std::size_t written{0};
+    while (written < trace_length)
+    {
+        auto result = ::write(trace_file, trace_buffer + written, trace_length - written);
+        if (result <= 0)
+        {
+            break;
+        }
+        written += result;
+    }
+    trace_length = 0;
+}
+
+void Trace_Recorder::record_alloc(void *pointer, std::size_t size)
+{
+    if (pointer != nullptr)
+    {
+        record('a', pointer, size);
+    }
+}
+
+void Trace_Recorder::record_free(void *pointer)
+{
+    if (pointer != nullptr)
+    {
+        record('f', pointer, 0);
+    }
+}
+
+void Trace_Recorder::record(char type, void *pointer, std::size_t size)
+{
+    static thread_local std::uint32_t thread = trace_threads.fetch_add(1, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock{trace_mutex};
+    if (!enabled())
+    {
+        return;
+    }
+
+    // longest event: a letter, four numbers and their separators
+    if (sizeof(trace_buffer) - trace_length < 96)
+    {
+        flush_trace();
+    }
+
+    auto timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - trace_start);
+    char event[96];
+    auto position = event;
+
+    // every number takes at most 20 characters
+    *position++ = type;
+    *position++ = ' ';
+    position = std::to_chars(position, position + 20, reinterpret_cast<std::uintptr_t>(pointer)).ptr;
+    if (type == 'a')
+    {
+        *position++ = ' ';
+        position = std::to_chars(position, position + 20, size).ptr;
+    }
+    *position++ = ' ';
+    position = std::to_chars(position, position + 20, static_cast<std::uint64_t>(timestamp.count())).ptr;
+    *position++ = ' ';
+    position = std::to_chars(position, position + 20, thread).ptr;
+    *position++ = '\n';
+
+    std::memcpy(trace_buffer + trace_length, event, position - event);
+    trace_length += position - event;
+}
+
+bool Trace_Recorder::start(const char *path)
+{
+    if (path == nullptr)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock{trace_mutex};
+    if (enabled())
+    {
+        return false;
+    }
+
+    trace_file = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (trace_file < 0)
+    {
+        return false;
+    }
+
+    trace_start = std::chrono::steady_clock::now();
+    s_enabled.store(true, std::memory_order_relaxed);
+    std::atexit(stop);
+    return true;
+}
+
+void Trace_Recorder::stop()
+{
+    std::lock_guard<std::mutex> lock{trace_mutex};
+    if (!enabled())
+    {
+        return;
+    }
+
+    s_enabled.store(false, std::memory_order_relaxed);
+    flush_trace();
+    ::close(trace_file);
+    trace_file = -1;
+}
@@ -0,0 +1,136 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * One allocation or free of an allocation trace.
+ *
+ * A trace is a text file with one event per line, in the order they happened:
+ *
+ *     a <id> <size> <timestamp> <thread>
+ *     f <id> <timestamp> <thread>
+ *
+ * The id links a free to its allocation, and is only unique among the live allocations: the recorder uses the address
+ * of the block, which is reused once it is freed. Timestamps are in nanoseconds since the start of the recording, and
+ * threads are numbered from 0 in the order they are first seen.
+ */
+class Trace_Event
+{
+public:
+    enum class kind
+    {
+        alloc,
+        free
+    };
+
+    kind type;
+    std::uint64_t id;
+
+    /**
+     * the number of bytes asked for, 0 for a free.
+     */
+    std::size_t size;
+
+    std::uint64_t timestamp;
+    std::uint32_t thread;
+};
+
+/**
+ * Reads a trace file, skipping lines that are not events.
+ *
+ * @param path the trace file.
+ * @param events where the events are appended.
+ * @return false if the file could not be opened.
+ */
+bool read_trace(const std::string &path, std::vector<Trace_Event> &events);
+
+/**
+ * Writes a trace file.
+ *
+ * @param path the trace file, overwritten.
+ * @param events the events, in order.
+ * @return false if the file could not be written.
+ */
+bool write_trace(const std::string &path, const std::vector<Trace_Event> &events);
+
+/**
+ * Synthetic trace of a single thread, with sizes following a power law (many small blocks, a few very big ones) and
+ * lifetimes that are mostly short with a long tail, so some blocks stay alive for most of the trace.
+ *
+ * @param allocations the number of allocations, every one of them is freed.
+ * @param seed the seed of the random generator.
+ * @return the events.
+ */
+std::vector<Trace_Event> generate_power_law(std::size_t allocations, std::uint32_t seed);
+
+/**
+ * Synthetic trace of a producer thread allocating messages and a consumer thread freeing them, in the same order,
+ * once they have waited in a queue. Every message is freed by the thread that did not allocate it.
+ *
+ * @param allocations the number of messages.
+ * @param seed the seed of the random generator.
+ * @return the events.
+ */
+std::vector<Trace_Event> generate_producer_consumer(std::size_t allocations, std::uint32_t seed);
+
+/**
+ * Records the allocations made through operator new and delete (see Allocation.h) to a trace file.
+ *
+ * Recording starts when the process starts if the ALLOCATOR_TRACE environment variable holds the path of the trace.
+ * The recorder never allocates itself: events are formatted into a static buffer under a mutex, which is written to
+ * the file when it is full and when the process exits. The mutex also gives the events of all threads a single order.
+ */
+class Trace_Recorder
+{
+public:
+    /**
+     * Returns whether allocations are being recorded, a relaxed load so it costs nothing when they are not.
+     */
+    static bool enabled()
+    {
+        return s_enabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Records an allocation.
+     *
+     * @param pointer the block, nullptr is ignored.
+     * @param size the number of bytes asked for.
+     */
+    static void record_alloc(void *pointer, std::size_t size);
+
+    /**
+     * Records a free.
+     *
+     * @param pointer the block, nullptr is ignored.
+     */
+    static void record_free(void *pointer);
+
+    /**
+     * Starts recording to a file.
+     *
+     * @param path the trace file, overwritten.
+     * @return false if the file could not be opened.
+     */
+    static bool start(const char *path);
+
+    /**
+     * Writes the buffered events and stops recording.
+     */
+    static void stop();
+
+private:
+    /**
+     * Formats an event into the buffer, writing the buffer out first if the event does not fit.
+     */
+    static void record(char type, void *pointer, std::size_t size);
+
+    inline static std::atomic<bool> s_enabled{false};
+};
+
+#endif //TRACE_H
@@ -0,0 +1,402 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include "allocator.h"
+#include "monotonic_arena.h"
+#include "thread_cache.h"
+#include "trace.h"
+
+/*
+ * Replays allocation traces (see trace.h) against every allocator of the repo and glibc malloc.
+ *
+ * usage: allocator_replay [--format=text|csv|json] [--filter=TEXT] TRACE...
+ *        allocator_replay --generate=power_law|producer_consumer [--allocations=N] [--seed=N] --output=TRACE
+ *
+ * The events are replayed in the order of the trace, as fast as possible, from a single thread: the gaps between
+ * timestamps are not waited for, and the thread of an event only matters to the allocator through the order of the
+ * events. Every allocator runs in its own child process, so that its peak RSS is not mixed with the others'.
+ */
+
+/**
+ * number of latency buckets, bucket i counts the operations that took [2^i, 2^(i+1)) nanoseconds.
+ */
+constexpr std::size_t bucket_count = 24;
+
+/**
+ * What the child process sends back after replaying a trace.
+ */
+class Replay_Result
+{
+public:
+    double seconds;
+    std::size_t operations;
+    std::size_t peak_rss;
+    std::size_t histogram[bucket_count];
+
+    double ops_per_second() const { return operations / seconds; }
+
+    /**
+     * Returns the upper bound of the bucket holding the operation of rank q * operations.
+     */
+    double percentile(double q) const
+    {
+        auto rank = static_cast<std::size_t>(q * operations);
+        std::size_t seen{0};
+        for (std::size_t i = 0; i < bucket_count; i++)
+        {
+            seen += histogram[i];
+            if (seen > rank)
+            {
+                return static_cast<double>(std::size_t{2} << i);
+            }
+        }
+        return static_cast<double>(std::size_t{1} << bucket_count);
+    }
+};
+
+/**
+ * An allocator the trace is replayed against.
+ */
+class Replay_Target
+{
+public:
+    std::string name;
+    std::function<void *(std::size_t)> allocate;
+    std::function<void(void *)> deallocate;
+};
+
+/**
+ * Returns the peak resident set size of the process in bytes, read from /proc/self/status.
+ */
+std::size_t peak_resident_bytes()
+{
+    std::ifstream status{"/proc/self/status"};
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.rfind("VmHWM:", 0) == 0)
+        {
+            return std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Returns the resident set size of the process in bytes, read from /proc/self/statm.
+ */
+std::size_t resident_bytes()
+{
+    std::ifstream statm{"/proc/self/statm"};
+    std::size_t pages{0}, resident{0};
+    statm >> pages >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+/**
+ * Replays the events, timing every one of them.
+ *
+ * @param events the trace.
+ * @param target the allocator.
+ * @return the timings. peak_rss is the growth of the peak RSS over the RSS before the replay.
+ */
+Replay_Result replay(const std::vector<Trace_Event> &events, const Replay_Target &target)
+{
+    Replay_Result result{};
+    std::unordered_map<std::uint64_t, void *> live;
+    live.reserve(events.size());
+
+    // resets the peak RSS to the current RSS
+    std::ofstream{"/proc/self/clear_refs"} << "5";
+    auto baseline = resident_bytes();
+
+    auto start = std::chrono::steady_clock::now();
+    for (const auto &event : events)
+    {
+        auto before = std::chrono::steady_clock::now();
+        if (event.type == Trace_Event::kind::alloc)
+        {
+            auto pointer = target.allocate(std::max<std::size_t>(event.size, 1));
+            if (pointer == nullptr)
+            {
+                continue;
+            }
+            // touches the block, as the program that was traced would have
+            std::memset(pointer, 0, std::min<std::size_t>(event.size, 64));
+            live[event.id] = pointer;
+        }
+        else
+        {
+            // frees of blocks allocated before the recording started are skipped
+            auto found = live.find(event.id);
+            if (found == live.end())
+            {
+                continue;
+            }
+            target.deallocate(found->second);
+            live.erase(found);
+        }
+        auto after = std::chrono::steady_clock::now();
+
+        auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(after - before).count();
+        auto bucket = std::bit_width(static_cast<std::uint64_t>(std::max<std::int64_t>(nanoseconds, 1))) - 1;
+        result.histogram[std::min<std::size_t>(bucket, bucket_count - 1)]++;
+        result.operations++;
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    result.seconds = std::chrono::duration<double>(end - start).count();
+    auto peak = peak_resident_bytes();
+    result.peak_rss = peak > baseline ? peak - baseline : 0;
+    return result;
+}
+
+/**
+ * Replays the trace in a child process.
+ *
+ * @return false if the child failed.
+ */
+bool replay_in_child(const std::vector<Trace_Event> &events, const Replay_Target &target, Replay_Result &result)
+{
+    int pipe_ends[2];
+    if (pipe(pipe_ends) != 0)
+    {
+        return false;
+    }
+
+    auto child = fork();
+    if (child == 0)
+    {
+        close(pipe_ends[0]);
+        auto child_result = replay(events, target);
+        auto written = write(pipe_ends[1], &child_result, sizeof(child_result));
+        _exit(written == sizeof(child_result) ? 0 : 1);
+    }
+
+    close(pipe_ends[1]);
+    auto received = child > 0 ? read(pipe_ends[0], &result, sizeof(result)) : 0;
+    close(pipe_ends[0]);
+
+    int status{0};
+    if (child > 0)
+    {
+        waitpid(child, &status, 0);
+    }
+    return received == sizeof(result) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+const char *search_mode_name(Memory_Linked_List::search_mode search)
+{
+    switch (search)
+    {
+    case Memory_Linked_List::search_mode::first_fit:
+        return "first_fit";
+    case Memory_Linked_List::search_mode::next_fit:
+        return "next_fit";
+    case Memory_Linked_List::search_mode::best_fit:
+        return "best_fit";
+    case Memory_Linked_List::search_mode::free_list:
+        return "free_list";
+    case Memory_Linked_List::search_mode::segregated:
+        return "segregated";
+    case Memory_Linked_List::search_mode::slab:
+        return "slab";
+    }
+    return "unknown";
+}
+
+/**
+ * Returns every allocator to replay against. The heaps and the arena take no memory until their first allocation,
+ * which happens in the child process.
+ */
+std::vector<Replay_Target> replay_targets()
+{
+    std::vector<Replay_Target> targets;
+
+    std::array<Memory_Linked_List::search_mode, 6> search_modes = {Memory_Linked_List::search_mode::first_fit, Memory_Linked_List::search_mode::next_fit, Memory_Linked_List::search_mode::best_fit, Memory_Linked_List::search_mode::free_list, Memory_Linked_List::search_mode::segregated, Memory_Linked_List::search_mode::slab};
+    for (auto search : search_modes)
+    {
+        auto heap = std::make_shared<Memory_Linked_List>();
+        heap->set_search_mode(search);
+        targets.push_back(Replay_Target{search_mode_name(search),
+                                        [heap](std::size_t size)
+                                        { return static_cast<void *>(heap->alloc(size)); },
+                                        [heap](void *pointer)
+                                        { heap->free(static_cast<intptr_t *>(pointer)); }});
+    }
+
+    targets.push_back(Replay_Target{"thread_cache", Thread_Cache::allocate, [](void *pointer)
+                                    { Thread_Cache::deallocate(pointer); }});
+
+    // frees nothing, so its peak RSS is the total of all allocations
+    auto arena = std::make_shared<Monotonic_Arena>();
+    targets.push_back(Replay_Target{"monotonic_arena", [arena](std::size_t size)
+                                    { return arena->allocate(size); },
+                                    [](void *) {}});
+
+    targets.push_back(Replay_Target{"malloc", std::malloc, std::free});
+    return targets;
+}
+
+int generate(const std::string &generator, std::size_t allocations, std::uint32_t seed, const std::string &output)
+{
+    std::vector<Trace_Event> events;
+    if (generator == "power_law")
+    {
+        events = generate_power_law(allocations, seed);
+    }
+    else if (generator == "producer_consumer")
+    {
+        events = generate_producer_consumer(allocations, seed);
+    }
+    else
+    {
+        std::cerr << "unknown generator " << generator << std::endl;
+        return 1;
+    }
+
+    if (output.empty() || !write_trace(output, events))
+    {
+        std::cerr << "cannot write the trace to " << output << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+void print_result(const std::string &format, const std::string &trace, const std::string &target,
+                  const Replay_Result &result, bool first)
+{
+    if (format == "csv")
+    {
+        std::cout << trace << "," << target << "," << result.operations << "," << result.ops_per_second() << ","
+                  << result.percentile(0.5) << "," << result.percentile(0.99) << "," << result.peak_rss << std::endl;
+    }
+    else if (format == "json")
+    {
+        std::cout << (first ? "" : ",") << "{\"trace\":\"" << trace << "\",\"allocator\":\"" << target
+                  << "\",\"operations\":" << result.operations << ",\"ops_per_sec\":" << result.ops_per_second()
+                  << ",\"p50_ns\":" << result.percentile(0.5) << ",\"p99_ns\":" << result.percentile(0.99)
+                  << ",\"peak_rss\":" << result.peak_rss << ",\"histogram\":[";
+        for (std::size_t i = 0; i < bucket_count; i++)
+        {
+            std::cout << (i == 0 ? "" : ",") << result.histogram[i];
+        }
+        std::cout << "]}";
+    }
+    else
+    {
+        std::cout << "    " << target << ": " << result.ops_per_second() / 1e6 << " Mops/s, p50 < "
+                  << result.percentile(0.5) << " ns, p99 < " << result.percentile(0.99) << " ns, peak RSS "
+                  << result.peak_rss / 1024 << " KiB" << std::endl;
+        std::cout << "        ";
+        for (std::size_t i = 0; i < bucket_count; i++)
+        {
+            if (result.histogram[i] != 0)
+            {
+                std::cout << "<" << (std::size_t{2} << i) << "ns:" << result.histogram[i] << " ";
+            }
+        }
+        std::cout << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::string format{"text"};
+    std::string generator, output, filter;
+    std::size_t allocations{100000};
+    std::uint32_t seed{42};
+    std::vector<std::string> traces;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        auto equals = argument.find('=');
+        auto name = argument.substr(0, equals);
+        auto value = equals == std::string::npos ? std::string{} : argument.substr(equals + 1);
+
+        if (name == "--format" && (value == "text" || value == "csv" || value == "json"))
+            format = value;
+        else if (name == "--filter")
+            filter = value;
+        else if (name == "--generate")
+            generator = value;
+        else if (name == "--allocations" && std::atol(value.c_str()) > 0)
+            allocations = std::atol(value.c_str());
+        else if (name == "--seed")
+            seed = std::atol(value.c_str());
+        else if (name == "--output")
+            output = value;
+        else if (argument.rfind("--", 0) != 0)
+            traces.push_back(argument);
+        else
+        {
+            traces.clear();
+            break;
+        }
+    }
+
+    if (!generator.empty())
+    {
+        return generate(generator, allocations, seed, output);
+    }
+
+    if (traces.empty())
+    {
+        std::cerr << "usage: " << argv[0] << " [--format=text|csv|json] [--filter=TEXT] TRACE..." << std::endl
+                  << "       " << argv[0]
+                  << " --generate=power_law|producer_consumer [--allocations=N] [--seed=N] --output=TRACE" << std::endl;
+        return 1;
+    }
+
+    if (format == "csv")
+        std::cout << "trace,allocator,operations,ops_per_sec,p50_ns,p99_ns,peak_rss" << std::endl;
+    else if (format == "json")
+        std::cout << "{\"results\":[";
+
+    bool first{true};
+    for (const auto &trace : traces)
+    {
+        std::vector<Trace_Event> events;
+        if (!read_trace(trace, events))
+        {
+            std::cerr << "cannot read " << trace << std::endl;
+            return 1;
+        }
+        if (format == "text")
+            std::cout << trace << " (" << events.size() << " events):" << std::endl;
+
+        for (const auto &target : replay_targets())
+        {
+            // only the allocators whose name contains the filter
+            if (target.name.find(filter) == std::string::npos)
+                continue;
+
+            Replay_Result result{};
+            if (!replay_in_child(events, target, result))
+            {
+                std::cerr << target.name << " failed on " << trace << std::endl;
+                continue;
+            }
+            print_result(format, trace, target.name, result, first);
+            first = false;
+        }
+    }
+
+    if (format == "json")
+        std::cout << "]}" << std::endl;
+    return 0;
+}